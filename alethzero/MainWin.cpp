@@ -1148,7 +1148,7 @@ void Main::populateDebugger(eth::bytesConstRef _r)
 		auto onOp = [&](uint64_t steps, Instruction inst, unsigned newMemSize, eth::bigint gasCost, void* voidVM, void const* voidExt)
 		{
 			eth::VM& vm = *(eth::VM*)voidVM;
-			eth::ExtVM const& ext = *(eth::ExtVM const*)voidExt;
+			eth::ExtVM const& ext = static_cast<eth::ExtVM const&>(*static_cast<eth::ExtVMFace const*>(voidExt));
 			if (ext.code != lastExtCode)
 			{
 				lastExtCode = ext.code;
@@ -1167,7 +1167,7 @@ void Main::populateDebugger(eth::bytesConstRef _r)
 				levels.push_back(&m_history.back());
 			else
 				levels.resize(ext.level);
-			m_history.append(WorldState({steps, ext.myAddress, vm.curPC(), inst, newMemSize, vm.gas(), lastHash, lastDataHash, vm.stack(), vm.memory(), gasCost, ext.state().storage(ext.myAddress), levels}));
+			m_history.append(WorldState({steps, ext.myAddress, vm.curPC(), inst, newMemSize, vm.gas(), lastHash, lastDataHash, vm.stack(), vm.memory().toBytes(), gasCost, ext.state().storage(ext.myAddress), levels}));
 		};
 		m_currentExecution->go(onOp);
 		initDebugger();
@@ -31,12 +31,15 @@
 #endif
 #include <libethcore/FileSystem.h>
 #include <libevmface/Instruction.h>
+#include <libevm/VM.h>
 #include <libethereum/Defaults.h>
 #include <libethereum/Client.h>
 #include <libethereum/PeerNetwork.h>
 #include <libethereum/BlockChain.h>
 #include <libethereum/State.h>
+#include <libethereum/StateDump.h>
 #include <libethcore/CommonEth.h>
+#include <libethcore/Exceptions.h>
 #if ETH_READLINE
 #include <readline/readline.h>
 #include <readline/history.h>
@@ -81,12 +84,13 @@ void interactiveHelp()
 		<< "    send  Execute a given transaction with current secret." << endl
 		<< "    contract  Create a new contract with current secret." << endl
 		<< "    peers  List the peers that are connected" << endl
-		<< "    listAccounts List the accounts on the network." << endl
-		<< "    listContracts List the contracts on the network." << endl
+		<< "    listAccounts [<addr> [<count>]] List the accounts on the network (from addr, at most count of them)." << endl
+		<< "    listContracts [<addr> [<count>]] List the contracts on the network (from addr, among at most count addresses)." << endl
 		<< "    setSecret <secret> Set the secret to the hex secret key." <<endl
 		<< "    setAddress <addr> Set the coinbase (mining payout) address." <<endl
 		<< "    exportConfig <path> Export the config (.RLP) to the path provided." <<endl
 		<< "    importConfig <path> Import the config (.RLP) from the path provided." <<endl
+		<< "    exportState <path> [<block>] Export the state of the given block (default: the latest) to the path provided." << endl
 		<< "    inspect <contract> Dumps a contract to <APPDATA>/<contract>.evm." << endl
 		<< "    exit  Exits the application." << endl;
 }
@@ -100,8 +104,10 @@ void help()
         << "    -c,--client-name <name>  Add a name to your client's version string (default: blank)." << endl
         << "    -d,--db-path <path>  Load database from path (default:  ~/.ethereum " << endl
         << "                         <APPDATA>/Etherum or Library/Application Support/Ethereum)." << endl
+        << "    --db-engine [<db>=]<engine>  Use the engine leveldb, memory or log for the DB db (state, blocks or details) or for all (default: leveldb)." << endl
         << "    -h,--help  Show this help message and exit." << endl
         << "    -i,--interactive  Enter interactive mode (default: non-interactive)." << endl
+        << "    --import-state <path>  Import a state dump of a block already in the block chain DB, before starting." << endl
 #if ETH_JSONRPC
 		<< "    -j,--json-rpc  Enable JSON-RPC server (default: off)." << endl
 		<< "    --json-rpc-port  Specify JSON-RPC server port (implies '-j', default: 8080)." << endl
@@ -111,12 +117,15 @@ void help()
         << "    -n,--upnp <on/off>  Use upnp for NAT (default: on)." << endl
         << "    -o,--mode <full/peer>  Start a full node or a peer node (Default: full)." << endl
         << "    -p,--port <port>  Connect to remote port (default: 30303)." << endl
+        << "    --prune <blocks>  Keep only the states of the last given number of blocks in the state DB; 0 keeps all (default: 0)." << endl
         << "    -r,--remote <host>  Connect to remote host (default: none)." << endl
         << "    -s,--secret <secretkeyhex>  Set the secret key for use with send command (default: auto)." << endl
         << "    -u,--public-ip <ip>  Force public ip to given (default; auto)." << endl
         << "    -v,--verbosity <0 - 9>  Set the log verbosity from 0 to 9 (Default: 8)." << endl
         << "    -x,--peers <number>  Attempt to connect to given number of peers (Default: 5)." << endl
-        << "    -V,--version  Show the version and exit." << endl;
+        << "    -V,--version  Show the version and exit." << endl
+        << "    --vm <switch/threaded>  Run contract code with the switch or the threaded interpreter (default: threaded where built)." << endl
+        << "    --vm-predecode <runs/never>  Pre-decode contract code once it's been run this many times (default: 0)." << endl;
         exit(0);
 }
 
@@ -170,6 +179,28 @@ string pretty(h160 _a, eth::State _st)
 	return ns;
 }
 bytes parse_data(string _args);
+
+/// Read the address at which a listing starts into @a o_from: the zero address if @a _hex is empty.
+/// @returns false if @a _hex is given but isn't a whole address.
+bool listingFrom(string const& _hex, Address& o_from)
+{
+	bytes b;
+	try
+	{
+		b = fromHex(_hex);
+	}
+	catch (BadHexCharacter const&)
+	{
+		return false;
+	}
+	if (b.size() != Address::size)
+	{
+		o_from = Address();
+		return _hex.empty();
+	}
+	o_from = Address(b);
+	return true;
+}
 int main(int argc, char** argv)
 {
 	unsigned short listenPort = 30303;
@@ -186,6 +217,7 @@ int main(int argc, char** argv)
 	string publicIP;
 	bool upnp = true;
 	string clientName;
+	string stateDump;
 
 	// Init defaults
 	Defaults::get();
@@ -241,6 +273,22 @@ int main(int argc, char** argv)
 			us = KeyPair(h256(fromHex(argv[++i])));
 		else if ((arg == "-d" || arg == "--path" || arg == "--db-path") && i + 1 < argc)
 			dbPath = argv[++i];
+		else if (arg == "--db-engine" && i + 1 < argc)
+		{
+			string e = argv[++i];
+			auto eq = e.find('=');
+			try
+			{
+				DBEngine engine = dbEngineFromString(e.substr(eq == string::npos ? 0 : eq + 1));
+				for (string const& db: eq == string::npos ? vector<string>{"state", "blocks", "details"} : vector<string>{e.substr(0, eq)})
+					Defaults::setDBEngine(db, engine);
+			}
+			catch (DatabaseError const& _e)
+			{
+				cerr << _e.description() << endl;
+				return -1;
+			}
+		}
 		else if ((arg == "-m" || arg == "--mining") && i + 1 < argc)
 		{
 			string m = argv[++i];
@@ -258,6 +306,28 @@ int main(int argc, char** argv)
 		}
 		else if (arg == "-i" || arg == "--interactive")
 			interactive = true;
+		else if (arg == "--vm" && i + 1 < argc)
+		{
+			string m = argv[++i];
+			if (m == "switch")
+				VM::setCore(VMCore::Switch);
+			else if (m == "threaded")
+				VM::setCore(VMCore::Threaded);
+			else
+			{
+				cerr << "Unknown VM core: " << m << endl;
+				return -1;
+			}
+		}
+		else if (arg == "--vm-predecode" && i + 1 < argc)
+		{
+			string m = argv[++i];
+			VM::setDecodeAfter(m == "never" ? ~0u : (unsigned)atoi(m.c_str()));
+		}
+		else if (arg == "--prune" && i + 1 < argc)
+			Defaults::setPruning((unsigned)atoi(argv[++i]));
+		else if (arg == "--import-state" && i + 1 < argc)
+			stateDump = argv[++i];
 #if ETH_JSONRPC
 		else if ((arg == "-j" || arg == "--json-rpc"))
 			jsonrpc = jsonrpc ? jsonrpc : 8080;
@@ -289,6 +359,32 @@ int main(int argc, char** argv)
 			remoteHost = argv[i];
 	}
 
+	if (!stateDump.empty())
+	{
+		// Load the dump before the client opens the DBs, so it need only replay the blocks after the dump's.
+		BlockChain bc(dbPath);
+		OverlayDB stateDB = State::openDB(dbPath);
+		ifstream f(stateDump, ios::binary);
+		try
+		{
+			bytes b = bc.block(StateDump::blockOf(f));
+			if (b.empty())
+			{
+				cerr << "The block of state dump " << stateDump << " isn't in the block chain." << endl;
+				return -1;
+			}
+			f.seekg(0);
+			BlockInfo bi(b);
+			unsigned n = StateDump::read(stateDB, bi, f);
+			cout << "Imported " << n << " accounts, the state of block #" << bi.number << " " << bi.hash << endl;
+		}
+		catch (Exception const& _e)
+		{
+			cerr << "Couldn't import state dump " << stateDump << ": " << _e.description() << endl;
+			return -1;
+		}
+	}
+
 	if (!clientName.empty())
 		clientName += "/";
     Client c("Ethereum(++)/" + clientName + "v" + eth::EthVersion + "/" ETH_QUOTED(ETH_BUILD_TYPE) "/" ETH_QUOTED(ETH_BUILD_PLATFORM), coinbase, dbPath);
@@ -470,9 +566,18 @@ int main(int argc, char** argv)
 			}
 			else if (cmd == "listContracts")
 			{
+				string from;
+				unsigned count = numeric_limits<unsigned>::max();
+				iss >> from >> count;
+				Address start;
+				if (!listingFrom(from, start))
+				{
+					cwarn << "Invalid address: " << from << " (need 40 hex digits)";
+					continue;
+				}
 				ClientGuard g(&c);
 				auto const& st = c.state();
-				auto acs = st.addresses();
+				auto acs = st.addresses(start, count);
 				string ss;
 				for (auto const& i: acs)
 				{
@@ -486,9 +591,18 @@ int main(int argc, char** argv)
 			}
 			else if (cmd == "listAccounts")
 			{
+				string from;
+				unsigned count = numeric_limits<unsigned>::max();
+				iss >> from >> count;
+				Address start;
+				if (!listingFrom(from, start))
+				{
+					cwarn << "Invalid address: " << from << " (need 40 hex digits)";
+					continue;
+				}
 				ClientGuard g(&c);
 				auto const& st = c.state();
-				auto acs = st.addresses();
+				auto acs = st.addresses(start, count);
 				string ss;
 				for (auto const& i: acs)
 				{
@@ -666,6 +780,20 @@ int main(int argc, char** argv)
 				else
 					cwarn << "Require parameter: importConfig PATH";
 			}
+			else if (cmd == "exportState")
+			{
+				if (iss.peek() != -1)
+				{
+					string path;
+					int block = -1;
+					iss >> path >> block;
+					ofstream f(path, ios::binary);
+					unsigned n = c.exportState(f, block);
+					cout << "Exported " << n << " accounts to " << path << endl;
+				}
+				else
+					cwarn << "Require parameter: exportState PATH";
+			}
 			else if (cmd == "help")
 				interactiveHelp();
 			else if (cmd == "exit")
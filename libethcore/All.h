@@ -1,12 +1,17 @@
 #pragma once
 
 #include "BlockInfo.h"
+#include "ByteBoundedLRU.h"
 #include "CommonEth.h"
 #include "Dagger.h"
 #include "FileSystem.h"
+#include "KeyValueDB.h"
+#include "LogDB.h"
 #include "MemoryDB.h"
+#include "NodeCache.h"
 #include "OverlayDB.h"
 #include "SHA3.h"
 #include "TrieCommon.h"
 #include "TrieDB.h"
 #include "UPnP.h"
+#include "WorkerPool.h"
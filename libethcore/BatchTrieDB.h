@@ -0,0 +1,617 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file BatchTrieDB.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <libethential/Common.h>
+#include <libethential/RLP.h>
+#include <libethcore/SHA3.h>
+#include "TrieCommon.h"
+#include "TrieDB.h"
+#include "WorkerPool.h"
+
+namespace eth
+{
+
+/**
+ * @brief Merkle Patricia Tree "Trie" held as a mutable tree of nodes in memory on top of a database.
+ * Unlike GenericTrieDB, insert() and remove() neither serialise, hash nor store anything: nodes are
+ * pulled from the DB lazily as they're visited and changed in place. Only the nodes that remain when
+ * root() is asked for get hashed (once each, until changed again) and only those that remain on
+ * commit() get written. Nodes that were replaced are killed on commit(), so the DB ends up with the
+ * same nodes and reference counts as it would had the changes gone through GenericTrieDB.
+ * Usage:
+ * @code
+ * GenericBatchTrieDB<MyDB> t(&myDB, oldRoot);
+ * for (auto const& i: changes)
+ *   t.insert(i.first, i.second);
+ * t.commit();
+ * h256 newRoot = t.root();
+ * @endcode
+ */
+template <class DB>
+class GenericBatchTrieDB
+{
+public:
+	GenericBatchTrieDB(DB* _db): m_db(_db) { setRoot(h256()); }
+	GenericBatchTrieDB(DB* _db, h256 _root) { open(_db, _root); }
+	~GenericBatchTrieDB() {}
+
+	void open(DB* _db, h256 _root) { m_db = _db; setRoot(_root); }
+	void setRoot(h256 _root);
+
+	/// @returns the root hash of the trie with all changes so far. Nothing is written to the DB.
+	h256 root() const;
+
+	std::string at(bytesConstRef _key) const;
+	/// @note Inserting an empty value is equivalent to removing the key.
+	void insert(bytesConstRef _key, bytesConstRef _value);
+	void remove(bytesConstRef _key);
+	bool contains(bytesConstRef _key) const { return !at(_key).empty(); }
+
+	/// Write every node that changed since the last commit to the DB and kill those that they replaced.
+	void commit();
+
+	/// Set the number of threads, this one and the rest from the WorkerPool, used for hashing changed subtrees in root()
+	/// and commit().
+	void setHashers(unsigned _n) { m_hashers = std::max(1u, _n); }
+	unsigned hashers() const { return m_hashers; }
+
+private:
+	struct Node
+	{
+		enum Kind { Stub, Leaf, Extension, Branch };
+
+		Kind kind = Stub;
+		bytes key;										///< Nibbles (Leaf and Extension only).
+		std::string value;								///< Leaf or Branch value.
+		std::unique_ptr<Node> next;						///< Extension only.
+		std::array<std::unique_ptr<Node>, 16> children;	///< Branch only.
+		bytes ref;										///< If non-empty, the RLP item by which a parent refers to us (the node itself if inline, its hash otherwise). Stub nodes are nothing else.
+		h256 origin;									///< The hash under which the node as loaded lives in the DB. To be killed once the node changes or goes.
+		bool dirty = false;								///< True if the node is not in the DB in its present form.
+	};
+	using NodePtr = std::unique_ptr<Node>;
+
+	static NodePtr newNode(typename Node::Kind _kind, bytesConstRef _key = bytesConstRef());
+	static NodePtr newStub(bytesConstRef _ref) { NodePtr ret(new Node); ret->ref = _ref.toBytes(); return ret; }
+
+	/// Turn a stub into a proper node by decoding it (and looking it up in the DB, if it's referenced by hash).
+	void expand(Node& _n) const;
+	/// Note that @a _n is about to change.
+	void touch(Node& _n);
+	/// Note that @a _n is about to be destroyed.
+	void drop(Node& _n);
+
+	void insertAt(NodePtr& io_n, bytesConstRef _k, std::string const& _v);
+	bool removeAt(NodePtr& io_n, bytesConstRef _k);
+	/// Rejig the branch @a io_n if, after a removal, it has fewer than two things left in it.
+	void collapse(NodePtr& io_n);
+
+	bytes encode(Node& _n) const;
+	bytes const& refOf(Node& _n) const;
+	/// Work out the refs of the changed subtrees below the top few levels of @a _n in parallel, if there are enough of them.
+	void hashSubtrees(Node& _n) const;
+	void gatherSubtrees(Node& _n, unsigned _depth, std::vector<Node*>& o_subtrees) const;
+	void commitAux(Node& _n, bool _isRoot);
+
+	/// Depth at which changed subtrees are split off to be hashed in parallel; up to 16^depth of them.
+	static const unsigned c_parallelDepth = 2;
+	/// Fewer changed subtrees than this at c_parallelDepth and we hash serially; threads would cost more than they save.
+	static const unsigned c_minParallelSubtrees = 32;
+
+	mutable NodePtr m_root;
+	mutable h256 m_rootHash;		///< The root hash, if it is known; null otherwise.
+	bool m_nullInDB = false;		///< True if the root is (and is in the DB as) the empty node.
+	h256s m_killed;					///< The nodes to be killed on the next commit().
+	DB* m_db = nullptr;
+	unsigned m_hashers = std::max(1u, std::thread::hardware_concurrency());
+};
+
+template <class KeyType, class DB>
+class BatchTrieDB: public GenericBatchTrieDB<DB>
+{
+public:
+	BatchTrieDB(DB* _db): GenericBatchTrieDB<DB>(_db) {}
+	BatchTrieDB(DB* _db, h256 _root): GenericBatchTrieDB<DB>(_db, _root) {}
+
+	std::string operator[](KeyType _k) const { return at(_k); }
+
+	bool contains(KeyType _k) const { return GenericBatchTrieDB<DB>::contains(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
+	std::string at(KeyType _k) const { return GenericBatchTrieDB<DB>::at(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
+	void insert(KeyType _k, bytesConstRef _value) { GenericBatchTrieDB<DB>::insert(bytesConstRef((byte const*)&_k, sizeof(KeyType)), _value); }
+	void insert(KeyType _k, bytes const& _value) { insert(_k, bytesConstRef(&_value)); }
+	void remove(KeyType _k) { GenericBatchTrieDB<DB>::remove(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
+};
+
+}
+
+// Template implementations...
+namespace eth
+{
+
+template <class DB> void GenericBatchTrieDB<DB>::setRoot(h256 _root)
+{
+	m_root.reset();
+	m_killed.clear();
+	m_rootHash = _root ? _root : c_shaNull;
+	m_nullInDB = false;
+	if (m_rootHash == c_shaNull)
+		m_nullInDB = m_db->exists(c_shaNull);
+	else if (m_db->lookup(m_rootHash).empty())
+		throw RootNotFound();
+	else
+	{
+		bytes r = rlp(m_rootHash);
+		m_root = newStub(&r);
+	}
+}
+
+template <class DB> h256 GenericBatchTrieDB<DB>::root() const
+{
+	if (!m_rootHash && !m_root)
+		m_rootHash = c_shaNull;
+	else if (!m_rootHash)
+	{
+		expand(*m_root);
+		hashSubtrees(*m_root);
+		m_rootHash = sha3(encode(*m_root));
+	}
+	return m_rootHash == c_shaNull ? h256() : m_rootHash;
+}
+
+template <class DB> std::string GenericBatchTrieDB<DB>::at(bytesConstRef _key) const
+{
+	bytes k = asNibbles(_key.toString());
+	bytesConstRef r(&k);
+	for (Node* n = m_root.get(); n;)
+	{
+		expand(*n);
+		if (n->kind == Node::Leaf)
+			return r.contentsEqual(n->key) ? n->value : std::string();
+		else if (n->kind == Node::Extension)
+		{
+			if (r.size() < n->key.size() || !std::equal(n->key.begin(), n->key.end(), r.begin()))
+				break;
+			r = r.cropped(n->key.size());
+			n = n->next.get();
+		}
+		else if (r.empty())
+			return n->value;
+		else
+		{
+			n = n->children[r[0]].get();
+			r = r.cropped(1);
+		}
+	}
+	return std::string();
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::insert(bytesConstRef _key, bytesConstRef _value)
+{
+	if (_value.empty())
+	{
+		remove(_key);
+		return;
+	}
+	if (m_nullInDB)
+	{
+		m_killed.push_back(c_shaNull);
+		m_nullInDB = false;
+	}
+	bytes k = asNibbles(_key.toString());
+	insertAt(m_root, &k, _value.toString());
+	m_rootHash = h256();
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::remove(bytesConstRef _key)
+{
+	bytes k = asNibbles(_key.toString());
+	Node const* old = m_root.get();
+	if (removeAt(m_root, &k))
+	{
+		m_rootHash = h256();
+		if (m_root && m_root.get() != old)
+		{
+			// A node that was formerly inline may have become the root; the root must always be stored by hash.
+			expand(*m_root);
+			touch(*m_root);
+		}
+	}
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::commit()
+{
+	for (auto const& h: m_killed)
+		m_db->kill(h);
+	m_killed.clear();
+
+	if (m_root)
+	{
+		hashSubtrees(*m_root);
+		commitAux(*m_root, true);
+	}
+	else if (!m_nullInDB)
+	{
+		m_db->insert(c_shaNull, &RLPNull);
+		m_nullInDB = true;
+	}
+}
+
+template <class DB> typename GenericBatchTrieDB<DB>::NodePtr GenericBatchTrieDB<DB>::newNode(typename Node::Kind _kind, bytesConstRef _key)
+{
+	NodePtr ret(new Node);
+	ret->kind = _kind;
+	ret->key = _key.toBytes();
+	ret->dirty = true;
+	return ret;
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::expand(Node& _n) const
+{
+	if (_n.kind != Node::Stub)
+		return;
+
+	RLP r(_n.ref);
+	std::string s;
+	if (r.isList())
+		s = asString(_n.ref);
+	else
+	{
+		_n.origin = r.toHash<h256>();
+		s = m_db->lookup(_n.origin);
+		if (s.size() < 32)
+			_n.ref.clear();	// only the root is stored by hash when small; elsewhere we'd be inline.
+	}
+
+	RLP n(s);
+	if (n.isList() && n.itemCount() == 2)
+	{
+		NibbleSlice k = keyOf(n);
+		for (uint i = 0; i < k.size(); ++i)
+			_n.key.push_back(k[i]);
+		if (isLeaf(n))
+		{
+			_n.kind = Node::Leaf;
+			_n.value = n[1].toString();
+		}
+		else
+		{
+			_n.kind = Node::Extension;
+			_n.next = newStub(n[1].data());
+		}
+	}
+	else if (n.isList() && n.itemCount() == 17)
+	{
+		_n.kind = Node::Branch;
+		for (unsigned i = 0; i < 16; ++i)
+			if (!n[i].isEmpty())
+				_n.children[i] = newStub(n[i].data());
+		_n.value = n[16].toString();
+	}
+	else
+		throw InvalidTrie();
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::touch(Node& _n)
+{
+	if (_n.origin)
+	{
+		m_killed.push_back(_n.origin);
+		_n.origin = h256();
+	}
+	_n.ref.clear();
+	_n.dirty = true;
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::drop(Node& _n)
+{
+	if (_n.origin)
+	{
+		m_killed.push_back(_n.origin);
+		_n.origin = h256();
+	}
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::insertAt(NodePtr& io_n, bytesConstRef _k, std::string const& _v)
+{
+	if (!io_n)
+	{
+		io_n = newNode(Node::Leaf, _k);
+		io_n->value = _v;
+		return;
+	}
+
+	Node& n = *io_n;
+	expand(n);
+	if (n.kind == Node::Branch)
+	{
+		touch(n);
+		if (_k.empty())
+			n.value = _v;
+		else
+			insertAt(n.children[_k[0]], _k.cropped(1), _v);
+		return;
+	}
+
+	uint p = commonPrefix(_k, n.key);
+	if (n.kind == Node::Leaf && p == n.key.size() && p == _k.size())
+	{
+		// exactly our node - replace the value.
+		touch(n);
+		n.value = _v;
+		return;
+	}
+	if (n.kind == Node::Extension && p == n.key.size())
+	{
+		// partial key is our key - move down.
+		touch(n);
+		insertAt(n.next, _k.cropped(p), _v);
+		return;
+	}
+
+	// disagreement at nibble p - put a branch there (behind an extension of the shared part if there is one).
+	NodePtr b = newNode(Node::Branch);
+	NodePtr old = std::move(io_n);
+	if (p == old->key.size())
+	{
+		// must be a leaf; its value goes into the branch.
+		b->value = old->value;
+		drop(*old);
+	}
+	else
+	{
+		byte c = old->key[p];
+		if (old->kind == Node::Extension && p + 1 == old->key.size())
+		{
+			b->children[c] = std::move(old->next);
+			drop(*old);
+		}
+		else
+		{
+			touch(*old);
+			trimFront(old->key, p + 1);
+			b->children[c] = std::move(old);
+		}
+	}
+
+	if (p == _k.size())
+		b->value = _v;
+	else
+		insertAt(b->children[_k[p]], _k.cropped(p + 1), _v);
+
+	if (p)
+	{
+		io_n = newNode(Node::Extension, _k.cropped(0, p));
+		io_n->next = std::move(b);
+	}
+	else
+		io_n = std::move(b);
+}
+
+template <class DB> bool GenericBatchTrieDB<DB>::removeAt(NodePtr& io_n, bytesConstRef _k)
+{
+	if (!io_n)
+		return false;
+
+	Node& n = *io_n;
+	expand(n);
+	if (n.kind == Node::Leaf)
+	{
+		if (!_k.contentsEqual(n.key))
+			return false;
+		drop(n);
+		io_n.reset();
+		return true;
+	}
+	else if (n.kind == Node::Extension)
+	{
+		if (_k.size() < n.key.size() || !std::equal(n.key.begin(), n.key.end(), _k.begin()) || !removeAt(n.next, _k.cropped(n.key.size())))
+			return false;
+		touch(n);
+		if (!n.next)
+		{
+			drop(n);
+			io_n.reset();
+			return true;
+		}
+		expand(*n.next);
+		if (n.next->kind != Node::Branch)
+		{
+			// extension of an extension or leaf - graft our key onto the child and replace ourselves with it.
+			NodePtr c = std::move(n.next);
+			touch(*c);
+			c->key.insert(c->key.begin(), n.key.begin(), n.key.end());
+			drop(n);
+			io_n = std::move(c);
+		}
+		return true;
+	}
+	else
+	{
+		if (_k.empty())
+		{
+			if (n.value.empty())
+				return false;
+			n.value.clear();
+		}
+		else if (!removeAt(n.children[_k[0]], _k.cropped(1)))
+			return false;
+		touch(n);
+		collapse(io_n);
+		return true;
+	}
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::collapse(NodePtr& io_n)
+{
+	Node& n = *io_n;
+	byte used = 255;
+	for (byte i = 0; i < 16; ++i)
+		if (n.children[i])
+		{
+			if (used != 255)
+				return;	// two or more children - still a valid branch.
+			used = i;
+		}
+
+	if (used == 255)
+	{
+		// only a value left - becomes a leaf.
+		NodePtr l = newNode(Node::Leaf);
+		l->value = n.value;
+		drop(n);
+		io_n = std::move(l);
+	}
+	else if (n.value.empty())
+	{
+		// only a single child left - merge with it.
+		NodePtr c = std::move(n.children[used]);
+		expand(*c);
+		drop(n);
+		if (c->kind == Node::Branch)
+		{
+			io_n = newNode(Node::Extension, bytesConstRef(&used, 1));
+			io_n->next = std::move(c);
+		}
+		else
+		{
+			touch(*c);
+			pushFront(c->key, used);
+			io_n = std::move(c);
+		}
+	}
+}
+
+template <class DB> bytes GenericBatchTrieDB<DB>::encode(Node& _n) const
+{
+	RLPStream s;
+	switch (_n.kind)
+	{
+	case Node::Leaf:
+		s.appendList(2) << hexPrefixEncode(_n.key, true) << _n.value;
+		break;
+	case Node::Extension:
+		s.appendList(2) << hexPrefixEncode(_n.key, false);
+		s.appendRaw(refOf(*_n.next));
+		break;
+	case Node::Branch:
+		s.appendList(17);
+		for (auto const& c: _n.children)
+			if (c)
+				s.appendRaw(refOf(*c));
+			else
+				s << "";
+		s << _n.value;
+		break;
+	default:
+		assert(false);
+	}
+	return s.out();
+}
+
+template <class DB> bytes const& GenericBatchTrieDB<DB>::refOf(Node& _n) const
+{
+	if (_n.ref.empty())
+	{
+		bytes b = encode(_n);
+		if (b.size() < 32)
+			_n.ref = std::move(b);
+		else
+			_n.ref = rlp(sha3(b));
+	}
+	return _n.ref;
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::hashSubtrees(Node& _n) const
+{
+	if (m_hashers < 2)
+		return;
+	std::vector<Node*> subtrees;
+	gatherSubtrees(_n, c_parallelDepth, subtrees);
+	if (subtrees.size() < c_minParallelSubtrees)
+		return;
+
+	// Subtrees are disjoint and already expanded wherever they changed, so refOf() touches neither the DB nor
+	// any node shared between threads.
+	std::atomic<size_t> next(0);
+	auto hash = [&]()
+	{
+		for (size_t i; (i = next++) < subtrees.size();)
+			refOf(*subtrees[i]);
+	};
+	WorkerPool::get().run(hash, (unsigned)std::min<size_t>(m_hashers, subtrees.size()));
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::gatherSubtrees(Node& _n, unsigned _depth, std::vector<Node*>& o_subtrees) const
+{
+	if (!_n.ref.empty() || _n.kind == Node::Stub)
+		return;
+	if (!_depth || _n.kind == Node::Leaf)
+		o_subtrees.push_back(&_n);
+	else if (_n.kind == Node::Extension)
+		gatherSubtrees(*_n.next, _depth - 1, o_subtrees);
+	else
+		for (auto const& c: _n.children)
+			if (c)
+				gatherSubtrees(*c, _depth - 1, o_subtrees);
+}
+
+template <class DB> void GenericBatchTrieDB<DB>::commitAux(Node& _n, bool _isRoot)
+{
+	if (!_n.dirty)
+		return;
+
+	if (_n.kind == Node::Extension)
+		commitAux(*_n.next, false);
+	else if (_n.kind == Node::Branch)
+		for (auto const& c: _n.children)
+			if (c)
+				commitAux(*c, false);
+
+	bytes b = encode(_n);
+	if (_isRoot)
+	{
+		if (!m_rootHash)
+			m_rootHash = sha3(b);
+		_n.origin = m_rootHash;
+	}
+	else if (b.size() >= 32)
+	{
+		if (_n.ref.empty())
+			_n.ref = rlp(sha3(b));
+		_n.origin = RLP(_n.ref).toHash<h256>();
+	}
+	else
+		_n.ref = std::move(b);
+
+	if (_n.origin)
+		m_db->insert(_n.origin, &b);
+	_n.dirty = false;
+}
+
+}
@@ -24,6 +24,7 @@
 #include <libethential/Common.h>
 #include <libethential/RLP.h>
 #include <libethcore/TrieDB.h>
+#include <libethcore/BatchTrieDB.h>
 #include "Dagger.h"
 #include "Exceptions.h"
 #include "BlockInfo.h"
@@ -121,9 +122,8 @@ void BlockInfo::verifyInternals(bytesConstRef _block) const
 
 	u256 mgp = (u256)-1;
 
-	OverlayDB db;
-	GenericTrieDB<OverlayDB> t(&db);
-	t.init();
+	MemoryDB db;
+	GenericBatchTrieDB<MemoryDB> t(&db);
 	unsigned i = 0;
 	for (auto const& tr: root[1])
 	{
@@ -0,0 +1,138 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file ByteBoundedLRU.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+namespace eth
+{
+
+/// Occupancy and effectiveness of a cache.
+struct CacheStats
+{
+	unsigned long long hits = 0;
+	unsigned long long misses = 0;
+	unsigned long long evictions = 0;
+	size_t bytes = 0;		///< Bytes of data currently held.
+	size_t entries = 0;		///< Items currently held.
+	size_t capacity = 0;	///< The bound on bytes.
+};
+
+/// The bytes of data in a value held by a ByteBoundedLRU: its size(), or that of what it points to.
+template <class T> struct ByteSize { size_t operator()(T const& _v) const { return _v.size(); } };
+template <class T> struct ByteSize<std::shared_ptr<T>> { size_t operator()(std::shared_ptr<T> const& _v) const { return _v ? _v->size() : 0; } };
+
+/**
+ * @brief A least-recently-used cache of values by key, bounded by the total bytes of their data (as @a Size gives it).
+ * A default-constructed Value stands for one not held.
+ * @threadsafe
+ */
+template <class Key, class Value, class Size = ByteSize<Value>>
+class ByteBoundedLRU
+{
+public:
+	explicit ByteBoundedLRU(size_t _capacity): m_capacity(_capacity) {}
+
+	/// @returns the value under @a _k, noting it as the most recently used, or Value() if we don't have it.
+	Value lookup(Key const& _k)
+	{
+		std::lock_guard<std::mutex> l(x_cache);
+		auto it = m_index.find(_k);
+		if (it == m_index.end())
+		{
+			++m_stats.misses;
+			return Value();
+		}
+		++m_stats.hits;
+		m_lru.splice(m_lru.begin(), m_lru, it->second);
+		return it->second->second;
+	}
+
+	/// Note @a _v, under @a _k, as the most recently used, evicting the least recently used as necessary. If @a _k is
+	/// already held it keeps the value it has, which is put in @a o_held if given. A value bigger than the whole
+	/// capacity isn't held.
+	void insert(Key const& _k, Value const& _v, Value* o_held = nullptr)
+	{
+		std::lock_guard<std::mutex> l(x_cache);
+		auto it = m_index.find(_k);
+		if (it != m_index.end())
+		{
+			m_lru.splice(m_lru.begin(), m_lru, it->second);
+			if (o_held)
+				*o_held = it->second->second;
+			return;
+		}
+		size_t s = Size()(_v);
+		if (s > m_capacity)
+			return;
+		m_lru.push_front(std::make_pair(_k, _v));
+		m_index[_k] = m_lru.begin();
+		m_stats.bytes += s;
+		++m_stats.entries;
+		evictWithoutLock();
+	}
+
+	/// Forget the value under @a _k, if we have it.
+	void erase(Key const& _k)
+	{
+		std::lock_guard<std::mutex> l(x_cache);
+		auto it = m_index.find(_k);
+		if (it == m_index.end())
+			return;
+		m_stats.bytes -= Size()(it->second->second);
+		--m_stats.entries;
+		m_lru.erase(it->second);
+		m_index.erase(it);
+	}
+
+	/// Set the bound on bytes held to @a _bytes, evicting as necessary.
+	void setCapacity(size_t _bytes) { std::lock_guard<std::mutex> l(x_cache); m_capacity = _bytes; evictWithoutLock(); }
+	size_t capacity() const { std::lock_guard<std::mutex> l(x_cache); return m_capacity; }
+	CacheStats stats() const { std::lock_guard<std::mutex> l(x_cache); CacheStats ret = m_stats; ret.capacity = m_capacity; return ret; }
+
+private:
+	using Entry = std::pair<Key, Value>;
+
+	void evictWithoutLock()
+	{
+		while (m_stats.bytes > m_capacity)
+		{
+			auto const& e = m_lru.back();
+			m_stats.bytes -= Size()(e.second);
+			--m_stats.entries;
+			++m_stats.evictions;
+			m_index.erase(e.first);
+			m_lru.pop_back();
+		}
+	}
+
+	mutable std::mutex x_cache;
+	std::list<Entry> m_lru;												///< Most recently used at the front.
+	std::unordered_map<Key, typename std::list<Entry>::iterator> m_index;
+	size_t m_capacity;
+	CacheStats m_stats;
+};
+
+}
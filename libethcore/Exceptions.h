@@ -23,6 +23,8 @@ class InvalidUncle: public Exception {};
 class UncleNotAnUncle: public Exception {};
 class DuplicateUncleNonce: public Exception {};
 class InvalidStateRoot: public Exception {};
+class InvalidStateDump: public Exception { public: InvalidStateDump(std::string const& _why): m_why(_why) {} std::string m_why; virtual std::string description() const { return "Invalid state dump: " + m_why; } };
+class DatabaseError: public Exception { public: DatabaseError(std::string const& _why): m_why(_why) {} std::string m_why; virtual std::string description() const { return "Database error: " + m_why; } };
 class InvalidTransactionsHash: public Exception { public: InvalidTransactionsHash(h256 _head, h256 _real): m_head(_head), m_real(_real) {} h256 m_head; h256 m_real; virtual std::string description() const { return "Invalid transactions hash:  header says: " + toHex(m_head.ref()) + " block is:" + toHex(m_real.ref()); } };
 class InvalidTransaction: public Exception {};
 class InvalidDifficulty: public Exception {};
@@ -0,0 +1,257 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file KeyValueDB.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "KeyValueDB.h"
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <leveldb/db.h>
+#include <leveldb/write_batch.h>
+#include "Exceptions.h"
+#include "LogDB.h"
+using namespace std;
+using namespace eth;
+namespace ldb = leveldb;
+
+DBEngine eth::dbEngineFromString(std::string const& _name)
+{
+	if (_name == "leveldb")
+		return DBEngine::LevelDB;
+	if (_name == "memory")
+		return DBEngine::Memory;
+	if (_name == "log")
+		return DBEngine::Log;
+	throw DatabaseError("Unknown storage engine " + _name);
+}
+
+namespace
+{
+
+static ldb::Slice toSlice(bytesConstRef _b) { return ldb::Slice((char const*)_b.data(), _b.size()); }
+static bytesConstRef fromSlice(ldb::Slice const& _s) { return bytesConstRef((byte const*)_s.data(), _s.size()); }
+
+static void forEachIn(ldb::DB* _db, ldb::ReadOptions const& _o, bytesConstRef _from, DBVisitor const& _f)
+{
+	std::unique_ptr<ldb::Iterator> it(_db->NewIterator(_o));
+	for (it->Seek(toSlice(_from)); it->Valid() && _f(fromSlice(it->key()), fromSlice(it->value())); it->Next()) {}
+}
+
+/// A LevelDB snapshot.
+class LevelDBView: public KeyValueView
+{
+public:
+	LevelDBView(ldb::DB* _db): m_db(_db) { m_o.snapshot = _db->GetSnapshot(); }
+	~LevelDBView() { m_db->ReleaseSnapshot(m_o.snapshot); }
+
+	std::string get(bytesConstRef _key) const { std::string ret; m_db->Get(m_o, toSlice(_key), &ret); return ret; }
+	void forEach(bytesConstRef _from, DBVisitor const& _f) const { forEachIn(m_db, m_o, _from, _f); }
+
+private:
+	ldb::DB* m_db;
+	ldb::ReadOptions m_o;
+};
+
+class LevelDB: public KeyValueDB
+{
+public:
+	LevelDB(std::string const& _path)
+	{
+		ldb::Options o;
+		o.create_if_missing = true;
+		ldb::DB* db = nullptr;
+		auto s = ldb::DB::Open(o, _path, &db);
+		if (!db)
+			throw DatabaseError("Couldn't open " + _path + ": " + s.ToString());
+		m_db.reset(db);
+	}
+
+	std::string get(bytesConstRef _key) const { std::string ret; m_db->Get(ldb::ReadOptions(), toSlice(_key), &ret); return ret; }
+	void forEach(bytesConstRef _from, DBVisitor const& _f) const { forEachIn(m_db.get(), ldb::ReadOptions(), _from, _f); }
+
+	void write(DBBatch const& _batch, bool _sync)
+	{
+		ldb::WriteBatch b;
+		for (auto const& i: _batch.ops())
+			if (i.put)
+				b.Put(i.key, i.value);
+			else
+				b.Delete(i.key);
+		ldb::WriteOptions o;
+		o.sync = _sync;
+		m_db->Write(o, &b);
+	}
+
+	std::shared_ptr<KeyValueView const> snapshot() const { return std::make_shared<LevelDBView>(m_db.get()); }
+
+private:
+	std::unique_ptr<ldb::DB> m_db;
+};
+
+/// One value a key has had: the version of the write that made it, and the value, or none if that write deleted it.
+struct Version
+{
+	unsigned version;
+	bool live;
+	std::string value;
+};
+
+/// Each key's values, oldest first. Only those some snapshot may still see are kept.
+using Map = std::map<std::string, std::vector<Version>>;
+
+/// @returns the value @a _h had as of version @a _v, or null if it had none.
+static std::string const* valueAt(std::vector<Version> const& _h, unsigned _v)
+{
+	for (auto it = _h.rbegin(); it != _h.rend(); ++it)
+		if (it->version <= _v)
+			return it->live ? &it->value : nullptr;
+	return nullptr;
+}
+
+/**
+ * @brief Everything in an ordered map of versioned values.
+ * A snapshot is just a version number: writes add new versions rather than overwriting, and a write drops the
+ * versions of the keys it touches that no live snapshot can see any longer. Taking a snapshot is thus O(1) and a
+ * write is O(batch size) whether or not snapshots are alive. Keys not written again keep their stale versions
+ * (and deletions) until they are.
+ */
+class MemoryKeyValueDB: public KeyValueDB
+{
+public:
+	std::string get(bytesConstRef _key) const
+	{
+		std::lock_guard<std::mutex> l(x_m);
+		auto it = m_m.find(_key.toString());
+		return it == m_m.end() || !it->second.back().live ? std::string() : it->second.back().value;
+	}
+	void forEach(bytesConstRef _from, DBVisitor const& _f) const
+	{
+		unsigned v = acquire();
+		forEachAt(v, _from, _f);
+		release(v);
+	}
+
+	void write(DBBatch const& _batch, bool)
+	{
+		std::lock_guard<std::mutex> l(x_m);
+		++m_version;
+		for (auto const& i: _batch.ops())
+		{
+			auto& h = m_m[i.key];
+			if (!h.empty() && h.back().version == m_version)
+				h.back() = Version{m_version, i.put, i.value};
+			else
+				h.push_back(Version{m_version, i.put, i.value});
+			prune(h);
+			if (!i.put && m_snapshots.empty())
+				m_m.erase(i.key);
+		}
+	}
+
+	std::shared_ptr<KeyValueView const> snapshot() const { return std::make_shared<MemoryView>(this, acquire()); }
+
+private:
+	/// A MemoryKeyValueDB snapshot: reads the DB as of a version, which it keeps alive until it's gone.
+	class MemoryView: public KeyValueView
+	{
+	public:
+		MemoryView(MemoryKeyValueDB const* _db, unsigned _v): m_db(_db), m_v(_v) {}
+		~MemoryView() { m_db->release(m_v); }
+
+		std::string get(bytesConstRef _key) const
+		{
+			std::lock_guard<std::mutex> l(m_db->x_m);
+			auto it = m_db->m_m.find(_key.toString());
+			std::string const* v = it == m_db->m_m.end() ? nullptr : valueAt(it->second, m_v);
+			return v ? *v : std::string();
+		}
+		void forEach(bytesConstRef _from, DBVisitor const& _f) const { m_db->forEachAt(m_v, _from, _f); }
+
+	private:
+		MemoryKeyValueDB const* m_db;
+		unsigned m_v;
+	};
+
+	/// Register a reader of the current version. @returns that version.
+	unsigned acquire() const { std::lock_guard<std::mutex> l(x_m); m_snapshots.insert(m_version); return m_version; }
+	void release(unsigned _v) const { std::lock_guard<std::mutex> l(x_m); m_snapshots.erase(m_snapshots.find(_v)); }
+
+	/// Drop the versions in @a _h that are neither the latest nor the one the oldest live snapshot sees.
+	void prune(std::vector<Version>& _h) const
+	{
+		if (_h.size() < 2)
+			return;
+		unsigned oldest = m_snapshots.empty() ? m_version : *m_snapshots.begin();
+		unsigned keep = 0;
+		for (unsigned i = 0; i < _h.size(); ++i)
+			if (_h[i].version <= oldest)
+				keep = i;
+		_h.erase(_h.begin(), _h.begin() + keep);
+	}
+
+	/// Visit the keys as of version @a _v. The lock is held only while gathering each run of keys, not while
+	/// @a _f is called, so @a _f may use the DB.
+	void forEachAt(unsigned _v, bytesConstRef _from, DBVisitor const& _f) const
+	{
+		std::string from = _from.toString();
+		bool first = true;
+		std::vector<std::pair<std::string, std::string>> run;
+		do
+		{
+			run.clear();
+			{
+				std::lock_guard<std::mutex> l(x_m);
+				for (auto it = first ? m_m.lower_bound(from) : m_m.upper_bound(from); it != m_m.end() && run.size() < c_runSize; ++it)
+					if (std::string const* v = valueAt(it->second, _v))
+						run.push_back(make_pair(it->first, *v));
+			}
+			first = false;
+			for (auto const& i: run)
+				if (!_f(bytesConstRef(i.first), bytesConstRef(i.second)))
+					return;
+			if (!run.empty())
+				from = run.back().first;
+		}
+		while (run.size() == c_runSize);
+	}
+
+	static const unsigned c_runSize = 256;
+
+	Map m_m;
+	unsigned m_version = 0;
+	mutable std::multiset<unsigned> m_snapshots;	///< The versions live snapshots and iterations read at.
+	mutable std::mutex x_m;
+};
+
+}
+
+std::unique_ptr<KeyValueDB> KeyValueDB::open(DBEngine _engine, std::string const& _path)
+{
+	switch (_engine)
+	{
+	case DBEngine::Memory:
+		return std::unique_ptr<KeyValueDB>(new MemoryKeyValueDB);
+	case DBEngine::Log:
+		return std::unique_ptr<KeyValueDB>(new LogDB(_path));
+	default:
+		return std::unique_ptr<KeyValueDB>(new LevelDB(_path));
+	}
+}
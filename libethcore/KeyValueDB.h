@@ -0,0 +1,101 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file KeyValueDB.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <libethential/Common.h>
+
+namespace eth
+{
+
+/// The storage engines a KeyValueDB may be backed by.
+enum class DBEngine
+{
+	LevelDB,	///< LevelDB; the default for everything.
+	Memory,		///< An ordered map in memory, gone once closed; for tests and benchmarks.
+	Log			///< An mmap()ed append-only log with a hash index; for write-once data such as block bodies.
+};
+
+/// @returns the engine named @a _name ("leveldb", "memory" or "log"); throws if there is none such.
+DBEngine dbEngineFromString(std::string const& _name);
+
+/// A set of writes to a KeyValueDB, made all at once or not at all by KeyValueDB::write().
+class DBBatch
+{
+public:
+	struct Op
+	{
+		bool put;
+		std::string key;
+		std::string value;
+	};
+
+	void put(bytesConstRef _key, bytesConstRef _value) { m_ops.push_back(Op{true, _key.toString(), _value.toString()}); }
+	void del(bytesConstRef _key) { m_ops.push_back(Op{false, _key.toString(), std::string()}); }
+
+	std::vector<Op> const& ops() const { return m_ops; }
+	bool empty() const { return m_ops.empty(); }
+	void clear() { m_ops.clear(); }
+
+private:
+	std::vector<Op> m_ops;
+};
+
+/// Given each key in order with its value; return false to stop.
+using DBVisitor = std::function<bool(bytesConstRef _key, bytesConstRef _value)>;
+
+/**
+ * @brief Read access to a set of values by key. Keys are ordered bytewise.
+ */
+class KeyValueView
+{
+public:
+	virtual ~KeyValueView() {}
+
+	/// @returns the value at @a _key, or the empty string if there is none.
+	virtual std::string get(bytesConstRef _key) const = 0;
+	/// Call @a _f with each key from @a _from onwards, in order, until it returns false.
+	virtual void forEach(bytesConstRef _from, DBVisitor const& _f) const = 0;
+};
+
+/**
+ * @brief A store of values by key: the disk DB beneath an OverlayDB and a BlockChain. Behind it is one of several
+ * storage engines, chosen when it's opened.
+ * @threadsafe
+ */
+class KeyValueDB: public KeyValueView
+{
+public:
+	/// Open (or create) the DB at @a _path with the engine @a _engine. The Memory engine ignores the path.
+	static std::unique_ptr<KeyValueDB> open(DBEngine _engine, std::string const& _path);
+
+	/// Make all the writes of @a _batch atomically. If @a _sync, don't return until they've reached the disk.
+	virtual void write(DBBatch const& _batch, bool _sync = false) = 0;
+	/// @returns a view of the DB as it is now, unaffected by later writes. It must not outlive the DB.
+	virtual std::shared_ptr<KeyValueView const> snapshot() const = 0;
+
+	void put(bytesConstRef _key, bytesConstRef _value, bool _sync = false) { DBBatch b; b.put(_key, _value); write(b, _sync); }
+	void del(bytesConstRef _key, bool _sync = false) { DBBatch b; b.del(_key); write(b, _sync); }
+};
+
+}
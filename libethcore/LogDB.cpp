@@ -0,0 +1,247 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file LogDB.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "LogDB.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <boost/filesystem.hpp>
+#include <libethential/Log.h>
+#include "SHA3.h"
+#include "Exceptions.h"
+using namespace std;
+using namespace eth;
+
+/// The value length that marks a record as a deletion.
+static const uint32_t c_deleted = ~uint32_t(0);
+
+static void put32(bytes& o_b, uint32_t _v)
+{
+	for (unsigned i = 4; i--;)
+		o_b.push_back((byte)(_v >> (i * 8)));
+}
+
+static uint32_t get32(char const* _p)
+{
+	byte const* p = (byte const*)_p;
+	return (uint32_t(p[0]) << 24) | (uint32_t(p[1]) << 16) | (uint32_t(p[2]) << 8) | p[3];
+}
+
+/// The checksum of a batch: the first four bytes of its SHA3.
+static uint32_t checksum(bytesConstRef _payload)
+{
+	return get32((char const*)sha3(_payload).data());
+}
+
+LogDB::Mapping::Mapping(int _fd, size_t _size)
+{
+	if (!_size)
+		return;
+	void* p = mmap(nullptr, _size, PROT_READ, MAP_SHARED, _fd, 0);
+	if (p == MAP_FAILED)
+		throw DatabaseError("Couldn't map log");
+	data = (char const*)p;
+	size = _size;
+}
+
+LogDB::Mapping::~Mapping()
+{
+	if (data)
+		munmap((void*)data, size);
+}
+
+LogDB::LogDB(std::string const& _path):
+	m_index(std::make_shared<Index>())
+{
+	boost::filesystem::create_directories(_path);
+	m_fd = ::open((_path + "/log").c_str(), O_RDWR | O_CREAT, 0644);
+	if (m_fd < 0)
+		throw DatabaseError("Couldn't open " + _path + "/log");
+	load();
+}
+
+LogDB::~LogDB()
+{
+	if (m_fd >= 0)
+		::close(m_fd);
+}
+
+void LogDB::load()
+{
+	struct stat st;
+	fstat(m_fd, &st);
+	Mapping m(m_fd, st.st_size);
+
+	size_t p = 0;
+	while (p + 8 <= m.size)
+	{
+		uint32_t len = get32(m.data + p);
+		if (p + 8 + len > m.size)
+			break;
+		char const* payload = m.data + p + 4;
+		if (get32(payload + len) != checksum(bytesConstRef((byte const*)payload, len)))
+			break;
+
+		// Only apply the batch once we know all of its records are whole.
+		std::vector<pair<std::string, Location>> records;
+		size_t q = 0;
+		while (q + 8 <= len)
+		{
+			uint32_t kl = get32(payload + q);
+			uint32_t vl = get32(payload + q + 4);
+			size_t vs = vl == c_deleted ? 0 : vl;
+			if (q + 8 + kl + vs > len)
+				break;
+			records.push_back(make_pair(std::string(payload + q + 8, kl), Location{vl == c_deleted ? 0 : p + 4 + q + 8 + kl, vl}));
+			q += 8 + kl + vs;
+		}
+		if (q != len)
+			break;
+		for (auto const& i: records)
+			if (i.second.size == c_deleted)
+				m_index->erase(i.first);
+			else
+				(*m_index)[i.first] = i.second;
+		p += 8 + len;
+	}
+
+	if (p < m.size)
+	{
+		cwarn << "Discarding" << (m.size - p) << "bytes of torn batch at the end of the log.";
+		if (ftruncate(m_fd, p))
+			throw DatabaseError("Couldn't truncate log");
+	}
+	m_end = p;
+}
+
+std::pair<std::shared_ptr<LogDB::Mapping const>, std::shared_ptr<LogDB::Index const>> LogDB::current() const
+{
+	if (!m_map || m_map->size < m_end)
+		m_map = std::make_shared<Mapping>(m_fd, m_end);
+	return make_pair(m_map, m_index);
+}
+
+namespace
+{
+
+std::string getIn(LogDB::Mapping const& _m, LogDB::Index const& _i, bytesConstRef _key)
+{
+	auto it = _i.find(_key.toString());
+	return it == _i.end() ? std::string() : std::string(_m.data + it->second.offset, it->second.size);
+}
+
+void forEachIn(LogDB::Mapping const& _m, LogDB::Index const& _i, bytesConstRef _from, DBVisitor const& _f)
+{
+	std::string from = _from.toString();
+	std::vector<LogDB::Index::value_type const*> entries;
+	for (auto const& i: _i)
+		if (i.first >= from)
+			entries.push_back(&i);
+	sort(entries.begin(), entries.end(), [](LogDB::Index::value_type const* a, LogDB::Index::value_type const* b) { return a->first < b->first; });
+	for (auto i: entries)
+		if (!_f(bytesConstRef(i->first), bytesConstRef((byte const*)_m.data + i->second.offset, i->second.size)))
+			break;
+}
+
+/// A LogDB snapshot: the index as it was, and a mapping covering everything it refers to.
+class LogView: public KeyValueView
+{
+public:
+	LogView(std::pair<std::shared_ptr<LogDB::Mapping const>, std::shared_ptr<LogDB::Index const>> const& _c): m_map(_c.first), m_index(_c.second) {}
+
+	std::string get(bytesConstRef _key) const { return getIn(*m_map, *m_index, _key); }
+	void forEach(bytesConstRef _from, DBVisitor const& _f) const { forEachIn(*m_map, *m_index, _from, _f); }
+
+private:
+	std::shared_ptr<LogDB::Mapping const> m_map;
+	std::shared_ptr<LogDB::Index const> m_index;
+};
+
+}
+
+std::string LogDB::get(bytesConstRef _key) const
+{
+	std::lock_guard<std::mutex> l(x_log);
+	auto c = current();
+	return getIn(*c.first, *c.second, _key);
+}
+
+void LogDB::forEach(bytesConstRef _from, DBVisitor const& _f) const
+{
+	snapshot()->forEach(_from, _f);
+}
+
+std::shared_ptr<KeyValueView const> LogDB::snapshot() const
+{
+	std::lock_guard<std::mutex> l(x_log);
+	return std::make_shared<LogView>(current());
+}
+
+void LogDB::write(DBBatch const& _batch, bool _sync)
+{
+	if (_batch.empty())
+		return;
+
+	bytes frame(4);
+	std::vector<size_t> valueAt;
+	for (auto const& i: _batch.ops())
+	{
+		put32(frame, i.key.size());
+		put32(frame, i.put ? i.value.size() : c_deleted);
+		frame.insert(frame.end(), i.key.begin(), i.key.end());
+		valueAt.push_back(frame.size());
+		frame.insert(frame.end(), i.value.begin(), i.value.end());
+	}
+	uint32_t len = frame.size() - 4;
+	for (unsigned i = 0; i < 4; ++i)
+		frame[i] = (byte)(len >> ((3 - i) * 8));
+	put32(frame, checksum(bytesConstRef(&frame).cropped(4, len)));
+
+	std::lock_guard<std::mutex> l(x_log);
+	for (size_t done = 0; done < frame.size();)
+	{
+		ssize_t n = pwrite(m_fd, frame.data() + done, frame.size() - done, m_end + done);
+		if (n <= 0)
+		{
+			// Whatever of the batch did get written will be cut off as torn when next opened.
+			if (ftruncate(m_fd, m_end)) {}
+			throw DatabaseError("Couldn't append to log");
+		}
+		done += n;
+	}
+	if (_sync)
+		fdatasync(m_fd);
+
+	if (m_index.use_count() > 1)
+		m_index = std::make_shared<Index>(*m_index);
+	for (unsigned i = 0; i < valueAt.size(); ++i)
+	{
+		auto const& o = _batch.ops()[i];
+		if (o.put)
+			(*m_index)[o.key] = Location{m_end + valueAt[i], (unsigned)o.value.size()};
+		else
+			m_index->erase(o.key);
+	}
+	m_end += frame.size();
+}
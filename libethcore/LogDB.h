@@ -0,0 +1,82 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file LogDB.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <mutex>
+#include <unordered_map>
+#include "KeyValueDB.h"
+
+namespace eth
+{
+
+/**
+ * @brief A KeyValueDB that is a single append-only log file, mmap()ed for reading, with an index in memory of where
+ * each key's latest value is. A lookup is one hash probe and a copy out of the mapping, with no decompression or
+ * levels to search; it suits data written once and read at random, such as block bodies.
+ * The log is a sequence of batches, each [length, records, checksum], a record being [key length, value length
+ * (~0 for a deletion), key, value]. Opening reads the whole log to build the index; a batch torn by a crash is cut
+ * off. Nothing is ever reclaimed, so overwritten and deleted values still take up room. Iteration has to sort the
+ * keys first, so it's slow. POSIX only.
+ */
+class LogDB: public KeyValueDB
+{
+public:
+	/// Open (or create) the log in directory @a _path.
+	explicit LogDB(std::string const& _path);
+	~LogDB();
+
+	std::string get(bytesConstRef _key) const;
+	void forEach(bytesConstRef _from, DBVisitor const& _f) const;
+	void write(DBBatch const& _batch, bool _sync = false);
+	std::shared_ptr<KeyValueView const> snapshot() const;
+
+	/// The whereabouts of a value in the log.
+	struct Location
+	{
+		size_t offset;
+		unsigned size;
+	};
+	using Index = std::unordered_map<std::string, Location>;
+
+	/// A read-only mapping of the first @a size bytes of the log.
+	struct Mapping
+	{
+		Mapping(int _fd, size_t _size);
+		~Mapping();
+		char const* data = nullptr;
+		size_t size = 0;
+	};
+
+private:
+	/// Bring m_index into line with the log's contents, truncating any torn batch at the end.
+	void load();
+	/// @returns the mapping and index as they are now, remapping first if the mapping doesn't cover the log.
+	std::pair<std::shared_ptr<Mapping const>, std::shared_ptr<Index const>> current() const;
+
+	int m_fd = -1;
+	size_t m_end = 0;						///< Size of the log.
+	std::shared_ptr<Index> m_index;			///< Shared with snapshots; a write copies it first if it's shared.
+	mutable std::shared_ptr<Mapping> m_map;	///< Of the log as it was when last read; snapshots keep old ones alive.
+	mutable std::mutex x_log;
+};
+
+}
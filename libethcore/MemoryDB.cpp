@@ -29,23 +29,21 @@ namespace eth
 
 std::map<h256, std::string> MemoryDB::get() const
 {
-	if (!m_enforceRefs)
-		return m_over;
 	std::map<h256, std::string> ret;
-	for (auto const& i: m_refCount)
-		if (i.second)
-			ret.insert(*m_over.find(i.first));
+	for (auto const& i: *m_over)
+		if (!m_enforceRefs || i.refs)
+			ret.insert(make_pair(i.key, i.valueString()));
 	return ret;
 }
 
 std::string MemoryDB::lookup(h256 _h) const
 {
-	auto it = m_over.find(_h);
-	if (it != m_over.end())
+	auto e = m_over->find(_h);
+	if (e)
 	{
-		if (!m_enforceRefs || (m_refCount.count(it->first) && m_refCount.at(it->first)))
-			return it->second;
-//		else if (m_enforceRefs && m_refCount.count(it->first) && !m_refCount.at(it->first))
+		if (!m_enforceRefs || e->refs)
+			return e->valueString();
+//		else if (m_enforceRefs && !e->refs)
 //			cnote << "Lookup required for value with no refs. Let's hope it's in the DB." << _h.abridged();
 	}
 	return std::string();
@@ -53,27 +51,24 @@ std::string MemoryDB::lookup(h256 _h) const
 
 bool MemoryDB::exists(h256 _h) const
 {
-	auto it = m_over.find(_h);
-	if (it != m_over.end() && (!m_enforceRefs || (m_refCount.count(it->first) && m_refCount.at(it->first))))
-		return true;
-	return false;
+	auto e = m_over->find(_h);
+	return e && (!m_enforceRefs || e->refs);
 }
 
 void MemoryDB::insert(h256 _h, bytesConstRef _v)
 {
-	m_over[_h] = _v.toString();
-	m_refCount[_h]++;
+	m_over.write().insert(_h, _v);
 #if ETH_PARANOIA
-	dbdebug << "INST" << _h.abridged() << "=>" << m_refCount[_h];
+	dbdebug << "INST" << _h.abridged() << "=>" << m_over->find(_h)->refs;
 #endif
 }
 
 bool MemoryDB::kill(h256 _h)
 {
-	if (m_refCount.count(_h))
+	if (auto e = m_over->find(_h))
 	{
-		if (m_refCount[_h] > 0)
-			--m_refCount[_h];
+		if (e->refs > 0)
+			--m_over.write().find(_h)->refs;
 #if ETH_PARANOIA
 		else
 		{
@@ -82,7 +77,7 @@ bool MemoryDB::kill(h256 _h)
 			dbdebug << "NOKILL-WAS" << _h.abridged();
 			return false;
 		}
-		dbdebug << "KILL" << _h.abridged() << "=>" << m_refCount[_h];
+		dbdebug << "KILL" << _h.abridged() << "=>" << m_over->find(_h)->refs;
 		return true;
 	}
 	else
@@ -98,17 +93,15 @@ bool MemoryDB::kill(h256 _h)
 
 void MemoryDB::purge()
 {
-	for (auto const& i: m_refCount)
-		if (!i.second)
-			m_over.erase(i.first);
+	m_over.write().purge();
 }
 
 set<h256> MemoryDB::keys() const
 {
 	set<h256> ret;
-	for (auto const& i: m_refCount)
-		if (i.second)
-			ret.insert(i.first);
+	for (auto const& i: *m_over)
+		if (i.refs)
+			ret.insert(i.key);
 	return ret;
 }
 
@@ -23,9 +23,11 @@
 
 #include <map>
 #include <libethential/Common.h>
+#include <libethential/CopyOnWrite.h>
 #include <libethential/FixedHash.h>
 #include <libethential/Log.h>
 #include <libethential/RLP.h>
+#include "NodeTable.h"
 
 namespace eth
 {
@@ -34,6 +36,10 @@ struct DBChannel: public LogChannel  { static const char* name() { return "TDB";
 
 #define dbdebug clog(DBChannel)
 
+/**
+ * @brief An in-memory, reference-counted store of nodes by hash.
+ * Its contents are shared between copies until altered, so copying one is O(1) however much it holds.
+ */
 class MemoryDB
 {
 	friend class EnforceRefs;
@@ -41,7 +47,7 @@ class MemoryDB
 public:
 	MemoryDB() {}
 
-	void clear() { m_over.clear(); }
+	void clear() { m_over.reset(); }
 	std::map<h256, std::string> get() const;
 
 	std::string lookup(h256 _h) const;
@@ -53,8 +59,7 @@ public:
 	std::set<h256> keys() const;
 
 protected:
-	std::map<h256, std::string> m_over;
-	std::map<h256, uint> m_refCount;
+	CopyOnWrite<NodeTable> m_over;		///< The nodes with their reference counts.
 
 	mutable bool m_enforceRefs = false;
 };
@@ -0,0 +1,43 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file NodeCache.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <string>
+#include <libethential/FixedHash.h>
+#include "ByteBoundedLRU.h"
+
+namespace eth
+{
+
+/**
+ * @brief A least-recently-used cache of DB nodes, keyed by hash and bounded by the total size of their data.
+ * Since nodes are content-addressed, a cached entry can never go stale; it can only go, when the node is pruned.
+ * lookup() gives the empty string for a node we don't have.
+ * @threadsafe
+ */
+class NodeCache: public ByteBoundedLRU<h256, std::string>
+{
+public:
+	explicit NodeCache(size_t _capacity): ByteBoundedLRU<h256, std::string>(_capacity) {}
+};
+
+}
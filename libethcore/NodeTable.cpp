@@ -0,0 +1,149 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file NodeTable.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "NodeTable.h"
+
+#include <cstring>
+using namespace std;
+using namespace eth;
+
+/// The number of slots a table starts with.
+static const size_t c_initialSlots = 64;
+/// The size of each block of the arena; larger values get a block to themselves.
+static const size_t c_blockSize = 64 * 1024;
+/// Where empty values point, so that their slots don't look empty.
+static const char c_empty = 0;
+
+NodeTable::NodeTable(NodeTable const& _t):
+	m_slots(_t.m_slots),
+	m_size(_t.m_size)
+{
+	for (auto& i: m_slots)
+		if (i.data)
+			i.data = store(i.value());
+}
+
+void NodeTable::swap(NodeTable& _t)
+{
+	m_slots.swap(_t.m_slots);
+	std::swap(m_size, _t.m_size);
+	m_blocks.swap(_t.m_blocks);
+	std::swap(m_next, _t.m_next);
+	std::swap(m_left, _t.m_left);
+}
+
+size_t NodeTable::slotOf(h256 const& _h) const
+{
+	uint64_t w[4];
+	memcpy(w, _h.data(), 32);
+	size_t mask = m_slots.size() - 1;
+	size_t i = (w[0] ^ w[1] ^ w[2] ^ w[3]) & mask;
+	while (m_slots[i].data && m_slots[i].key != _h)
+		i = (i + 1) & mask;
+	return i;
+}
+
+NodeTable::Entry const* NodeTable::find(h256 const& _h) const
+{
+	if (!m_size)
+		return nullptr;
+	Entry const& e = m_slots[slotOf(_h)];
+	return e.data ? &e : nullptr;
+}
+
+void NodeTable::insert(h256 const& _h, bytesConstRef _v)
+{
+	if ((m_size + 1) * 2 > m_slots.size())
+		grow();
+	Entry& e = m_slots[slotOf(_h)];
+	if (!e.data)
+	{
+		e.key = _h;
+		e.size = _v.size();
+		e.data = store(_v);
+		++m_size;
+	}
+	++e.refs;
+}
+
+void NodeTable::grow()
+{
+	std::vector<Entry> old(max(c_initialSlots, m_slots.size() * 2));
+	old.swap(m_slots);
+	for (auto const& i: old)
+		if (i.data)
+			m_slots[slotOf(i.key)] = i;
+}
+
+char const* NodeTable::store(bytesConstRef _v)
+{
+	if (_v.empty())
+		return &c_empty;
+	if (_v.size() > m_left)
+	{
+		if (_v.size() > c_blockSize / 4)
+		{
+			// Too big to be worth starting a new block for; give it one of its own, leaving the current one be.
+			m_blocks.push_back(std::unique_ptr<char[]>(new char[_v.size()]));
+			memcpy(m_blocks.back().get(), _v.data(), _v.size());
+			return m_blocks.back().get();
+		}
+		m_blocks.push_back(std::unique_ptr<char[]>(new char[c_blockSize]));
+		m_next = m_blocks.back().get();
+		m_left = c_blockSize;
+	}
+	char* ret = m_next;
+	memcpy(ret, _v.data(), _v.size());
+	m_next += _v.size();
+	m_left -= _v.size();
+	return ret;
+}
+
+void NodeTable::purge()
+{
+	NodeTable t;
+	size_t n = c_initialSlots;
+	for (auto const& i: *this)
+		if (i.refs)
+			n += 2;
+	while (t.m_slots.size() < n)
+		t.grow();
+	for (auto const& i: *this)
+		if (i.refs)
+		{
+			Entry& e = t.m_slots[t.slotOf(i.key)];
+			e = i;
+			e.data = t.store(i.value());
+			++t.m_size;
+		}
+	swap(t);
+}
+
+void NodeTable::clear()
+{
+	if (m_size)
+		for (auto& i: m_slots)
+			i = Entry();
+	m_size = 0;
+	m_blocks.clear();
+	m_next = nullptr;
+	m_left = 0;
+}
@@ -0,0 +1,111 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file NodeTable.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <libethential/Common.h>
+#include <libethential/FixedHash.h>
+
+namespace eth
+{
+
+/**
+ * @brief A flat hash table of reference-counted nodes by hash, for MemoryDB.
+ * Open addressing with linear probing; the keys, being SHA3 hashes, are already well mixed so folding their words
+ * together serves as the hash. A node's key, reference count and the whereabouts of its value sit together in one slot, while the
+ * values themselves are bump-allocated from an arena. Nothing is freed one node at a time: clear() lets go of the
+ * whole arena at once, keeping the slots for reuse.
+ */
+class NodeTable
+{
+public:
+	struct Entry
+	{
+		h256 key;
+		uint refs = 0;
+		unsigned size = 0;
+		char const* data = nullptr;		///< The value, in the arena; null if the slot is empty.
+
+		bytesConstRef value() const { return bytesConstRef((byte const*)data, size); }
+		std::string valueString() const { return std::string(data, size); }
+	};
+
+	class const_iterator
+	{
+	public:
+		const_iterator(Entry const* _p, Entry const* _end): m_p(_p), m_end(_end) { skip(); }
+
+		Entry const& operator*() const { return *m_p; }
+		Entry const* operator->() const { return m_p; }
+		const_iterator& operator++() { ++m_p; skip(); return *this; }
+		bool operator==(const_iterator const& _c) const { return m_p == _c.m_p; }
+		bool operator!=(const_iterator const& _c) const { return m_p != _c.m_p; }
+
+	private:
+		void skip() { while (m_p != m_end && !m_p->data) ++m_p; }
+
+		Entry const* m_p;
+		Entry const* m_end;
+	};
+
+	NodeTable() {}
+	NodeTable(NodeTable const& _t);
+	NodeTable(NodeTable&&) = default;
+	NodeTable& operator=(NodeTable _t) { swap(_t); return *this; }
+
+	/// @returns the entry for @a _h, or null if there is none.
+	Entry const* find(h256 const& _h) const;
+	Entry* find(h256 const& _h) { return const_cast<Entry*>(const_cast<NodeTable const*>(this)->find(_h)); }
+
+	/// Add a reference to the node @a _h, whose value is @a _v. Since keys are the hashes of their values, the value
+	/// is only stored the first time.
+	void insert(h256 const& _h, bytesConstRef _v);
+
+	/// Drop the entries with no references, compacting the arena.
+	void purge();
+
+	void clear();
+	size_t size() const { return m_size; }
+
+	const_iterator begin() const { return const_iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+	const_iterator end() const { return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+
+	void swap(NodeTable& _t);
+
+private:
+	/// @returns the slot in which @a _h is, or would be put.
+	size_t slotOf(h256 const& _h) const;
+	/// Double the number of slots, rehashing everything.
+	void grow();
+	/// @returns a copy of @a _v in the arena.
+	char const* store(bytesConstRef _v);
+
+	std::vector<Entry> m_slots;			///< A power of two in number, at most half of them used.
+	size_t m_size = 0;
+
+	std::vector<std::unique_ptr<char[]>> m_blocks;	///< The arena.
+	char* m_next = nullptr;				///< Where the next value goes in the last block of the arena.
+	size_t m_left = 0;					///< Bytes left after m_next.
+};
+
+}
@@ -20,6 +20,7 @@
  */
 
 #include <libethential/Common.h>
+#include <libethential/CommonIO.h>
 #include "OverlayDB.h"
 using namespace std;
 using namespace eth;
@@ -33,40 +34,191 @@ OverlayDB::~OverlayDB()
 		cnote << "Closing state DB";
 }
 
-void OverlayDB::setDB(ldb::DB* _db, bool _clearOverlay)
+void OverlayDB::setDB(KeyValueDB* _db, bool _clearOverlay)
 {
-	m_db = std::shared_ptr<ldb::DB>(_db);
+	m_db = std::shared_ptr<KeyValueDB>(_db);
+	m_cache = _db ? std::make_shared<NodeCache>(m_cache ? m_cache->capacity() : c_defaultNodeCacheSize) : nullptr;
 	if (_clearOverlay)
-		m_over.clear();
+		m_over.reset();
+}
+
+/// Disk DB keys of the pruning records, all of lengths other than 32 so they can't clash with nodes:
+/// a node's reference count...
+static std::string refCountKey(h256 const& _h) { return asString(_h.asBytes()) + "r"; }
+/// ...the journal of a block's state...
+static std::string journalKey(h256 const& _id) { return "journal" + asString(_id.asBytes()); }
+/// ...the blocks journalled at a number...
+static std::string numberKey(unsigned _n) { return std::string("journalled") + toString(_n); }
+/// ...and the last number pruned.
+static const std::string c_prunedKey = "pruned";
+
+void OverlayDB::writeNodes(DBBatch& o_batch)
+{
+	m_lastCommit = DBWriteStats();
+	for (auto const& i: *m_over)
+		if (i.refs)
+		{
+			o_batch.put(i.key.ref(), i.value());
+			++m_lastCommit.keys;
+			m_lastCommit.bytes += i.key.size + i.size;
+		}
+	for (auto const& i: m_aux)
+	{
+		o_batch.put(i.first, i.second);
+		++m_lastCommit.keys;
+		m_lastCommit.bytes += i.first.size() + i.second.size();
+	}
+}
+
+void OverlayDB::finishCommit()
+{
+	// Those just written are those most likely to be wanted next (they include the new state root).
+	for (auto const& i: *m_over)
+		if (i.refs)
+			m_cache->insert(i.key, i.valueString());
+	m_over.reset();
+	m_journal.reset();
+	m_aux.clear();
 }
 
 void OverlayDB::commit()
 {
 	if (m_db)
 	{
-//		cnote << "Committing nodes to disk DB:";
-		for (auto const& i: m_over)
+		DBBatch batch;
+		writeNodes(batch);
+		m_db->write(batch, m_syncWrites);
+		finishCommit();
+	}
+}
+
+void OverlayDB::commit(unsigned _number, h256 const& _id)
+{
+	if (!m_db || !m_history)
+	{
+		commit();
+		return;
+	}
+
+	std::string s = m_db->get(c_prunedKey);
+	bool pruned = !s.empty() && _number <= (unsigned)atoi(s.c_str());
+	s = m_db->get(journalKey(_id));
+
+	DBBatch batch;
+	if (s.empty() && !pruned)
+	{
+		// Count in inserted nodes now. Those already on disk but not counted were written outside of any journal, so
+		// must be kept forever; they're left uncounted.
+		RLPStream inserted;
+		RLPStream killed;
+		for (auto const& i: *m_journal)
+			if (i.second > 0)
+			{
+				std::string rc = m_db->get(refCountKey(i.first));
+				if (rc.empty() && !m_db->get(i.first.ref()).empty())
+					continue;
+				batch.put(refCountKey(i.first), toString((rc.empty() ? 0 : atoi(rc.c_str())) + i.second));
+				inserted.appendList(2) << i.first << (unsigned)i.second;
+			}
+			else if (i.second < 0)
+				killed.appendList(2) << i.first << (unsigned)-i.second;
+		RLPStream j(2);
+		j.appendList(inserted).appendList(killed);
+		batch.put(journalKey(_id), &j.out());
+
+		std::string ids = m_db->get(numberKey(_number));
+		batch.put(numberKey(_number), ids + asString(_id.asBytes()));
+	}
+	writeNodes(batch);
+	m_db->write(batch, m_syncWrites);
+	finishCommit();
+}
+
+void OverlayDB::prune(unsigned _upTo, std::function<h256(unsigned)> const& _canonical)
+{
+	if (!m_db || !m_history)
+		return;
+
+	std::string s = m_db->get(c_prunedKey);
+	unsigned from = s.empty() ? _upTo : (unsigned)atoi(s.c_str()) + 1;
+	if (from > _upTo)
+		return;
+
+	DBBatch batch;
+	std::map<h256, int> counts;
+	auto countOut = [&](RLP const& _nodes)
+	{
+		for (auto const& i: _nodes)
 		{
-//			cnote << i.first << "#" << m_refCount[i.first];
-			if (m_refCount[i.first])
-				m_db->Put(m_writeOptions, ldb::Slice((char const*)i.first.data(), i.first.size), ldb::Slice(i.second.data(), i.second.size()));
+			h256 h = i[0].toHash<h256>();
+			auto it = counts.find(h);
+			if (it == counts.end())
+			{
+				std::string rc = m_db->get(refCountKey(h));
+				if (rc.empty())
+					continue;	// Not counted; keep forever.
+				it = counts.insert(make_pair(h, atoi(rc.c_str()))).first;
+			}
+			it->second -= (int)i[1].toInt<unsigned>();
 		}
-		m_over.clear();
-		m_refCount.clear();
+	};
+	for (unsigned n = from; n <= _upTo; ++n)
+	{
+		std::string ids = m_db->get(numberKey(n));
+		h256 canon = _canonical(n);
+		for (unsigned i = 0; i + 32 <= ids.size(); i += 32)
+		{
+			h256 id((byte const*)ids.data() + i, h256::ConstructFromPointer);
+			std::string j = m_db->get(journalKey(id));
+			if (!j.empty())
+			{
+				// The canonical block's state is kept; so the nodes its parent's state needed and it didn't can go.
+				// Any other block's state is dropped; so the nodes it introduced can go.
+				RLP r(j);
+				countOut(id == canon ? r[1] : r[0]);
+			}
+			batch.del(journalKey(id));
+		}
+		batch.del(numberKey(n));
 	}
+	std::vector<h256> deleted;
+	for (auto const& i: counts)
+		if (i.second > 0)
+			batch.put(refCountKey(i.first), toString(i.second));
+		else
+		{
+			batch.del(refCountKey(i.first));
+			batch.del(i.first.ref());
+			deleted.push_back(i.first);
+		}
+	batch.put(c_prunedKey, toString(_upTo));
+	m_db->write(batch, m_syncWrites);
+
+	// The cache is shared with every copy of us; none of them must find a node that's no longer on disk.
+	for (auto const& h: deleted)
+		m_cache->erase(h);
 }
 
 void OverlayDB::rollback()
 {
-	m_over.clear();
-	m_refCount.clear();
+	m_over.reset();
+	m_journal.reset();
+	m_aux.clear();
 }
 
 std::string OverlayDB::lookup(h256 _h) const
 {
 	std::string ret = MemoryDB::lookup(_h);
 	if (ret.empty() && m_db)
-		m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
+	{
+		ret = m_cache->lookup(_h);
+		if (ret.empty())
+		{
+			ret = m_db->get(_h.ref());
+			if (!ret.empty())
+				m_cache->insert(_h, ret);
+		}
+	}
 	return ret;
 }
 
@@ -74,20 +226,26 @@ bool OverlayDB::exists(h256 _h) const
 {
 	if (MemoryDB::exists(_h))
 		return true;
-	std::string ret;
-	if (m_db)
-		m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
-	return !ret.empty();
+	return !lookup(_h).empty();
+}
+
+void OverlayDB::insert(h256 _h, bytesConstRef _v)
+{
+	MemoryDB::insert(_h, _v);
+	if (m_history)
+		++m_journal.write()[_h];
 }
 
 void OverlayDB::kill(h256 _h)
 {
+	if (m_history)
+		--m_journal.write()[_h];
 #if ETH_PARANOIA
 	if (!MemoryDB::kill(_h))
 	{
 		std::string ret;
 		if (m_db)
-			m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
+			ret = m_db->get(_h.ref());
 		if (ret.empty())
 			cnote << "Decreasing DB node ref count below zero with no DB node. Probably have a corrupt Trie." << _h.abridged();
 	}
@@ -22,37 +22,89 @@
 #pragma once
 
 #include <memory>
+#include <functional>
 #include <libethential/Common.h>
 #include <libethential/Log.h>
 #include "MemoryDB.h"
-namespace ldb = leveldb;
+#include "NodeCache.h"
+#include "KeyValueDB.h"
 
 namespace eth
 {
 
+/// Default bound, in bytes of node data, on the node cache shared by an OverlayDB and its copies.
+static const size_t c_defaultNodeCacheSize = 32 * 1024 * 1024;
+
+/// What a single (batched) write to a disk DB amounted to.
+struct DBWriteStats
+{
+	unsigned keys = 0;
+	size_t bytes = 0;
+};
+
 class OverlayDB: public MemoryDB
 {
 public:
-	OverlayDB(ldb::DB* _db = nullptr): m_db(_db) {}
+	/// Overlay @a _db, which is taken ownership of.
+	OverlayDB(KeyValueDB* _db = nullptr): m_db(_db), m_cache(_db ? std::make_shared<NodeCache>(c_defaultNodeCacheSize) : nullptr) {}
 	~OverlayDB();
 
-	ldb::DB* db() const { return m_db.get(); }
-	void setDB(ldb::DB* _db, bool _clearOverlay = true);
+	KeyValueDB* db() const { return m_db.get(); }
+	void setDB(KeyValueDB* _db, bool _clearOverlay = true);
 
+	/// Write all live nodes of the overlay to the disk DB as a single atomic batch and clear the overlay.
 	void commit();
+	/// As commit(), but when pruning also journal the nodes inserted and killed since startJournal() as the state of
+	/// block @a _id, number @a _number. Inserted nodes are counted in on-disk reference counts immediately; killed ones
+	/// are only counted out once prune() passes @a _number. Committing the same block twice journals it once.
+	void commit(unsigned _number, h256 const& _id);
 	void rollback();
 
+	/// Keep only the states of the last @a _history blocks given to commit(_number, _id); 0 (the default) keeps all.
+	void setPruning(unsigned _history) { m_history = _history; }
+	unsigned pruning() const { return m_history; }
+	/// Note that the overlay's state is now the base for the next commit(_number, _id): forget the journal so far.
+	void startJournal() { m_journal.reset(); }
+	/// Delete from the disk DB the nodes no longer needed by any state of a block numbered from the last one pruned
+	/// up to @a _upTo. For each number, only the state of the block @a _canonical gives is kept; others are dropped.
+	/// Nodes written other than through commit(_number, _id) (e.g. genesis, or before pruning) are never deleted.
+	void prune(unsigned _upTo, std::function<h256(unsigned)> const& _canonical);
+
+	/// Set whether commit() waits for the write to reach the disk (true) or returns once the OS has it (false, the default).
+	void setSyncWrites(bool _sync) { m_syncWrites = _sync; }
+	/// @returns the number of keys and bytes written by the last commit().
+	DBWriteStats const& lastCommit() const { return m_lastCommit; }
+
+	/// Set the bound, in bytes, on the cache of disk DB nodes. It is shared with all copies of this OverlayDB.
+	void setCacheSize(size_t _bytes) { if (m_cache) m_cache->setCapacity(_bytes); }
+	CacheStats cacheStats() const { return m_cache ? m_cache->stats() : CacheStats(); }
+
 	std::string lookup(h256 _h) const;
 	bool exists(h256 _h) const;
+	void insert(h256 _h, bytesConstRef _v);
 	void kill(h256 _h);
 
+	/// Write @a _value under @a _key in the disk DB as part of the next commit(). For records kept alongside the nodes;
+	/// @a _key must not be 32 bytes long, lest it clash with a node.
+	void insertAux(std::string const& _key, bytesConstRef _value) { assert(_key.size() != 32); m_aux[_key] = _value.toString(); }
+
 private:
 	using MemoryDB::clear;
 
-	std::shared_ptr<ldb::DB> m_db;
+	/// Put the overlay's live nodes into @a o_batch, noting them in m_lastCommit.
+	void writeNodes(DBBatch& o_batch);
+	/// Note the overlay's live nodes in the node cache and clear the overlay.
+	void finishCommit();
+
+	std::shared_ptr<KeyValueDB> m_db;
+	std::shared_ptr<NodeCache> m_cache;		///< Recently used nodes of m_db; shared, like m_db, between copies.
+
+	bool m_syncWrites = false;
+	DBWriteStats m_lastCommit;
 
-	ldb::ReadOptions m_readOptions;
-	ldb::WriteOptions m_writeOptions;
+	unsigned m_history = 0;
+	CopyOnWrite<std::map<h256, int>> m_journal;	///< Net inserts (+) and kills (-) of each node since startJournal(); only kept when pruning.
+	std::map<std::string, std::string> m_aux;		///< Records to be written with the next commit(); see insertAux().
 };
 
 }
@@ -21,15 +21,18 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <memory>
+#include <thread>
+#include <vector>
 #include <libethential/Common.h>
 #include <libethential/Log.h>
 #include <libethcore/SHA3.h>
 #include "MemoryDB.h"
 #include "OverlayDB.h"
 #include "TrieCommon.h"
-namespace ldb = leveldb;
 
 namespace eth
 {
@@ -151,6 +154,11 @@ public:
 	}
 
 	std::string at(bytesConstRef _key) const;
+	/// Look up each of @a _keys, which must be in ascending order, in a single walk of the trie: nodes on the path
+	/// to several keys are read from the DB only once. If @a _readers is greater than one, the subtrees below the
+	/// first branch are read on up to that many threads; the DB's lookup() must then be safe to call concurrently.
+	/// @returns the value of each key, in the same order as @a _keys; empty if it has none.
+	std::vector<std::string> atMany(std::vector<bytes> const& _keys, unsigned _readers = 1) const;
 	void insert(bytesConstRef _key, bytesConstRef _value);
 	void remove(bytesConstRef _key);
 	void contains(bytesConstRef _key) { return !at(_key).empty(); }
@@ -162,6 +170,8 @@ public:
 
 		iterator() {}
 		iterator(GenericTrieDB const* _db);
+		/// Start at the first key that is no less than @a _fullKey.
+		iterator(GenericTrieDB const* _db, bytesConstRef _fullKey);
 
 		iterator& operator++() { next(); return *this; }
 
@@ -195,11 +205,17 @@ public:
 
 	iterator begin() const { return this; }
 	iterator end() const { return iterator(); }
+	/// @returns an iterator at the first key no less than @a _key, having read only the nodes on the path to it.
+	/// Iterating over everything under a prefix is a matter of starting at lower_bound(prefix) and stopping at the
+	/// first key that doesn't begin with it; a listing may be resumed later from the key after the last one seen.
+	iterator lower_bound(bytesConstRef _key) const { return iterator(this, _key); }
 
 private:
 	RLPStream& streamNode(RLPStream& _s, bytes const& _b);
 
 	std::string atAux(RLP const& _here, NibbleSlice _key) const;
+	/// Look up keys [_begin, _end) of @a _keys, all of whose first @a _depth nibbles lead to @a _here.
+	void atManyAux(RLP const& _here, std::vector<NibbleSlice> const& _keys, uint _depth, uint _begin, uint _end, std::vector<std::string>& o_values, unsigned _readers) const;
 
 	void mergeAtAux(RLPStream& _out, RLP const& _replace, NibbleSlice _key, bytesConstRef _value);
 	bytes mergeAt(RLP const& _replace, NibbleSlice _k, bytesConstRef _v, bool _inLine = false);
@@ -277,6 +293,7 @@ public:
 
 	bool contains(KeyType _k) const { return GenericTrieDB<DB>::contains(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
 	std::string at(KeyType _k) const { return GenericTrieDB<DB>::at(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
+	std::vector<std::string> atMany(std::vector<KeyType> const& _keys, unsigned _readers = 1) const;
 	void insert(KeyType _k, bytesConstRef _value) { GenericTrieDB<DB>::insert(bytesConstRef((byte const*)&_k, sizeof(KeyType)), _value); }
 	void insert(KeyType _k, bytes const& _value) { insert(_k, bytesConstRef(&_value)); }
 	void remove(KeyType _k) { GenericTrieDB<DB>::remove(bytesConstRef((byte const*)&_k, sizeof(KeyType))); }
@@ -289,6 +306,7 @@ public:
 
 		iterator() {}
 		iterator(TrieDB const* _db): Super(_db) {}
+		iterator(TrieDB const* _db, KeyType _k): Super(_db, bytesConstRef((byte const*)&_k, sizeof(KeyType))) {}
 
 		value_type operator*() const { return at(); }
 		value_type operator->() const { return at(); }
@@ -298,6 +316,7 @@ public:
 
 	iterator begin() const { return this; }
 	iterator end() const { return iterator(); }
+	iterator lower_bound(KeyType _k) const { return iterator(this, _k); }
 };
 
 template <class KeyType, class DB>
@@ -321,6 +340,64 @@ template <class DB> GenericTrieDB<DB>::iterator::iterator(GenericTrieDB const* _
 	next();
 }
 
+template <class DB> GenericTrieDB<DB>::iterator::iterator(GenericTrieDB const* _db, bytesConstRef _fullKey)
+{
+	m_that = _db;
+	m_trail.push_back({_db->node(_db->m_root), std::string(1, '\0'), 255});
+	NibbleSlice k(_fullKey);
+
+	// Follow _fullKey down for as long as the trie does, leaving the trail as next() would have had it. Where they
+	// part, the subtree at the top of the trail is either all before _fullKey (in which case we pop it) or all after.
+	while (true)
+	{
+		Node& b = m_trail.back();
+		RLP rlp(b.rlp);
+		NibbleSlice r = k.mid(keyOf(b.key).size());
+		bool before = false;
+		if (rlp.isList() && rlp.itemCount() == 2)
+		{
+			auto nk = keyOf(rlp);
+			uint s = nk.shared(r);
+			if (s < nk.size() && s < r.size())
+				before = nk[s] < r[s];
+			else if (s == nk.size() && !isLeaf(rlp))
+			{
+				// extension on our path - go through it.
+				b.key = hexPrefixEncode(keyOf(b.key), nk, false);
+				b.rlp = m_that->deref(rlp[1]);
+				continue;
+			}
+			else if (s == nk.size() && s == r.size())
+			{
+				// exactly our key.
+				b.key = hexPrefixEncode(keyOf(b.key), nk, false);
+				b.child = 0;
+				return;
+			}
+			else
+				// either the leaf is a prefix of our key, or our key is a prefix of the node's.
+				before = s == nk.size();
+		}
+		else if (rlp.isList() && rlp.itemCount() == 17 && r.size())
+		{
+			// the value here and the children before r[0] are all before our key.
+			byte c = r[0];
+			b.child = c;
+			if (!rlp[c].isEmpty())
+			{
+				Node n{m_that->deref(rlp[c]), hexPrefixEncode(keyOf(b.key), NibbleSlice(bytesConstRef(&c, 1), 1), false), 255};
+				m_trail.push_back(n);
+				continue;
+			}
+		}
+
+		if (before)
+			m_trail.pop_back();
+		next();
+		return;
+	}
+}
+
 template <class DB> typename GenericTrieDB<DB>::iterator::value_type GenericTrieDB<DB>::iterator::at() const
 {
 	assert(m_trail.size());
@@ -444,6 +521,15 @@ template <class KeyType, class DB> typename TrieDB<KeyType, DB>::iterator::value
 	return ret;
 }
 
+template <class KeyType, class DB> std::vector<std::string> TrieDB<KeyType, DB>::atMany(std::vector<KeyType> const& _keys, unsigned _readers) const
+{
+	std::vector<bytes> keys;
+	keys.reserve(_keys.size());
+	for (auto const& k: _keys)
+		keys.push_back(bytes((byte const*)&k, (byte const*)&k + sizeof(KeyType)));
+	return GenericTrieDB<DB>::atMany(keys, _readers);
+}
+
 template <class DB> void GenericTrieDB<DB>::init()
 {
 	m_root = insertNode(&RLPNull);
@@ -474,6 +560,80 @@ template <class DB> std::string GenericTrieDB<DB>::at(bytesConstRef _key) const
 	return atAux(RLP(node(m_root)), _key);
 }
 
+template <class DB> std::vector<std::string> GenericTrieDB<DB>::atMany(std::vector<bytes> const& _keys, unsigned _readers) const
+{
+	assert(std::is_sorted(_keys.begin(), _keys.end()));
+	std::vector<NibbleSlice> keys;
+	keys.reserve(_keys.size());
+	for (auto const& k: _keys)
+		keys.push_back(NibbleSlice(&k));
+	std::vector<std::string> ret(_keys.size());
+	std::string root = node(m_root);
+	atManyAux(RLP(root), keys, 0, 0, keys.size(), ret, std::max(1u, _readers));
+	return ret;
+}
+
+template <class DB> void GenericTrieDB<DB>::atManyAux(RLP const& _here, std::vector<NibbleSlice> const& _keys, uint _depth, uint _begin, uint _end, std::vector<std::string>& o_values, unsigned _readers) const
+{
+	if (_here.isEmpty() || _here.isNull() || _begin == _end)
+		return;
+	assert(_here.isList() && (_here.itemCount() == 2 || _here.itemCount() == 17));
+	if (_here.itemCount() == 2)
+	{
+		auto k = keyOf(_here);
+		if (isLeaf(_here))
+		{
+			for (uint i = _begin; i < _end; ++i)
+				if (_keys[i].mid(_depth) == k)
+					o_values[i] = _here[1].toString();
+			return;
+		}
+		// keys are in order, so those that go on through us are all together.
+		uint b = _begin;
+		for (; b < _end && !_keys[b].mid(_depth).contains(k); ++b) {}
+		uint e = b;
+		for (; e < _end && _keys[e].mid(_depth).contains(k); ++e) {}
+		if (b < e)
+		{
+			std::string n = deref(_here[1]);
+			atManyAux(RLP(n), _keys, _depth + k.size(), b, e, o_values, _readers);
+		}
+		return;
+	}
+
+	// a key that ends here is a prefix of, and so comes before, all the others.
+	uint b = _begin;
+	for (; b < _end && _keys[b].size() == _depth; ++b)
+		o_values[b] = _here[16].toString();
+
+	// split the rest by their next nibble; each group goes down a different child.
+	std::vector<std::pair<uint, uint>> groups;
+	for (uint e = b; b < _end; b = e)
+	{
+		byte c = _keys[b][_depth];
+		for (; e < _end && _keys[e][_depth] == c; ++e) {}
+		if (!_here[c].isEmpty())
+			groups.push_back(std::make_pair(b, e));
+	}
+
+	std::atomic<size_t> next(0);
+	auto read = [&]()
+	{
+		for (size_t i; (i = next++) < groups.size();)
+		{
+			auto const& g = groups[i];
+			std::string n = deref(_here[_keys[g.first][_depth]]);
+			atManyAux(RLP(n), _keys, _depth + 1, g.first, g.second, o_values, 1);
+		}
+	};
+	std::vector<std::thread> readers;
+	for (unsigned i = 1; i < std::min<size_t>(_readers, groups.size()); ++i)
+		readers.push_back(std::thread(read));
+	read();
+	for (auto& r: readers)
+		r.join();
+}
+
 template <class DB> std::string GenericTrieDB<DB>::atAux(RLP const& _here, NibbleSlice _key) const
 {
 	if (_here.isEmpty() || _here.isNull())
@@ -642,9 +802,12 @@ template <class DB> bytes GenericTrieDB<DB>::deleteAt(RLP const& _orig, NibbleSl
 		// pair...
 		NibbleSlice k = keyOf(_orig);
 
-		// exactly our node - return null.
+		// exactly our node - kill it and return null.
 		if (k == _k && isLeaf(_orig))
+		{
+			killNode(_orig);
 			return RLPNull;
+		}
 
 		// partial key is our key - move down.
 		if (_k.contains(k))
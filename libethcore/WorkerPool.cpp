@@ -0,0 +1,88 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file WorkerPool.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "WorkerPool.h"
+
+#include <algorithm>
+using namespace std;
+using namespace eth;
+
+WorkerPool& WorkerPool::get()
+{
+	static WorkerPool s_pool;
+	return s_pool;
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		lock_guard<mutex> l(x_queue);
+		m_stopping = true;
+	}
+	m_queued.notify_all();
+	for (auto& w: m_workers)
+		w.join();
+}
+
+void WorkerPool::run(std::function<void()> const& _job, unsigned _threads)
+{
+	if (_threads < 2)
+	{
+		_job();
+		return;
+	}
+
+	Job job{&_job, _threads - 1};
+	{
+		lock_guard<mutex> l(x_queue);
+		while (m_workers.size() < _threads - 1)
+			m_workers.push_back(thread([this]() { work(); }));
+		m_queue.insert(m_queue.end(), _threads - 1, &job);
+	}
+	m_queued.notify_all();
+
+	_job();
+
+	// Ours is done, so the work is all taken: withdraw the copies not yet started and wait for the rest.
+	unique_lock<mutex> l(x_queue);
+	auto unstarted = remove(m_queue.begin(), m_queue.end(), &job);
+	job.pending -= m_queue.end() - unstarted;
+	m_queue.erase(unstarted, m_queue.end());
+	m_finished.wait(l, [&]() { return !job.pending; });
+}
+
+void WorkerPool::work()
+{
+	unique_lock<mutex> l(x_queue);
+	while (true)
+	{
+		m_queued.wait(l, [&]() { return m_stopping || !m_queue.empty(); });
+		if (m_stopping)
+			return;
+		Job* job = m_queue.front();
+		m_queue.pop_front();
+		l.unlock();
+		(*job->run)();
+		l.lock();
+		if (!--job->pending)
+			m_finished.notify_all();
+	}
+}
@@ -0,0 +1,73 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file WorkerPool.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace eth
+{
+
+/**
+ * @brief A process-wide pool of threads for running a job on several at once, e.g. hashing a trie's changed subtrees.
+ * Threads are started as they're first needed and then kept, waiting for work, until the process ends.
+ * @threadsafe
+ */
+class WorkerPool
+{
+public:
+	/// @returns the process's pool.
+	static WorkerPool& get();
+
+	~WorkerPool();
+
+	/// Run @a _job on @a _threads threads at once, this one and the rest from the pool, and return once all are done.
+	/// Each run of @a _job should take what's left of some shared work until there's none; copies that no worker has
+	/// started by the time this thread's is done are dropped.
+	void run(std::function<void()> const& _job, unsigned _threads);
+
+private:
+	WorkerPool() {}
+
+	/// A job handed to the pool, with the number of its copies not yet finished.
+	struct Job
+	{
+		std::function<void()> const* run;
+		unsigned pending;
+	};
+
+	/// A worker's loop: run queued jobs until we're stopping.
+	void work();
+
+	std::mutex x_queue;
+	std::condition_variable m_queued;	///< Signalled when jobs are queued, or we're stopping.
+	std::condition_variable m_finished;	///< Signalled when a job's last copy is finished.
+	std::deque<Job*> m_queue;			///< A copy of the job for each worker it's for.
+	std::vector<std::thread> m_workers;
+	bool m_stopping = false;
+};
+
+}
@@ -3,6 +3,8 @@
 #include "Common.h"
 #include "CommonData.h"
 #include "CommonIO.h"
+#include "CopyOnWrite.h"
 #include "FixedHash.h"
 #include "Log.h"
 #include "RLP.h"
+#include "W256.h"
@@ -95,7 +95,7 @@ bytes eth::asNibbles(std::string const& _s)
 {
 	std::vector<uint8_t> ret;
 	ret.reserve(_s.size() * 2);
-	for (auto i: _s)
+	for (byte i: _s)
 	{
 		ret.push_back(i / 16);
 		ret.push_back(i % 16);
@@ -0,0 +1,56 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CopyOnWrite.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <memory>
+
+namespace eth
+{
+
+/**
+ * @brief A value shared between copies of its holder until one of them alters it.
+ * Copying is O(1). The first write() through a copy whose value is still shared gives that copy its own value first, so
+ * what the others see never changes under them.
+ * @threadsafe for reading through different copies, so long as copying from (and writing to) any one copy is
+ * synchronised like it would be for a plain T.
+ */
+template <class T>
+class CopyOnWrite
+{
+public:
+	CopyOnWrite(): m_p(std::make_shared<T>()) {}
+
+	T const& operator*() const { return *m_p; }
+	T const* operator->() const { return m_p.get(); }
+
+	/// @returns the value for altering, having first made it our own if it's shared.
+	T& write() { if (m_p.use_count() > 1) m_p = std::make_shared<T>(*m_p); return *m_p; }
+
+	/// Start afresh with an empty value, leaving any others sharing the old one be. If it's not shared, the value is
+	/// cleared in place, so it may keep hold of the memory it had for reuse.
+	void reset() { if (m_p.use_count() > 1) m_p = std::make_shared<T>(); else m_p->clear(); }
+
+private:
+	std::shared_ptr<T> m_p;
+};
+
+}
@@ -0,0 +1,372 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file W256.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ *
+ * A fixed-width 256-bit unsigned integer for hot loops.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include "Common.h"
+#include "FixedHash.h"
+
+namespace eth
+{
+
+/**
+ * @brief An unsigned 256-bit integer as four 64-bit limbs, least significant first, with all arithmetic modulo
+ * 2**256, as in the VM. It's a plain value: unlike u256 nothing about it is generic, so every operation is inline
+ * and straight-line. Where the compiler has a 128-bit integer type, products are formed with it.
+ * Conversion to a built-in integer type takes the low-order bits.
+ */
+class w256
+{
+public:
+	w256(): m_l{0, 0, 0, 0} {}
+	w256(uint64_t _v): m_l{_v, 0, 0, 0} {}
+	explicit w256(u256 const& _u);
+	explicit w256(h256 const& _h): w256(fromBigEndian(_h.ref())) {}
+
+	/// @returns the value of the (at most 32) big-endian bytes @a _b.
+	static w256 fromBigEndian(bytesConstRef _b);
+	/// Write the value as 32 big-endian bytes to @a o_b.
+	void toBigEndian(byte* o_b) const;
+
+	u256 toU256() const { return (u256(m_l[3]) << 192) | (u256(m_l[2]) << 128) | (u256(m_l[1]) << 64) | m_l[0]; }
+	h256 toHash() const { h256 ret; toBigEndian(ret.data()); return ret; }
+
+	explicit operator bool() const { return m_l[0] | m_l[1] | m_l[2] | m_l[3]; }
+	explicit operator uint64_t() const { return m_l[0]; }
+	explicit operator unsigned() const { return (unsigned)m_l[0]; }
+	/// @returns true if the value fits in 64 bits.
+	bool fits64() const { return !(m_l[1] | m_l[2] | m_l[3]); }
+
+	bool operator==(w256 const& _c) const { return m_l[0] == _c.m_l[0] && m_l[1] == _c.m_l[1] && m_l[2] == _c.m_l[2] && m_l[3] == _c.m_l[3]; }
+	bool operator!=(w256 const& _c) const { return !operator==(_c); }
+	bool operator<(w256 const& _c) const;
+	bool operator>(w256 const& _c) const { return _c < *this; }
+	bool operator<=(w256 const& _c) const { return !(_c < *this); }
+	bool operator>=(w256 const& _c) const { return !(*this < _c); }
+
+	w256& operator+=(w256 const& _c);
+	w256& operator-=(w256 const& _c);
+	w256& operator*=(w256 const& _c) { return *this = *this * _c; }
+	w256 operator+(w256 const& _c) const { return w256(*this) += _c; }
+	w256 operator-(w256 const& _c) const { return w256(*this) -= _c; }
+	w256 operator*(w256 const& _c) const;
+	/// Division and remainder; both are zero when dividing by zero.
+	w256 operator/(w256 const& _c) const { w256 q; w256 r; divMod(*this, _c, q, r); return q; }
+	w256 operator%(w256 const& _c) const { w256 q; w256 r; divMod(*this, _c, q, r); return r; }
+	w256 operator-() const { return ~*this + 1; }
+
+	w256 operator~() const { w256 ret; for (unsigned i = 0; i < 4; ++i) ret.m_l[i] = ~m_l[i]; return ret; }
+	w256& operator&=(w256 const& _c) { for (unsigned i = 0; i < 4; ++i) m_l[i] &= _c.m_l[i]; return *this; }
+	w256& operator|=(w256 const& _c) { for (unsigned i = 0; i < 4; ++i) m_l[i] |= _c.m_l[i]; return *this; }
+	w256& operator^=(w256 const& _c) { for (unsigned i = 0; i < 4; ++i) m_l[i] ^= _c.m_l[i]; return *this; }
+	w256 operator&(w256 const& _c) const { return w256(*this) &= _c; }
+	w256 operator|(w256 const& _c) const { return w256(*this) |= _c; }
+	w256 operator^(w256 const& _c) const { return w256(*this) ^= _c; }
+	w256 operator<<(unsigned _n) const;
+	w256 operator>>(unsigned _n) const;
+
+	/// As two's complement: the sign, and signed division, remainder (which takes the sign of the dividend) and comparison.
+	bool negative() const { return m_l[3] >> 63; }
+	w256 sdiv(w256 const& _c) const;
+	w256 smod(w256 const& _c) const;
+	bool slt(w256 const& _c) const { return negative() != _c.negative() ? negative() : *this < _c; }
+	bool sgt(w256 const& _c) const { return _c.slt(*this); }
+
+	/// @returns byte @a _i, counting from the most significant; _i must be less than 32.
+	byte byteAt(unsigned _i) const { return (byte)(m_l[(31 - _i) / 8] >> ((31 - _i) % 8 * 8)); }
+	/// @returns the value raised to the power @a _e.
+	w256 pow(unsigned _e) const;
+
+	/// Set @a o_q and @a o_r to the quotient and remainder of @a _u by @a _v, or both to zero if @a _v is zero.
+	static void divMod(w256 const& _u, w256 const& _v, w256& o_q, w256& o_r);
+
+private:
+	uint64_t m_l[4];
+};
+
+#if defined(__SIZEOF_INT128__)
+using w256_uint128 = unsigned __int128;
+#endif
+
+/// @returns the low 64 bits of @a _a * @a _b + @a _c + @a _d, putting the high 64 bits in @a o_hi. (It can't overflow.)
+inline uint64_t w256MulAdd(uint64_t _a, uint64_t _b, uint64_t _c, uint64_t _d, uint64_t& o_hi)
+{
+#if defined(__SIZEOF_INT128__)
+	w256_uint128 p = (w256_uint128)_a * _b + _c + _d;
+	o_hi = (uint64_t)(p >> 64);
+	return (uint64_t)p;
+#else
+	uint64_t al = (uint32_t)_a, ah = _a >> 32, bl = (uint32_t)_b, bh = _b >> 32;
+	uint64_t ll = al * bl, lh = al * bh, hl = ah * bl, hh = ah * bh;
+	uint64_t mid = (ll >> 32) + (uint32_t)lh + (uint32_t)hl;
+	uint64_t lo = (mid << 32) | (uint32_t)ll;
+	uint64_t hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+	lo += _c;
+	hi += lo < _c;
+	lo += _d;
+	hi += lo < _d;
+	o_hi = hi;
+	return lo;
+#endif
+}
+
+inline w256::w256(u256 const& _u): m_l{0, 0, 0, 0}
+{
+	auto const& b = _u.backend();
+	unsigned const bits = sizeof(*b.limbs()) * 8;
+	for (unsigned i = 0; i < b.size() && i * bits < 256; ++i)
+		m_l[i * bits / 64] |= uint64_t(b.limbs()[i]) << (i * bits % 64);
+}
+
+inline w256 w256::fromBigEndian(bytesConstRef _b)
+{
+	w256 ret;
+	for (unsigned i = 0, n = (unsigned)_b.size(); i < n; ++i)
+		ret.m_l[i / 8] |= uint64_t(_b[n - 1 - i]) << (i % 8 * 8);
+	return ret;
+}
+
+inline void w256::toBigEndian(byte* o_b) const
+{
+	for (unsigned i = 0; i < 32; ++i)
+		o_b[31 - i] = (byte)(m_l[i / 8] >> (i % 8 * 8));
+}
+
+inline bool w256::operator<(w256 const& _c) const
+{
+	for (unsigned i = 4; i--;)
+		if (m_l[i] != _c.m_l[i])
+			return m_l[i] < _c.m_l[i];
+	return false;
+}
+
+inline w256& w256::operator+=(w256 const& _c)
+{
+	uint64_t carry = 0;
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		uint64_t s = m_l[i] + carry;
+		carry = s < carry;
+		m_l[i] = s + _c.m_l[i];
+		carry += m_l[i] < s;
+	}
+	return *this;
+}
+
+inline w256& w256::operator-=(w256 const& _c)
+{
+	uint64_t borrow = 0;
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		uint64_t d = m_l[i] - _c.m_l[i];
+		uint64_t b = m_l[i] < _c.m_l[i];
+		m_l[i] = d - borrow;
+		borrow = b | (d < borrow);
+	}
+	return *this;
+}
+
+inline w256 w256::operator*(w256 const& _c) const
+{
+	w256 ret;
+	for (unsigned i = 0; i < 4; ++i)
+		if (m_l[i])
+		{
+			uint64_t carry = 0;
+			for (unsigned j = 0; i + j < 4; ++j)
+				ret.m_l[i + j] = w256MulAdd(m_l[i], _c.m_l[j], ret.m_l[i + j], carry, carry);
+		}
+	return ret;
+}
+
+inline w256 w256::operator<<(unsigned _n) const
+{
+	w256 ret;
+	if (_n >= 256)
+		return ret;
+	unsigned limbs = _n / 64;
+	unsigned bits = _n % 64;
+	for (unsigned i = 4; i-- > limbs;)
+	{
+		ret.m_l[i] = m_l[i - limbs] << bits;
+		if (bits && i > limbs)
+			ret.m_l[i] |= m_l[i - limbs - 1] >> (64 - bits);
+	}
+	return ret;
+}
+
+inline w256 w256::operator>>(unsigned _n) const
+{
+	w256 ret;
+	if (_n >= 256)
+		return ret;
+	unsigned limbs = _n / 64;
+	unsigned bits = _n % 64;
+	for (unsigned i = 0; i + limbs < 4; ++i)
+	{
+		ret.m_l[i] = m_l[i + limbs] >> bits;
+		if (bits && i + limbs < 3)
+			ret.m_l[i] |= m_l[i + limbs + 1] << (64 - bits);
+	}
+	return ret;
+}
+
+inline w256 w256::sdiv(w256 const& _c) const
+{
+	w256 q = (negative() ? -*this : *this) / (_c.negative() ? -_c : _c);
+	return negative() != _c.negative() ? -q : q;
+}
+
+inline w256 w256::smod(w256 const& _c) const
+{
+	w256 r = (negative() ? -*this : *this) % (_c.negative() ? -_c : _c);
+	return negative() ? -r : r;
+}
+
+inline w256 w256::pow(unsigned _e) const
+{
+	w256 ret = 1;
+	for (w256 b = *this; _e; _e >>= 1, b *= b)
+		if (_e & 1)
+			ret *= b;
+	return ret;
+}
+
+inline void w256::divMod(w256 const& _u, w256 const& _v, w256& o_q, w256& o_r)
+{
+	o_q = w256();
+	o_r = w256();
+	if (!_v)
+		return;
+	if (_u < _v)
+	{
+		o_r = _u;
+		return;
+	}
+	if (_u.fits64())
+	{
+		// Then so does _v.
+		o_q = _u.m_l[0] / _v.m_l[0];
+		o_r = _u.m_l[0] % _v.m_l[0];
+		return;
+	}
+
+	// Knuth's algorithm D, on 32-bit digits so that all the intermediates fit in 64 bits.
+	uint32_t u[8];
+	uint32_t v[8];
+	for (unsigned i = 0; i < 8; ++i)
+	{
+		u[i] = (uint32_t)(_u.m_l[i / 2] >> (i % 2 * 32));
+		v[i] = (uint32_t)(_v.m_l[i / 2] >> (i % 2 * 32));
+	}
+	int m = 8;
+	while (!u[m - 1])
+		--m;
+	int n = 8;
+	while (!v[n - 1])
+		--n;
+	uint32_t q[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+	uint32_t r[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+	if (n == 1)
+	{
+		uint64_t k = 0;
+		for (int j = m; j--;)
+		{
+			uint64_t t = (k << 32) | u[j];
+			q[j] = (uint32_t)(t / v[0]);
+			k = t % v[0];
+		}
+		r[0] = (uint32_t)k;
+	}
+	else
+	{
+		// Normalise so that the divisor's top digit has its top bit set.
+		int s = 0;
+		for (uint32_t t = v[n - 1]; !(t & 0x80000000u); t <<= 1)
+			++s;
+		uint32_t vn[8];
+		uint32_t un[9];
+		for (int i = n - 1; i > 0; --i)
+			vn[i] = (v[i] << s) | (uint32_t)((uint64_t)v[i - 1] >> (32 - s));
+		vn[0] = v[0] << s;
+		un[m] = (uint32_t)((uint64_t)u[m - 1] >> (32 - s));
+		for (int i = m - 1; i > 0; --i)
+			un[i] = (u[i] << s) | (uint32_t)((uint64_t)u[i - 1] >> (32 - s));
+		un[0] = u[0] << s;
+
+		uint64_t const b = 1ull << 32;
+		for (int j = m - n; j >= 0; --j)
+		{
+			// Estimate the quotient digit (it's at most two too big)...
+			uint64_t num = ((uint64_t)un[j + n] << 32) | un[j + n - 1];
+			uint64_t qhat = num / vn[n - 1];
+			uint64_t rhat = num % vn[n - 1];
+			while (qhat >= b || qhat * vn[n - 2] > ((rhat << 32) | un[j + n - 2]))
+			{
+				--qhat;
+				rhat += vn[n - 1];
+				if (rhat >= b)
+					break;
+			}
+			// ...multiply and subtract...
+			int64_t t;
+			uint64_t k = 0;
+			for (int i = 0; i < n; ++i)
+			{
+				uint64_t p = qhat * vn[i];
+				t = (int64_t)un[i + j] - (int64_t)k - (int64_t)(p & 0xffffffff);
+				un[i + j] = (uint32_t)t;
+				k = (p >> 32) - (t >> 32);
+			}
+			t = (int64_t)un[j + n] - (int64_t)k;
+			un[j + n] = (uint32_t)t;
+			q[j] = (uint32_t)qhat;
+			// ...and add back if it was one too big.
+			if (t < 0)
+			{
+				--q[j];
+				k = 0;
+				for (int i = 0; i < n; ++i)
+				{
+					uint64_t a = (uint64_t)un[i + j] + vn[i] + k;
+					un[i + j] = (uint32_t)a;
+					k = a >> 32;
+				}
+				un[j + n] = (uint32_t)(un[j + n] + k);
+			}
+		}
+		for (int i = 0; i < n - 1; ++i)
+			r[i] = (un[i] >> s) | (uint32_t)((uint64_t)un[i + 1] << (32 - s));
+		r[n - 1] = un[n - 1] >> s;
+	}
+
+	for (unsigned i = 0; i < 4; ++i)
+	{
+		o_q.m_l[i] = q[i * 2] | ((uint64_t)q[i * 2 + 1] << 32);
+		o_r.m_l[i] = r[i * 2] | ((uint64_t)r[i * 2 + 1] << 32);
+	}
+}
+
+}
@@ -24,6 +24,7 @@
 #include <libethential/Common.h>
 #include <libethential/RLP.h>
 #include <libethcore/SHA3.h>
+#include "CodeCache.h"
 
 namespace eth
 {
@@ -50,14 +51,17 @@ public:
 	h256 baseRoot() const { return m_storageRoot; }
 	std::map<u256, u256> const& storage() const { return m_storageOverlay; }
 	void setStorage(u256 _p, u256 _v) { m_storageOverlay[_p] = _v; }
+	void uncacheStorage(u256 _p) { m_storageOverlay.erase(_p); }
 
 	bool isFreshCode() const { return !m_codeHash; }
 	bool codeBearing() const { return m_codeHash != EmptySHA3; }
-	bool codeCacheValid() const { return m_codeHash == EmptySHA3 || !m_codeHash || m_codeCache.size(); }
+	bool codeCacheValid() const { return m_codeHash == EmptySHA3 || !m_codeHash || m_code; }
 	h256 codeHash() const { assert(m_codeHash); return m_codeHash; }
-	bytes const& code() const { assert(m_codeHash == EmptySHA3 || !m_codeHash || m_codeCache.size()); return m_codeCache; }
-	void setCode(bytesConstRef _code) { assert(!m_codeHash); m_codeCache = _code.toBytes(); }
-	void noteCode(bytesConstRef _code) { assert(sha3(_code) == m_codeHash); m_codeCache = _code.toBytes(); }
+	bytes const& code() const { assert(codeCacheValid()); return m_code ? *m_code : NullBytes; }
+	/// @returns the code as shared with all else using it; null if there's none (yet).
+	SharedCode const& sharedCode() const { assert(codeCacheValid()); return m_code; }
+	void setCode(bytesConstRef _code) { assert(!m_codeHash); m_code = std::make_shared<bytes const>(_code.toBytes()); }
+	void noteCode(SharedCode const& _code) { assert(sha3(*_code) == m_codeHash); m_code = _code; }
 
 private:
 	bool m_isAlive;
@@ -69,13 +73,13 @@ private:
 	h256 m_storageRoot;
 
 	/// If 0 then we're in the limbo where we're running the initialisation code. We expect a setCode() at some point later.
-	/// If EmptySHA3, then m_code, which should be empty, is valid.
-	/// If anything else, then m_code is valid iff it's not empty, otherwise, State::ensureCached() needs to be called with the correct args.
+	/// If EmptySHA3, then m_code, which should be null, is valid.
+	/// If anything else, then m_code is valid iff it's not null, otherwise, State::ensureCached() needs to be called with the correct args.
 	h256 m_codeHash;
 
 	// TODO: change to unordered_map.
 	std::map<u256, u256> m_storageOverlay;
-	bytes m_codeCache;
+	SharedCode m_code;			///< Fresh code, or that of m_codeHash once loaded (usually from the CodeCache).
 };
 
 }
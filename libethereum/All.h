@@ -3,6 +3,7 @@
 #include "AddressState.h"
 #include "BlockChain.h"
 #include "Client.h"
+#include "CodeCache.h"
 #include "Defaults.h"
 #include "Executive.h"
 #include "ExtVM.h"
@@ -10,5 +11,7 @@
 #include "PeerServer.h"
 #include "PeerSession.h"
 #include "State.h"
+#include "StateDump.h"
+#include "StateIndex.h"
 #include "Transaction.h"
 #include "TransactionQueue.h"
@@ -0,0 +1,129 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file BlockCache.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <libethential/Common.h>
+#include <libethential/FixedHash.h>
+#include <libethcore/NodeCache.h>
+#include "Guards.h"
+
+namespace eth
+{
+
+/**
+ * @brief A map of block hash to @a T whose total size is kept to a budget.
+ * Each entry carries the size of its encoded form as its cost. Entries are evicted with the CLOCK algorithm: each
+ * get() sets an entry's reference bit; the sweep clears set bits and evicts entries whose bit is already clear, so
+ * everything looked up since the hand last passed survives.
+ * Eviction happens in garbageCollect(), which is meant to be called periodically; insert() only evicts once the
+ * cache has grown to twice its budget.
+ * @threadsafe
+ */
+template <class T>
+class BlockCache
+{
+public:
+	explicit BlockCache(size_t _budget): m_budget(_budget) {}
+
+	/// Find the item for @a _h, placing it in @a o_v. @returns false if we don't have it.
+	bool get(h256 _h, T& o_v) const
+	{
+		Guard l(x_entries);
+		auto it = m_entries.find(_h);
+		if (it == m_entries.end())
+		{
+			++m_stats.misses;
+			return false;
+		}
+		++m_stats.hits;
+		it->second.used = true;
+		o_v = it->second.value;
+		return true;
+	}
+
+	/// Note the item @a _v for @a _h, whose encoded form is @a _size bytes. Replaces any item already there.
+	void insert(h256 _h, T const& _v, size_t _size)
+	{
+		Guard l(x_entries);
+		auto& e = m_entries[_h];
+		if (e.size)
+			m_stats.bytes -= e.size;
+		else
+			++m_stats.entries;
+		e.value = _v;
+		e.size = _size + c_entryOverhead;
+		m_stats.bytes += e.size;
+		if (m_stats.bytes > m_budget * 2)
+			evictWithoutLock();
+	}
+
+	/// Evict entries until we're within budget.
+	void garbageCollect() { Guard l(x_entries); evictWithoutLock(); }
+	void clear() { Guard l(x_entries); m_entries.clear(); m_stats.bytes = m_stats.entries = 0; }
+
+	void setBudget(size_t _bytes) { Guard l(x_entries); m_budget = _bytes; }
+	CacheStats stats() const { Guard l(x_entries); CacheStats ret = m_stats; ret.capacity = m_budget; return ret; }
+
+private:
+	/// Rough cost of an entry beyond its encoded size (map node, hash, decoded form's fixed part).
+	static const size_t c_entryOverhead = 64 + sizeof(T);
+
+	struct Entry
+	{
+		T value;
+		size_t size = 0;
+		bool used = false;
+	};
+
+	void evictWithoutLock()
+	{
+		while (m_stats.bytes > m_budget && !m_entries.empty())
+		{
+			auto it = m_entries.lower_bound(m_hand);
+			if (it == m_entries.end())
+				it = m_entries.begin();
+			if (it->second.used)
+			{
+				it->second.used = false;
+				++it;
+			}
+			else
+			{
+				m_stats.bytes -= it->second.size;
+				--m_stats.entries;
+				++m_stats.evictions;
+				it = m_entries.erase(it);
+			}
+			m_hand = it == m_entries.end() ? h256() : it->first;
+		}
+	}
+
+	mutable std::mutex x_entries;
+	mutable std::map<h256, Entry> m_entries;
+	h256 m_hand;						///< The CLOCK hand: the hash at which the next sweep begins.
+	size_t m_budget;
+	mutable CacheStats m_stats;
+};
+
+}
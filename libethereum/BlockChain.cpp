@@ -35,17 +35,24 @@ using namespace eth;
 
 #define ETH_CATCH 1
 
+// Default memory budgets of the caches.
+static const size_t c_defaultDetailsCacheBudget = 8 * 1024 * 1024;
+static const size_t c_defaultBloomsCacheBudget = 8 * 1024 * 1024;
+static const size_t c_defaultTracesCacheBudget = 16 * 1024 * 1024;
+static const size_t c_defaultBlocksCacheBudget = 32 * 1024 * 1024;
+
 std::ostream& eth::operator<<(std::ostream& _out, BlockChain const& _bc)
 {
 	string cmp = toBigEndianString(_bc.currentHash());
-	auto it = _bc.m_extrasDB->NewIterator(_bc.m_readOptions);
-	for (it->SeekToFirst(); it->Valid(); it->Next())
-		if (it->key().ToString() != "best")
+	_bc.m_extrasDB->forEach(bytesConstRef(), [&](bytesConstRef _k, bytesConstRef _v)
+	{
+		if (_k.toString() != "best")
 		{
-			BlockDetails d(RLP(it->value().ToString()));
-			_out << toHex(it->key().ToString()) << ":   " << d.number << " @ " << d.parent << (cmp == it->key().ToString() ? "  BEST" : "") << std::endl;
+			BlockDetails d(RLP(_v.toString()));
+			_out << toHex(_k) << ":   " << d.number << " @ " << d.parent << (cmp == _k.toString() ? "  BEST" : "") << std::endl;
 		}
-	delete it;
+		return true;
+	});
 	return _out;
 }
 
@@ -71,18 +78,9 @@ std::map<Address, AddressState> const& eth::genesisState()
 BlockInfo* BlockChain::s_genesis = nullptr;
 boost::shared_mutex BlockChain::x_genesis;
 
-ldb::Slice eth::toSlice(h256 _h, unsigned _sub)
+h256 eth::toKey(h256 _h, unsigned _sub)
 {
-#if ALL_COMPILERS_ARE_CPP11_COMPLIANT
-	static thread_local h256 h = _h ^ h256(u256(_sub));
-	return ldb::Slice((char const*)&h, 32);
-#else
-	static boost::thread_specific_ptr<h256> t_h;
-	if (!t_h.get())
-		t_h.reset(new h256);
-	*t_h = _h ^ h256(u256(_sub));
-	return ldb::Slice((char const*)t_h.get(), 32);
-#endif
+	return _h ^ h256(u256(_sub));
 }
 
 bytes BlockChain::createGenesisBlock()
@@ -106,7 +104,11 @@ bytes BlockChain::createGenesisBlock()
 	return block.out();
 }
 
-BlockChain::BlockChain(std::string _path, bool _killExisting)
+BlockChain::BlockChain(std::string _path, bool _killExisting):
+	m_details(c_defaultDetailsCacheBudget),
+	m_blooms(c_defaultBloomsCacheBudget),
+	m_traces(c_defaultTracesCacheBudget),
+	m_blocks(c_defaultBlocksCacheBudget)
 {
 	if (_path.empty())
 		_path = Defaults::get()->m_dbPath;
@@ -117,12 +119,8 @@ BlockChain::BlockChain(std::string _path, bool _killExisting)
 		boost::filesystem::remove_all(_path + "/details");
 	}
 
-	ldb::Options o;
-	o.create_if_missing = true;
-	auto s = ldb::DB::Open(o, _path + "/blocks", &m_db);
-	assert(m_db);
-	s = ldb::DB::Open(o, _path + "/details", &m_extrasDB);
-	assert(m_extrasDB);
+	m_db = KeyValueDB::open(Defaults::dbEngine("blocks"), _path + "/blocks");
+	m_extrasDB = KeyValueDB::open(Defaults::dbEngine("details"), _path + "/details");
 
 	// Initialise with the genesis as the last block on the longest chain.
 	m_genesisHash = BlockChain::genesis().hash;
@@ -131,16 +129,16 @@ BlockChain::BlockChain(std::string _path, bool _killExisting)
 	if (!details(m_genesisHash))
 	{
 		// Insert details of genesis block.
-		m_details[m_genesisHash] = BlockDetails(0, c_genesisDifficulty, h256(), {}, h256());
-		auto r = m_details[m_genesisHash].rlp();
-		m_extrasDB->Put(m_writeOptions, ldb::Slice((char const*)&m_genesisHash, 32), (ldb::Slice)eth::ref(r));
+		BlockDetails gd(0, c_genesisDifficulty, h256(), {}, h256());
+		auto r = gd.rlp();
+		m_details.insert(m_genesisHash, gd, r.size());
+		m_extrasDB->put(m_genesisHash.ref(), &r);
 	}
 
 	checkConsistency();
 
 	// TODO: Implement ability to rebuild details map from DB.
-	std::string l;
-	m_extrasDB->Get(m_readOptions, ldb::Slice("best"), &l);
+	std::string l = m_extrasDB->get(std::string("best"));
 
 	m_lastBlockHash = l.empty() ? m_genesisHash : *(h256*)l.data();
 
@@ -150,8 +148,6 @@ BlockChain::BlockChain(std::string _path, bool _killExisting)
 BlockChain::~BlockChain()
 {
 	cnote << "Closing blockchain DB";
-	delete m_extrasDB;
-	delete m_db;
 }
 
 template <class T, class V>
@@ -249,6 +245,10 @@ h256s BlockChain::import(bytes const& _block, OverlayDB const& _db)
 	clog(BlockChainNote) << "Attempting import of " << newHash << "...";
 
 	u256 td;
+	DBWriteStats stats;
+	h256 last = currentHash();
+	bool best = false;
+	h256s ret;
 #if ETH_CATCH
 	try
 #endif
@@ -266,31 +266,92 @@ h256s BlockChain::import(bytes const& _block, OverlayDB const& _db)
 			bb.blooms.push_back(s.changesFromPending(i).bloom());
 		}
 		s.cleanup(true);
+		stats = s.db().lastCommit();
 		td = pd.totalDifficulty + tdIncrease;
 
 #if ETH_PARANOIA
 		checkConsistency();
 #endif
 		// All ok - insert into DB
+		BlockDetails nd((uint)pd.number + 1, td, bi.parentHash, {}, b);
+		pd.children.push_back(newHash);
+		bytes ndRLP = nd.rlp();
+		bytes pdRLP = pd.rlp();
+		bytes bbRLP = bb.rlp();
+		bytes btRLP = bt.rlp();
+		m_details.insert(newHash, nd, ndRLP.size());
+		m_details.insert(bi.parentHash, pd, pdRLP.size());
+		m_blooms.insert(newHash, bb, bbRLP.size());
+		m_traces.insert(newHash, bt, btRLP.size());
+
+		// This might be the new best block...
+		best = td > details(last).totalDifficulty;
+
+		// Block first, then all the extras (including the best-block pointer, if it changes) in one atomic batch, so
+		// a crash can never leave the extras referring to a block we don't have or disagreeing among themselves.
+		DBBatch blocksBatch;
+		DBBatch extrasBatch;
+		auto put = [&](DBBatch& _b, bytesConstRef _k, bytesConstRef _v)
 		{
-			WriteGuard l(x_details);
-			m_details[newHash] = BlockDetails((uint)pd.number + 1, td, bi.parentHash, {}, b);
-			m_details[bi.parentHash].children.push_back(newHash);
-		}
+			_b.put(_k, _v);
+			++stats.keys;
+			stats.bytes += _k.size() + _v.size();
+		};
+		put(blocksBatch, toKey(newHash).ref(), &_block);
+		put(extrasBatch, toKey(newHash).ref(), &ndRLP);
+		put(extrasBatch, toKey(bi.parentHash).ref(), &pdRLP);
+		put(extrasBatch, toKey(newHash, 1).ref(), &bbRLP);
+		put(extrasBatch, toKey(newHash, 2).ref(), &btRLP);
+		if (best)
 		{
-			WriteGuard l(x_blooms);
-			m_blooms[newHash] = bb;
+			put(extrasBatch, std::string("best"), newHash.ref());
+
+			// Bring the number->hash index into line with the new canonical chain: back from us until we meet it...
+			// The blooms of the groups each newly canonical block is in get its bloom OR'd in. (Those of blocks that leave the
+			// canonical chain are left in; they can only cause false positives.)
+			unsigned n = nd.number;
+			h256 h = newHash;
+			std::map<std::pair<unsigned, unsigned>, h256> groupBlooms;
+			for (; n && indexedHash(n) != h; h = details(h).parent, --n)
+			{
+				put(extrasBatch, toKey(h256(u256(n)), 3).ref(), h.ref());
+				h256 b = details(h).bloom;
+				for (unsigned l = 1; l <= c_bloomIndexLevels; ++l)
+				{
+					auto g = make_pair(l, n >> (c_bloomIndexLevelBits * l));
+					if (!groupBlooms.count(g))
+					{
+						std::string s = m_extrasDB->get(bloomIndexKey(g.first, g.second).ref());
+						groupBlooms[g] = s.size() == 32 ? h256((byte const*)s.data(), h256::ConstructFromPointer) : h256();
+					}
+					groupBlooms[g] |= b;
+				}
+			}
+			for (auto const& g: groupBlooms)
+				put(extrasBatch, bloomIndexKey(g.first.first, g.first.second).ref(), g.second.ref());
+			// ...and forget anything from the old one that was higher than us.
+			for (unsigned i = nd.number + 1, e = details(last).number; i <= e; ++i)
+			{
+				extrasBatch.del(toKey(h256(u256(i)), 3).ref());
+				++stats.keys;
+			}
 		}
+		m_db->write(blocksBatch, m_syncWrites);
+		m_extrasDB->write(extrasBatch, m_syncWrites);
+
+		// With the canonical chain settled, the states that have fallen out of the state DB's window can go.
+		if (best && _db.pruning() && nd.number > _db.pruning())
 		{
-			WriteGuard l(x_traces);
-			m_traces[newHash] = bt;
+			OverlayDB db = _db;
+			db.prune(nd.number - _db.pruning(), [&](unsigned _n) { return numberHash(_n); });
 		}
 
-		m_extrasDB->Put(m_writeOptions, toSlice(newHash), (ldb::Slice)eth::ref(m_details[newHash].rlp()));
-		m_extrasDB->Put(m_writeOptions, toSlice(bi.parentHash), (ldb::Slice)eth::ref(m_details[bi.parentHash].rlp()));
-		m_extrasDB->Put(m_writeOptions, toSlice(newHash, 1), (ldb::Slice)eth::ref(m_blooms[newHash].rlp()));
-		m_extrasDB->Put(m_writeOptions, toSlice(newHash, 2), (ldb::Slice)eth::ref(m_traces[newHash].rlp()));
-		m_db->Put(m_writeOptions, toSlice(newHash), (ldb::Slice)ref(_block));
+		if (best)
+		{
+			ret = treeRoute(last, newHash);
+			WriteGuard l(x_lastBlockHash);
+			m_lastBlockHash = newHash;
+		}
 
 #if ETH_PARANOIA
 		checkConsistency();
@@ -306,17 +367,12 @@ h256s BlockChain::import(bytes const& _block, OverlayDB const& _db)
 
 //	cnote << "Parent " << bi.parentHash << " has " << details(bi.parentHash).children.size() << " children.";
 
-	h256s ret;
-	// This might be the new best block...
-	h256 last = currentHash();
-	if (td > details(last).totalDifficulty)
 	{
-		ret = treeRoute(last, newHash);
-		{
-			WriteGuard l(x_lastBlockHash);
-			m_lastBlockHash = newHash;
-		}
-		m_extrasDB->Put(m_writeOptions, ldb::Slice("best"), ldb::Slice((char const*)&newHash, 32));
+		Guard l(x_lastImport);
+		m_lastImport = stats;
+	}
+	if (best)
+	{
 		clog(BlockChainNote) << "   Imported and best. Has" << (details(bi.parentHash).children.size() - 1) << "siblings. Route:";
 		for (auto r: ret)
 			clog(BlockChainNote) << r;
@@ -361,14 +417,30 @@ h256s BlockChain::treeRoute(h256 _from, h256 _to, h256* o_common) const
 	return ret;
 }
 
+void BlockChain::process()
+{
+	m_details.garbageCollect();
+	m_blooms.garbageCollect();
+	m_traces.garbageCollect();
+	m_blocks.garbageCollect();
+}
+
+void BlockChain::setCacheBudgets(size_t _details, size_t _blooms, size_t _traces, size_t _blocks)
+{
+	m_details.setBudget(_details);
+	m_blooms.setBudget(_blooms);
+	m_traces.setBudget(_traces);
+	m_blocks.setBudget(_blocks);
+}
+
 void BlockChain::checkConsistency()
 {
 	m_details.clear();
-	ldb::Iterator* it = m_db->NewIterator(m_readOptions);
-	for (it->SeekToFirst(); it->Valid(); it->Next())
-		if (it->key().size() == 32)
+	m_db->forEach(bytesConstRef(), [&](bytesConstRef _k, bytesConstRef)
+	{
+		if (_k.size() == 32)
 		{
-			h256 h((byte const*)it->key().data(), h256::ConstructFromPointer);
+			h256 h(_k.data(), h256::ConstructFromPointer);
 			auto dh = details(h);
 			auto p = dh.parent;
 			if (p != h256())
@@ -378,7 +450,8 @@ void BlockChain::checkConsistency()
 				assert(dp.number == dh.number - 1);
 			}
 		}
-	delete it;
+		return true;
+	});
 }
 
 bytes BlockChain::block(h256 _hash) const
@@ -386,24 +459,18 @@ bytes BlockChain::block(h256 _hash) const
 	if (_hash == m_genesisHash)
 		return m_genesisBlock;
 
-	{
-		ReadGuard l(x_cache);
-		auto it = m_cache.find(_hash);
-		if (it != m_cache.end())
-			return it->second;
-	}
-
-	string d;
-	m_db->Get(m_readOptions, ldb::Slice((char const*)&_hash, 32), &d);
+	bytes ret;
+	if (m_blocks.get(_hash, ret))
+		return ret;
 
-	WriteGuard l(x_cache);
-	m_cache[_hash].resize(d.size());
-	memcpy(m_cache[_hash].data(), d.data(), d.size());
+	string d = m_db->get(_hash.ref());
 
 	if (!d.size())
 		cwarn << "Couldn't find requested block:" << _hash;
 
-	return m_cache[_hash];
+	ret = asBytes(d);
+	m_blocks.insert(_hash, ret, ret.size());
+	return ret;
 }
 
 h256 BlockChain::numberHash(unsigned _n) const
@@ -411,6 +478,58 @@ h256 BlockChain::numberHash(unsigned _n) const
 	if (!_n)
 		return genesisHash();
 	h256 ret = currentHash();
-	for (; _n < details().number; ++_n, ret = details(ret).parent) {}
+	unsigned n = details(ret).number;
+	if (_n >= n)
+		return ret;
+	if (h256 h = indexedHash(_n))
+		return h;
+
+	// Not indexed (the DB predates the index) - walk back.
+	for (; _n < n; --n, ret = details(ret).parent) {}
 	return ret;
 }
+
+h256 BlockChain::levelBloom(unsigned _level, unsigned _index) const
+{
+	if (!_level)
+		return details(numberHash(_index)).bloom;
+	std::string s = m_extrasDB->get(bloomIndexKey(_level, _index).ref());
+	// A group with no entry hasn't been indexed (e.g. the chain predates the index) so must be assumed to match anything.
+	return s.size() == 32 ? h256((byte const*)s.data(), h256::ConstructFromPointer) : ~h256();
+}
+
+std::vector<unsigned> BlockChain::withBlockBloom(std::function<bool(h256 const&)> const& _matches, unsigned _earliest, unsigned _latest) const
+{
+	std::vector<unsigned> ret;
+	if (_earliest > _latest)
+		return ret;
+	unsigned topBits = c_bloomIndexLevelBits * c_bloomIndexLevels;
+	for (unsigned i = (_latest >> topBits) + 1; i-- > (_earliest >> topBits);)
+		withBlockBloom(_matches, _earliest, _latest, c_bloomIndexLevels, i, ret);
+	return ret;
+}
+
+void BlockChain::withBlockBloom(std::function<bool(h256 const&)> const& _matches, unsigned _earliest, unsigned _latest, unsigned _level, unsigned _index, std::vector<unsigned>& o_ret) const
+{
+	unsigned bits = c_bloomIndexLevelBits * _level;
+	unsigned first = _index << bits;
+	unsigned last = first + (1u << bits) - 1;
+	if (last < _earliest || first > _latest || !_matches(levelBloom(_level, _index)))
+		return;
+	if (!_level)
+		o_ret.push_back(_index);
+	else
+		for (unsigned i = 1u << c_bloomIndexLevelBits; i--;)
+			withBlockBloom(_matches, _earliest, _latest, _level - 1, (_index << c_bloomIndexLevelBits) + i, o_ret);
+}
+
+h256 BlockChain::bloomIndexKey(unsigned _level, unsigned _index)
+{
+	return toKey(h256((u256(_level) << 64) + _index), 4);
+}
+
+h256 BlockChain::indexedHash(unsigned _n) const
+{
+	std::string s = m_extrasDB->get(toKey(h256(u256(_n)), 3).ref());
+	return s.size() == 32 ? h256((byte const*)s.data(), h256::ConstructFromPointer) : h256();
+}
@@ -22,22 +22,28 @@
 #pragma once
 
 #include <mutex>
+#include <functional>
 #include <libethential/Log.h>
 #include <libethcore/CommonEth.h>
 #include <libethcore/BlockInfo.h>
+#include <libethcore/OverlayDB.h>
 #include "Guards.h"
 #include "BlockDetails.h"
+#include "BlockCache.h"
 #include "AddressState.h"
 #include "BlockQueue.h"
-namespace ldb = leveldb;
 
 namespace eth
 {
 
 static const h256s NullH256s;
 
+/// The bloom index has this many levels above the blocks themselves...
+static const unsigned c_bloomIndexLevels = 3;
+/// ...each grouping 2 ** this many items of the level below: 16, 256 and 4096 blocks.
+static const unsigned c_bloomIndexLevelBits = 4;
+
 class State;
-class OverlayDB;
 
 class AlreadyHaveBlock: public std::exception {};
 class UnknownParent: public std::exception {};
@@ -49,12 +55,12 @@ struct BlockChainNote: public LogChannel { static const char* name() { return "=
 // TODO: Move all this Genesis stuff into Genesis.h/.cpp
 std::map<Address, AddressState> const& genesisState();
 
-ldb::Slice toSlice(h256 _h, unsigned _sub = 0);
+/// @returns the key in the extras DB of item @a _sub of block @a _h (0: details, 1: blooms, 2: traces).
+h256 toKey(h256 _h, unsigned _sub = 0);
 
 /**
  * @brief Implements the blockchain database. All data this gives is disk-backed.
  * @threadsafe
- * @todo Make not memory hog (should actually act as a cache and deallocate old entries).
  */
 class BlockChain
 {
@@ -64,7 +70,7 @@ public:
 	~BlockChain();
 
 	/// (Potentially) renders invalid existing bytesConstRef returned by lastBlock.
-	/// To be called from main loop every 100ms or so.
+	/// To be called from main loop every 100ms or so. Trims the caches back to their budgets.
 	void process();
 
 	/// Sync the chain with any incoming blocks. All blocks should, if processed in order
@@ -78,16 +84,37 @@ public:
 	/// @returns the block hashes of any blocks that came into/went out of the canonical block chain.
 	h256s import(bytes const& _block, OverlayDB const& _stateDB);
 
+	/// Set whether block imports wait for their writes to reach the disk (true) or return once the OS has them (false, the default).
+	/// @note The state DB's writes are governed separately; see OverlayDB::setSyncWrites().
+	void setSyncWrites(bool _sync) { m_syncWrites = _sync; }
+	/// @returns the number of keys and bytes written to disk (state, blocks and extras) by the last import().
+	DBWriteStats lastImport() const { Guard l(x_lastImport); return m_lastImport; }
+
+	/// @returns the numbers of the blocks on the canonical chain, from @a _latest down to @a _earliest (inclusive), whose
+	/// blooms satisfy @a _matches. @a _matches must be monotonic (i.e. if it holds for a bloom then it holds for any superset
+	/// of it) since it is used to skip whole groups of blocks by their combined blooms.
+	std::vector<unsigned> withBlockBloom(std::function<bool(h256 const&)> const& _matches, unsigned _earliest, unsigned _latest) const;
+	/// @returns the OR of the blooms of the canonical blocks numbered from _index << (4 * _level) for 16 ** _level blocks.
+	h256 levelBloom(unsigned _level, unsigned _index) const;
+
+	/// Set the memory budgets, in bytes, of the caches of block details, blooms, traces and block bodies.
+	void setCacheBudgets(size_t _details, size_t _blooms, size_t _traces, size_t _blocks);
+	/// @returns the occupancy of the caches of block details, blooms, traces and block bodies.
+	CacheStats detailsCacheStats() const { return m_details.stats(); }
+	CacheStats bloomsCacheStats() const { return m_blooms.stats(); }
+	CacheStats tracesCacheStats() const { return m_traces.stats(); }
+	CacheStats blocksCacheStats() const { return m_blocks.stats(); }
+
 	/// Get the familial details concerning a block (or the most recent mined if none given). Thread-safe.
-	BlockDetails details(h256 _hash) const { return queryExtras<BlockDetails, 0>(_hash, m_details, x_details, NullBlockDetails); }
+	BlockDetails details(h256 _hash) const { return queryExtras<BlockDetails, 0>(_hash, m_details, NullBlockDetails); }
 	BlockDetails details() const { return details(currentHash()); }
 
 	/// Get the transactions' bloom filters of a block (or the most recent mined if none given). Thread-safe.
-	BlockBlooms blooms(h256 _hash) const { return queryExtras<BlockBlooms, 1>(_hash, m_blooms, x_blooms, NullBlockBlooms); }
+	BlockBlooms blooms(h256 _hash) const { return queryExtras<BlockBlooms, 1>(_hash, m_blooms, NullBlockBlooms); }
 	BlockBlooms blooms() const { return blooms(currentHash()); }
 
 	/// Get the transactions' trace manifests of a block (or the most recent mined if none given). Thread-safe.
-	BlockTraces traces(h256 _hash) const { return queryExtras<BlockTraces, 2>(_hash, m_traces, x_traces, NullBlockTraces); }
+	BlockTraces traces(h256 _hash) const { return queryExtras<BlockTraces, 2>(_hash, m_traces, NullBlockTraces); }
 	BlockTraces traces() const { return traces(currentHash()); }
 
 	/// Get a block (RLP format) for the given hash (or the most recent mined if none given). Thread-safe.
@@ -104,7 +131,8 @@ public:
 	/// Get the hash of the genesis block. Thread-safe.
 	h256 genesisHash() const { return m_genesisHash; }
 
-	/// Get the hash of a block of a given number. Slow; try not to use it too much.
+	/// Get the hash of the block of a given number on the canonical chain (or the most recent if the number is beyond it).
+	/// Takes a single DB read, through the number->hash index kept in the extras DB.
 	h256 numberHash(unsigned _n) const;
 
 	/// @returns the genesis block header.
@@ -131,43 +159,41 @@ public:
 	h256s treeRoute(h256 _from, h256 _to, h256* o_common = nullptr) const;
 
 private:
-	template<class T, unsigned N> T queryExtras(h256 _h, std::map<h256, T>& _m, boost::shared_mutex& _x, T const& _n) const
+	template<class T, unsigned N> T queryExtras(h256 _h, BlockCache<T>& _m, T const& _n) const
 	{
-		{
-			ReadGuard l(_x);
-			auto it = _m.find(_h);
-			if (it != _m.end())
-				return it->second;
-		}
+		T ret;
+		if (_m.get(_h, ret))
+			return ret;
 
-		std::string s;
-		m_extrasDB->Get(m_readOptions, toSlice(_h, N), &s);
+		std::string s = m_extrasDB->get(toKey(_h, N).ref());
 		if (s.empty())
 		{
 	//			cout << "Not found in DB: " << _h << endl;
 			return _n;
 		}
 
-		WriteGuard l(_x);
-		auto ret = _m.insert(std::make_pair(_h, T(RLP(s))));
-		return ret.first->second;
+		ret = T(RLP(s));
+		_m.insert(_h, ret, s.size());
+		return ret;
 	}
 
 	void checkConsistency();
 
-	/// The caches of the disk DB and their locks.
-	mutable boost::shared_mutex x_details;
-	mutable BlockDetailsHash m_details;
-	mutable boost::shared_mutex x_blooms;
-	mutable BlockBloomsHash m_blooms;
-	mutable boost::shared_mutex x_traces;
-	mutable BlockTracesHash m_traces;
-	mutable boost::shared_mutex x_cache;
-	mutable std::map<h256, bytes> m_cache;
+	/// @returns the hash the number->hash index has for block number @a _n, or the null hash if it has none.
+	h256 indexedHash(unsigned _n) const;
+
+	void withBlockBloom(std::function<bool(h256 const&)> const& _matches, unsigned _earliest, unsigned _latest, unsigned _level, unsigned _index, std::vector<unsigned>& o_ret) const;
+	static h256 bloomIndexKey(unsigned _level, unsigned _index);
+
+	/// The caches of the disk DB; each is threadsafe and bounded.
+	mutable BlockCache<BlockDetails> m_details;
+	mutable BlockCache<BlockBlooms> m_blooms;
+	mutable BlockCache<BlockTraces> m_traces;
+	mutable BlockCache<bytes> m_blocks;
 
 	/// The disk DBs. Thread-safe, so no need for locks.
-	ldb::DB* m_db;
-	ldb::DB* m_extrasDB;
+	std::unique_ptr<KeyValueDB> m_db;
+	std::unique_ptr<KeyValueDB> m_extrasDB;
 
 	/// Hash of the last (valid) block on the longest chain.
 	mutable boost::shared_mutex x_lastBlockHash;
@@ -177,8 +203,9 @@ private:
 	h256 m_genesisHash;
 	bytes m_genesisBlock;
 
-	ldb::ReadOptions m_readOptions;
-	ldb::WriteOptions m_writeOptions;
+	bool m_syncWrites = false;
+	mutable std::mutex x_lastImport;
+	DBWriteStats m_lastImport;		///< What the last import() wrote to disk.
 
 	friend std::ostream& operator<<(std::ostream& _out, BlockChain const& _bc);
 
@@ -24,7 +24,6 @@
 #include <libethential/Log.h>
 #include <libethential/RLP.h>
 #include "Manifest.h"
-namespace ldb = leveldb;
 
 namespace eth
 {
@@ -65,10 +64,6 @@ struct BlockTraces
 };
 
 
-typedef std::map<h256, BlockDetails> BlockDetailsHash;
-typedef std::map<h256, BlockBlooms> BlockBloomsHash;
-typedef std::map<h256, BlockTraces> BlockTracesHash;
-
 static const BlockDetails NullBlockDetails;
 static const BlockBlooms NullBlockBlooms;
 static const BlockTraces NullBlockTraces;
@@ -27,6 +27,7 @@
 #include <libethential/Common.h>
 #include "Defaults.h"
 #include "PeerServer.h"
+#include "StateDump.h"
 using namespace std;
 using namespace eth;
 
@@ -67,6 +68,7 @@ Client::Client(std::string const& _clientVersion, Address _us, std::string const
 	m_vc(_dbPath),
 	m_bc(_dbPath, !m_vc.ok() || _forceClean),
 	m_stateDB(State::openDB(_dbPath, !m_vc.ok() || _forceClean)),
+	m_stateIndex(make_shared<StateIndex>(m_stateDB)),
 	m_preMine(_us, m_stateDB),
 	m_postMine(_us, m_stateDB),
 	m_workState(Deleted)
@@ -74,6 +76,8 @@ Client::Client(std::string const& _clientVersion, Address _us, std::string const
 	if (_dbPath.size())
 		Defaults::setDBPath(_dbPath);
 	m_vc.setOk();
+	m_preMine.setIndex(m_stateIndex);
+	m_postMine.setIndex(m_stateIndex);
 	work(true);
 }
 
@@ -409,6 +413,9 @@ void Client::work(bool _justQueue)
 		OverlayDB db = m_stateDB;
 		m_lock.unlock();
 		h256s newBlocks = m_bc.sync(m_bq, db, 100);
+		m_bc.process();
+		// Off the import path: moves the index along the blocks just imported, or starts it rebuilding in the background.
+		m_stateIndex->moveTo(m_bc);
 		if (newBlocks.size())
 		{
 			for (auto i: newBlocks)
@@ -476,7 +483,11 @@ State Client::asOf(int _h) const
 	else if (_h == -1)
 		return m_preMine;
 	else
-		return State(m_stateDB, m_bc, m_bc.numberHash(numberOf(_h)));
+	{
+		State ret(m_stateDB, m_bc, m_bc.numberHash(numberOf(_h)));
+		ret.setIndex(m_stateIndex);
+		return ret;
+	}
 }
 
 std::vector<Address> Client::addresses(int _block) const
@@ -488,6 +499,13 @@ std::vector<Address> Client::addresses(int _block) const
 	return ret;
 }
 
+unsigned Client::exportState(std::ostream& _out, int _block) const
+{
+	ClientGuard l(this);
+	h256 h = m_bc.numberHash(numberOf(_block ? _block : -1));
+	return StateDump::write(m_stateDB, BlockInfo(m_bc.block(h)), _out);
+}
+
 u256 Client::balanceAt(Address _a, int _block) const
 {
 	ClientGuard l(this);
@@ -655,58 +673,50 @@ PastMessages Client::transactions(TransactionFilter const& _f) const
 	}
 
 #if ETH_DEBUG
-	unsigned skipped = 0;
 	unsigned falsePos = 0;
 #endif
-	auto h = m_bc.numberHash(begin);
-	unsigned n = begin;
-	for (; ret.size() != m && n != end; n--, h = m_bc.details(h).parent)
+	// Only blocks whose blooms (and those of the groups they're in) might match are visited.
+	auto candidates = end < begin ? m_bc.withBlockBloom([&](h256 const& b){ return _f.matches(b); }, end + 1, begin) : vector<unsigned>();
+	for (unsigned n: candidates)
 	{
-		auto d = m_bc.details(h);
+		if (ret.size() == m)
+			break;
+		auto h = m_bc.numberHash(n);
 #if ETH_DEBUG
 		int total = 0;
 #endif
-		if (_f.matches(d.bloom))
-		{
-			// Might have a block that contains a transaction that contains a matching message.
-			auto bs = m_bc.blooms(h).blooms;
-			Manifests ms;
-			for (unsigned i = 0; i < bs.size(); ++i)
-				if (_f.matches(bs[i]))
+		// Might have a block that contains a transaction that contains a matching message.
+		auto bs = m_bc.blooms(h).blooms;
+		Manifests ms;
+		for (unsigned i = 0; i < bs.size(); ++i)
+			if (_f.matches(bs[i]))
+			{
+				// Might have a transaction that contains a matching message.
+				if (ms.empty())
+					ms = m_bc.traces(h).traces;
+				Manifest const& changes = ms[i];
+				PastMessages pm = _f.matches(changes, i);
+				if (pm.size())
 				{
-					// Might have a transaction that contains a matching message.
-					if (ms.empty())
-						ms = m_bc.traces(h).traces;
-					Manifest const& changes = ms[i];
-					PastMessages pm = _f.matches(changes, i);
-					if (pm.size())
-					{
 #if ETH_DEBUG
-						total += pm.size();
+					total += pm.size();
 #endif
-						auto ts = BlockInfo(m_bc.block(h)).timestamp;
-						for (unsigned j = 0; j < pm.size() && ret.size() != m; ++j)
-							if (s)
-								s--;
-							else
-								// Have a transaction that contains a matching message.
-								ret.insert(ret.begin(), pm[j].polish(h, ts, n));
-					}
+					auto ts = BlockInfo(m_bc.block(h)).timestamp;
+					for (unsigned j = 0; j < pm.size() && ret.size() != m; ++j)
+						if (s)
+							s--;
+						else
+							// Have a transaction that contains a matching message.
+							ret.insert(ret.begin(), pm[j].polish(h, ts, n));
 				}
+			}
 #if ETH_DEBUG
-			if (!total)
-				falsePos++;
-		}
-		else
-			skipped++;
-#else
-		}
+		if (!total)
+			falsePos++;
 #endif
-		if (n == end)
-			break;
 	}
 #if ETH_DEBUG
-//	cdebug << (begin - n) << "searched; " << skipped << "skipped; " << falsePos << "false +ves";
+//	cdebug << (begin - end) << "in range; " << candidates.size() << "candidates; " << falsePos << "false +ves";
 #endif
 	return ret;
 }
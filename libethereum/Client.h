@@ -234,6 +234,10 @@ public:
 	std::vector<Address> addresses() const { return addresses(m_default); }
 	std::vector<Address> addresses(int _block) const;
 
+	/// Write the state as of block @a _block (as for balanceAt(), though the pending state can't be written) to @a _out
+	/// as a StateDump. @returns the number of accounts written.
+	unsigned exportState(std::ostream& _out, int _block = -1) const;
+
 	// Misc stuff:
 
 	void setClientVersion(std::string const& _name) { m_clientVersion = _name; }
@@ -314,6 +318,7 @@ private:
 	TransactionQueue m_tq;				///< Maintains a list of incoming transactions not yet in a block on the blockchain.
 	BlockQueue m_bq;					///< Maintains a list of incoming blocks not yet on the blockchain (to be imported).
 	OverlayDB m_stateDB;				///< Acts as the central point for the state database, so multiple States can share it.
+	std::shared_ptr<StateIndex> m_stateIndex;	///< The flat index of the head's state, which our States read through.
 	State m_preMine;					///< The present state of the client.
 	State m_postMine;					///< The state of the client which we're mining (i.e. it'll have all the rewards added).
 
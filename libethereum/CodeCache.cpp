@@ -0,0 +1,37 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeCache.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "CodeCache.h"
+using namespace std;
+using namespace eth;
+
+SharedCode CodeCache::insert(h256 const& _h, bytesConstRef _code)
+{
+	SharedCode ret = make_shared<bytes const>(_code.toBytes());
+	get().insert(_h, ret, &ret);
+	return ret;
+}
+
+ByteBoundedLRU<h256, SharedCode>& CodeCache::get()
+{
+	static ByteBoundedLRU<h256, SharedCode> s_this(c_defaultCodeCacheSize);
+	return s_this;
+}
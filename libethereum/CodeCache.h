@@ -0,0 +1,61 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeCache.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <memory>
+#include <libethential/Common.h>
+#include <libethential/FixedHash.h>
+#include <libethcore/ByteBoundedLRU.h>
+
+namespace eth
+{
+
+/// Code, which never changes once written, as shared between all that use it.
+using SharedCode = std::shared_ptr<bytes const>;
+
+/// Default bound, in bytes of code, on the process-wide code cache.
+static const size_t c_defaultCodeCacheSize = 16 * 1024 * 1024;
+
+/**
+ * @brief The process-wide cache of contract code by hash, bounded by the total size of the code and evicting the least
+ * recently used. Each piece of code is held once and handed out as a shared reference, so every account, copy of a
+ * State and VM execution using it refers to the same buffer. Eviction only drops the cache's own reference; whoever
+ * still holds the code keeps it.
+ * @threadsafe
+ */
+class CodeCache
+{
+public:
+	/// @returns the code with hash @a _h, or null if it's not cached.
+	static SharedCode lookup(h256 const& _h) { return get().lookup(_h); }
+	/// Note @a _code, whose hash is @a _h, as the most recently used. @returns the shared reference to it; if the code
+	/// was already cached, that's the one already handed out.
+	static SharedCode insert(h256 const& _h, bytesConstRef _code);
+
+	static void setCapacity(size_t _bytes) { get().setCapacity(_bytes); }
+	static CacheStats stats() { return get().stats(); }
+
+private:
+	static ByteBoundedLRU<h256, SharedCode>& get();
+};
+
+}
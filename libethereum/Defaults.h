@@ -22,6 +22,7 @@
 #pragma once
 
 #include <libethential/Common.h>
+#include <libethcore/KeyValueDB.h>
 
 namespace eth
 {
@@ -37,9 +38,17 @@ public:
 	static Defaults* get() { if (!s_this) s_this = new Defaults; return s_this; }
 	static void setDBPath(std::string const& _dbPath) { get()->m_dbPath = _dbPath; }
 	static std::string const& dbPath() { return get()->m_dbPath; }
+	/// Set how many of the most recent blocks' states the state DB keeps; 0 (the default) keeps them all.
+	static void setPruning(unsigned _history) { get()->m_pruning = _history; }
+	static unsigned pruning() { return get()->m_pruning; }
+	/// Set the storage engine of the DB @a _name ("state", "blocks" or "details"); each is LevelDB unless set otherwise.
+	static void setDBEngine(std::string const& _name, DBEngine _engine) { get()->m_dbEngines[_name] = _engine; }
+	static DBEngine dbEngine(std::string const& _name) { auto const& e = get()->m_dbEngines; return e.count(_name) ? e.at(_name) : DBEngine::LevelDB; }
 
 private:
 	std::string m_dbPath;
+	unsigned m_pruning = 0;
+	std::map<std::string, DBEngine> m_dbEngines;
 
 	static Defaults* s_this;
 };
@@ -32,7 +32,6 @@ Executive::~Executive()
 {
 	// TODO: Make safe.
 	delete m_ext;
-	delete m_vm;
 }
 
 u256 Executive::gasUsed() const
@@ -40,12 +39,14 @@ u256 Executive::gasUsed() const
 	return m_t.gas - m_endGas;
 }
 
-bool Executive::setup(bytesConstRef _rlp)
+bool Executive::setup(Transaction const& _t)
 {
 	// Entry point for a user-executed transaction.
-	m_t = Transaction(_rlp);
+	m_t = _t;
 
 	m_sender = m_t.sender();
+	// Bring in the sender and recipient together so that the top of the state trie is read only once for both.
+	m_s.ensureCached(m_t.isCreation() ? Addresses{m_sender} : Addresses{m_sender, m_t.receiveAddress});
 
 	// Avoid invalid transactions.
 	auto nonceReq = m_s.transactionsFrom(m_sender);
@@ -115,9 +116,10 @@ bool Executive::call(Address _receiveAddress, Address _senderAddress, u256 _valu
 
 	if (m_s.addressHasCode(_receiveAddress))
 	{
-		m_vm = new VM(_gas);
-		bytes const& c = m_s.code(_receiveAddress);
-		m_ext = new ExtVM(m_s, _receiveAddress, _senderAddress, _originAddress, _value, _gasPrice, _data, &c, m_ms);
+		m_vm = pooledVM(_gas);
+		m_code = m_s.sharedCode(_receiveAddress);
+		m_ext = new ExtVM(m_s, _receiveAddress, _senderAddress, _originAddress, _value, _gasPrice, _data, m_code ? bytesConstRef(m_code.get()) : bytesConstRef(), m_ms);
+		m_ext->codeHash = m_s.codeHash(_receiveAddress);
 	}
 	else
 		m_endGas = _gas;
@@ -133,10 +135,10 @@ bool Executive::create(Address _sender, u256 _endowment, u256 _gasPrice, u256 _g
 		m_newAddress = (u160)m_newAddress + 1;
 
 	// Set up new account...
-	m_s.m_cache[m_newAddress] = AddressState(0, _endowment, h256(), h256());
+	m_s.journalAccount(m_newAddress) = AddressState(0, _endowment, h256(), h256());
 
 	// Execute _init.
-	m_vm = new VM(_gas);
+	m_vm = pooledVM(_gas);
 	m_ext = new ExtVM(m_s, m_newAddress, _sender, _origin, _endowment, _gasPrice, bytesConstRef(), _init, m_ms);
 	return _init.empty();
 }
@@ -145,14 +147,18 @@ OnOpFunc Executive::simpleTrace()
 {
 	return [](uint64_t steps, Instruction inst, unsigned newMemSize, bigint gasCost, void* voidVM, void const* voidExt)
 	{
-		ExtVM const& ext = *(ExtVM const*)voidExt;
+		// None of it would be logged; don't go to the trouble of writing out the stack, memory and storage.
+		if (g_logVerbosity < VMTraceChannel::verbosity)
+			return;
+
+		ExtVM const& ext = static_cast<ExtVM const&>(*static_cast<ExtVMFace const*>(voidExt));
 		VM& vm = *(VM*)voidVM;
 
 		ostringstream o;
 		o << endl << "    STACK" << endl;
 		for (auto i: vm.stack())
 			o << (h256)i << endl;
-		o << "    MEMORY" << endl << memDump(vm.memory());
+		o << "    MEMORY" << endl << memDump(vm.memory().toBytes());
 		o << "    STORAGE" << endl;
 		for (auto const& i: ext.state().storage(ext.myAddress))
 			o << showbase << hex << i.first << ": " << i.second << endl;
@@ -200,6 +206,7 @@ bool Executive::go(OnOpFunc const& _onOp)
 			// Explicitly delete a newly created address - this will still be in the reverted state.
 			if (m_newAddress)
 			{
+				m_s.journalAccount(m_newAddress);
 				m_s.m_cache.erase(m_newAddress);
 				m_newAddress = Address();
 			}
@@ -216,8 +223,11 @@ u256 Executive::gas() const
 void Executive::finalize()
 {
 	if (m_t.isCreation() && m_newAddress && m_out.size())
+	{
 		// non-reverted creation - put code in place.
+		m_s.m_journal.push_back(JournalEntry(JournalEntry::Code, m_newAddress));
 		m_s.m_cache[m_newAddress].setCode(m_out);
+	}
 
 //	cnote << "Refunding" << formatBalance(m_endGas * m_ext->gasPrice) << "to origin (=" << m_endGas << "*" << formatBalance(m_ext->gasPrice) << ")";
 	m_s.addBalance(m_sender, m_endGas * m_t.gasPrice);
@@ -237,5 +247,5 @@ void Executive::finalize()
 	// Suicides...
 	if (m_ext)
 		for (auto a: m_ext->suicides)
-			m_s.m_cache[a].kill();
+			m_s.journalAccount(a).kill();
 }
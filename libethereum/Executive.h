@@ -26,13 +26,14 @@
 #include <libevmface/Instruction.h>
 #include <libethcore/CommonEth.h>
 #include <libevm/ExtVMFace.h>
+#include <libevm/VM.h>
 #include "Transaction.h"
 #include "Manifest.h"
+#include "CodeCache.h"
 
 namespace eth
 {
 
-class VM;
 class ExtVM;
 class State;
 
@@ -44,7 +45,8 @@ public:
 	Executive(State& _s, Manifest* o_ms = nullptr): m_s(_s), m_ms(o_ms) {}
 	~Executive();
 
-	bool setup(bytesConstRef _transaction);
+	bool setup(bytesConstRef _transaction) { return setup(Transaction(_transaction)); }
+	bool setup(Transaction const& _transaction);
 	bool create(Address _txSender, u256 _endowment, u256 _gasPrice, u256 _gas, bytesConstRef _code, Address _originAddress);
 	bool call(Address _myAddress, Address _txSender, u256 _txValue, u256 _gasPrice, bytesConstRef _txData, u256 _gas, Address _originAddress);
 	bool go(OnOpFunc const& _onOp = OnOpFunc());
@@ -67,7 +69,8 @@ public:
 private:
 	State& m_s;
 	ExtVM* m_ext = nullptr;	// TODO: make safe.
-	VM* m_vm = nullptr;
+	PooledVM m_vm;
+	SharedCode m_code;		///< The code being run by a call, kept alive for as long as m_ext refers to it.
 	Manifest* m_ms = nullptr;
 	bytesConstRef m_out;
 	Address m_newAddress;
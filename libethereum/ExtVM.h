@@ -38,8 +38,9 @@ class ExtVM: public ExtVMFace
 public:
 	/// Full constructor.
 	ExtVM(State& _s, Address _myAddress, Address _caller, Address _origin, u256 _value, u256 _gasPrice, bytesConstRef _data, bytesConstRef _code, Manifest* o_ms, unsigned _level = 0):
-		ExtVMFace(_myAddress, _caller, _origin, _value, _gasPrice, _data, _code, _s.m_previousBlock, _s.m_currentBlock), level(_level), m_s(_s), m_origCache(_s.m_cache), m_ms(o_ms)
+		ExtVMFace(_myAddress, _caller, _origin, _value, _gasPrice, _data, _code, _s.m_previousBlock, _s.m_currentBlock), m_s(_s), m_savepoint(_s.savepoint()), m_ms(o_ms)
 	{
+		level = _level;
 		m_s.ensureCached(_myAddress, true, true);
 	}
 
@@ -91,16 +92,13 @@ public:
 
 	/// Revert any changes made (by any of the other calls).
 	/// @TODO check call site for the parent manifest being discarded.
-	void revert() { if (m_ms) *m_ms = Manifest(); m_s.m_cache = m_origCache; }
+	void revert() { if (m_ms) *m_ms = Manifest(); m_s.rollback(m_savepoint); }
 
 	State& state() const { return m_s; }
 
-	/// @note not a part of the main API; just for use by tracing/debug stuff.
-	unsigned level = 0;
-
 private:
 	State& m_s;										///< A reference to the base state.
-	std::map<Address, AddressState> m_origCache;	///< The cache of the address states (i.e. the externalities) as-was prior to the execution.
+	unsigned m_savepoint;							///< The journal savepoint of the address states (i.e. the externalities) as-was prior to the execution.
 	Manifest* m_ms;
 };
 
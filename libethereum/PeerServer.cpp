@@ -418,11 +418,11 @@ void PeerServer::maintainTransactions(TransactionQueue& _tq, h256 _currentHash)
 {
 	bool resendAll = (_currentHash != m_latestBlockSent);
 
-	for (auto it = m_incomingTransactions.begin(); it != m_incomingTransactions.end(); ++it)
-		if (_tq.import(&*it))
-		{}//ret = true;		// just putting a transaction in the queue isn't enough to change the state - it might have an invalid nonce...
-		else
-			m_transactionsSent.insert(sha3(*it));	// if we already had the transaction, then don't bother sending it on.
+	// just putting a transaction in the queue isn't enough to change the state - it might have an invalid nonce...
+	h256s ignored;
+	_tq.import(m_incomingTransactions, &ignored);
+	for (auto const& h: ignored)
+		m_transactionsSent.insert(h);	// if we already had the transaction, then don't bother sending it on.
 	m_incomingTransactions.clear();
 
 	// Send any new transactions.
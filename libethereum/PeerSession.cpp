@@ -295,7 +295,11 @@ bool PeerSession::interpret(RLP const& _r)
 				// append blocks
 				uint n = latestNumber;
 				// seek back (occurs when count is limited by baseCount)
-				for (; n > startNumber; n--, h = m_server->m_chain->details(h).parent) {}
+				if (n > startNumber)
+				{
+					n = startNumber;
+					h = m_server->m_chain->numberHash(n);
+				}
 				for (uint i = 0; i < count; ++i, --n, h = m_server->m_chain->details(h).parent)
 				{
 					if (h == parent || n == endNumber)
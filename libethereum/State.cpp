@@ -24,6 +24,7 @@
 #include <boost/filesystem.hpp>
 #include <time.h>
 #include <random>
+#include <queue>
 #include <secp256k1/secp256k1.h>
 #include <libevmface/Instruction.h>
 #include <libethcore/Exceptions.h>
@@ -48,12 +49,10 @@ OverlayDB State::openDB(std::string _path, bool _killExisting)
 	if (_killExisting)
 		boost::filesystem::remove_all(_path + "/state");
 
-	ldb::Options o;
-	o.create_if_missing = true;
-	ldb::DB* db = nullptr;
-	ldb::DB::Open(o, _path + "/state", &db);
+	OverlayDB ret(KeyValueDB::open(Defaults::dbEngine("state"), _path + "/state").release());
 	cnote << "Opened state DB.";
-	return OverlayDB(db);
+	ret.setPruning(Defaults::pruning());
+	return ret;
 }
 
 State::State(Address _coinbaseAddress, OverlayDB const& _db):
@@ -113,6 +112,10 @@ State::State(State const& _s):
 	m_transactions(_s.m_transactions),
 	m_transactionSet(_s.m_transactionSet),
 	m_cache(_s.m_cache),
+	m_journal(_s.m_journal),
+	m_changes(_s.m_changes),
+	m_indexBase(_s.m_indexBase),
+	m_index(_s.m_index),
 	m_previousBlock(_s.m_previousBlock),
 	m_currentBlock(_s.m_currentBlock),
 	m_ourAddress(_s.m_ourAddress),
@@ -144,6 +147,10 @@ State& State::operator=(State const& _s)
 	m_transactions = _s.m_transactions;
 	m_transactionSet = _s.m_transactionSet;
 	m_cache = _s.m_cache;
+	m_journal = _s.m_journal;
+	m_changes = _s.m_changes;
+	m_indexBase = _s.m_indexBase;
+	m_index = _s.m_index;
 	m_previousBlock = _s.m_previousBlock;
 	m_currentBlock = _s.m_currentBlock;
 	m_ourAddress = _s.m_ourAddress;
@@ -268,6 +275,13 @@ StateDiff State::diff(State const& _c) const
 	return ret;
 }
 
+static AddressState accountFromTrie(RLP const& _state)
+{
+	if (_state.isNull())
+		return AddressState(0, 0, h256(), EmptySHA3);
+	return AddressState(_state[0].toInt<u256>(), _state[1].toInt<u256>(), _state[2].toHash<h256>(), _state[3].toHash<h256>());
+}
+
 void State::ensureCached(Address _a, bool _requireCode, bool _forceCreate) const
 {
 	ensureCached(m_cache, _a, _requireCode, _forceCreate);
@@ -279,26 +293,122 @@ void State::ensureCached(std::map<Address, AddressState>& _cache, Address _a, bo
 	if (it == _cache.end())
 	{
 		// populate basic info.
-		string stateBack = m_state.at(_a);
+		string stateBack = committedAccount(_a);
 		if (stateBack.empty() && !_forceCreate)
 			return;
-		RLP state(stateBack);
-		AddressState s;
-		if (state.isNull())
-			s = AddressState(0, 0, h256(), EmptySHA3);
-		else
-			s = AddressState(state[0].toInt<u256>(), state[1].toInt<u256>(), state[2].toHash<h256>(), state[3].toHash<h256>());
 		bool ok;
-		tie(it, ok) = _cache.insert(make_pair(_a, s));
+		tie(it, ok) = _cache.insert(make_pair(_a, accountFromTrie(RLP(stateBack))));
+		if (stateBack.empty() && &_cache == &m_cache)
+			m_journal.push_back(JournalEntry(_a, nullptr));
 	}
 	if (_requireCode && it != _cache.end() && !it->second.isFreshCode() && !it->second.codeCacheValid())
-		it->second.noteCode(it->second.codeHash() == EmptySHA3 ? bytesConstRef() : bytesConstRef(m_db.lookup(it->second.codeHash())));
+	{
+		// Code is shared by all that use it; go to the DB only if nobody else has it. What the DB gives is shared only if
+		// it's the code asked for: if it's missing, the account's code stays unloaded, to be looked for again next time.
+		h256 h = it->second.codeHash();
+		SharedCode c = CodeCache::lookup(h);
+		if (!c)
+		{
+			string s = m_db.lookup(h);
+			if (sha3(s) == h)
+				c = CodeCache::insert(h, bytesConstRef(s));
+		}
+		if (c)
+			it->second.noteCode(c);
+	}
+}
+
+void State::ensureCached(Addresses const& _as) const
+{
+	Addresses todo;
+	for (auto const& a: _as)
+		if (!m_cache.count(a))
+		{
+			string s;
+			if (m_changes.changed(a) || !m_index || !m_index->account(m_indexBase, a, s))
+				todo.push_back(a);
+			else if (!s.empty())
+				m_cache.insert(make_pair(a, accountFromTrie(RLP(s))));
+		}
+	sort(todo.begin(), todo.end());
+	todo.erase(unique(todo.begin(), todo.end()), todo.end());
+
+	auto states = m_state.atMany(todo);
+	for (unsigned i = 0; i < todo.size(); ++i)
+		if (!states[i].empty())
+			m_cache.insert(make_pair(todo[i], accountFromTrie(RLP(states[i]))));
+}
+
+string State::committedAccount(Address _a) const
+{
+	string ret;
+	if (m_changes.changed(_a) || !m_index || !m_index->account(m_indexBase, _a, ret))
+		ret = m_state.at(_a);
+	return ret;
 }
 
 void State::commit()
 {
+	// Note what's about to change in the trie, for the state index.
+	for (auto const& i: m_journal)
+	{
+		m_changes.accounts.insert(i.address);
+		if (i.kind == JournalEntry::Storage)
+			m_changes.storage[i.address].insert(i.key);
+		else if (i.kind == JournalEntry::Account && i.account && i.account->baseRoot())
+			m_changes.wiped.insert(i.address);
+	}
+	for (auto const& i: m_cache)
+		if (!i.second.isAlive())
+			m_changes.wiped.insert(i.first);
+
 	eth::commit(m_cache, m_db, m_state);
-	m_cache.clear();
+	clearCache();
+}
+
+AddressState& State::journalAccount(Address _a)
+{
+	auto it = m_cache.find(_a);
+	if (it == m_cache.end())
+	{
+		m_journal.push_back(JournalEntry(_a, nullptr));
+		return m_cache[_a];
+	}
+	m_journal.push_back(JournalEntry(_a, make_shared<AddressState>(it->second)));
+	return it->second;
+}
+
+void State::rollback(unsigned _savepoint)
+{
+	while (m_journal.size() > _savepoint)
+	{
+		JournalEntry const& e = m_journal.back();
+		switch (e.kind)
+		{
+		case JournalEntry::Account:
+			if (e.account)
+				m_cache[e.address] = *e.account;
+			else
+				m_cache.erase(e.address);
+			break;
+		case JournalEntry::Balance:
+			m_cache[e.address].balance() = e.value;
+			break;
+		case JournalEntry::Nonce:
+			m_cache[e.address].nonce() = e.value;
+			break;
+		case JournalEntry::Storage:
+			if (e.existed)
+				m_cache[e.address].setStorage(e.key, e.value);
+			else
+				m_cache[e.address].uncacheStorage(e.key);
+			break;
+		case JournalEntry::Code:
+			m_cache[e.address].setCode(bytesConstRef());
+			break;
+		}
+		m_journal.pop_back();
+	}
 }
 
 bool State::sync(BlockChain const& _bc)
@@ -393,23 +503,34 @@ u256 State::enactOn(bytesConstRef _block, BlockInfo const& _bi, BlockChain const
 	return enact(_block, biGrandParent);
 }
 
-map<Address, u256> State::addresses() const
+map<Address, u256> State::addresses(Address _from, unsigned _max) const
 {
 	map<Address, u256> ret;
-	for (auto i: m_cache)
-		if (i.second.isAlive())
-			ret[i.first] = i.second.balance();
-	for (auto const& i: m_state)
-		if (m_cache.find(i.first) == m_cache.end())
+	// Walk the state trie from _from alongside the cache, which takes precedence.
+	auto t = m_state.lower_bound(_from);
+	for (auto c = m_cache.lower_bound(_from); ret.size() < _max && (t != m_state.end() || c != m_cache.end());)
+		if (t == m_state.end() || (c != m_cache.end() && !((*t).first < c->first)))
+		{
+			if (t != m_state.end() && c->first == (*t).first)
+				++t;
+			if (c->second.isAlive())
+				ret[c->first] = c->second.balance();
+			++c;
+		}
+		else
+		{
+			auto i = *t;
 			ret[i.first] = RLP(i.second)[1].toInt<u256>();
+			++t;
+		}
 	return ret;
 }
 
 void State::resetCurrent()
 {
-	m_transactions.clear();
-	m_transactionSet.clear();
-	m_cache.clear();
+	m_transactions.reset();
+	m_transactionSet.reset();
+	clearCache();
 	m_currentBlock = BlockInfo();
 	m_currentBlock.coinbaseAddress = m_ourAddress;
 	m_currentBlock.timestamp = time(0);
@@ -421,8 +542,11 @@ void State::resetCurrent()
 	// Update timestamp according to clock.
 	// TODO: check.
 
+	m_db.startJournal();
 	m_lastTx = m_db;
 	m_state.setRoot(m_previousBlock.stateRoot);
+	m_changes.clear();
+	m_indexBase = m_previousBlock.stateRoot;
 
 	paranoia("begin resetCurrent", true);
 }
@@ -430,14 +554,14 @@ void State::resetCurrent()
 bool State::cull(TransactionQueue& _tq) const
 {
 	bool ret = false;
-	auto ts = _tq.transactions();
+	auto ts = _tq.verified();
 	for (auto const& i: ts)
 	{
-		if (!m_transactionSet.count(i.first))
+		if (!m_transactionSet->count(i.first))
 		{
 			try
 			{
-				Transaction t(i.second);
+				Transaction const& t = i.second;
 				if (t.nonce <= transactionsFrom(t.sender()))
 				{
 					_tq.drop(i.first);
@@ -458,43 +582,76 @@ h256s State::sync(TransactionQueue& _tq, bool* o_transactionQueueChanged)
 {
 	// TRANSACTIONS
 	h256s ret;
-	auto ts = _tq.transactions();
+	auto ts = _tq.bySender();
 
-	for (int goodTxs = 1; goodTxs;)
+	// Each sender's transactions are in nonce order, so only the first not yet executed can be executable. Keep those
+	// (at most one per sender) queued by gas price, best first, and replace each with its successor as it's executed.
+	std::map<Address, unsigned> next;
+	std::priority_queue<std::pair<u256, Address>> ready;
+	auto queueNext = [&](Address _a)
 	{
-		goodTxs = 0;
-		for (auto const& i: ts)
-			if (!m_transactionSet.count(i.first))
+		auto const& txs = ts[_a];
+		unsigned& i = next[_a];
+		u256 nonce = transactionsFrom(_a);
+		for (; i < txs.size(); ++i)
+			if (m_transactionSet->count(txs[i].first))
+				continue;
+			else if (txs[i].second.nonce < nonce)
 			{
-				// don't have it yet! Execute it now.
-				try
-				{
-					uncommitToMine();
-					execute(i.second);
-					ret.push_back(m_transactions.back().changes.bloom());
-					_tq.noteGood(i);
-					++goodTxs;
-				}
-				catch (InvalidNonce const& in)
-				{
-					if (in.required > in.candidate)
-					{
-						// too old
-						_tq.drop(i.first);
-						if (o_transactionQueueChanged)
-							*o_transactionQueueChanged = true;
-					}
-					else
-						_tq.setFuture(i);
-				}
-				catch (std::exception const&)
-				{
-					// Something else went wrong - drop it.
-					_tq.drop(i.first);
-					if (o_transactionQueueChanged)
-						*o_transactionQueueChanged = true;
-				}
+				// too old
+				_tq.drop(txs[i].first);
+				if (o_transactionQueueChanged)
+					*o_transactionQueueChanged = true;
+			}
+			else if (txs[i].second.nonce == nonce)
+			{
+				ready.push(make_pair(txs[i].second.gasPrice, _a));
+				return;
 			}
+			else
+			{
+				// can't be executed until the gap is filled.
+				for (; i < txs.size(); ++i)
+					_tq.setFuture(txs[i].first);
+				return;
+			}
+	};
+
+	for (auto const& i: ts)
+		queueNext(i.first);
+
+	while (!ready.empty())
+	{
+		Address a = ready.top().second;
+		ready.pop();
+		auto const& i = ts[a][next[a]++];
+		try
+		{
+			uncommitToMine();
+			execute(i.second);
+			ret.push_back(m_transactions->back().changes.bloom());
+			_tq.noteGood(i.first);
+		}
+		catch (InvalidNonce const& in)
+		{
+			if (in.required > in.candidate)
+			{
+				// too old
+				_tq.drop(i.first);
+				if (o_transactionQueueChanged)
+					*o_transactionQueueChanged = true;
+			}
+			else
+				_tq.setFuture(i.first);
+		}
+		catch (std::exception const&)
+		{
+			// Something else went wrong - drop it.
+			_tq.drop(i.first);
+			if (o_transactionQueueChanged)
+				*o_transactionQueueChanged = true;
+		}
+		queueNext(a);
 	}
 	return ret;
 }
@@ -521,8 +678,7 @@ u256 State::enact(bytesConstRef _block, BlockInfo const& _grandParent, bool _che
 //	cnote << m_state;
 
 	MemoryDB tm;
-	GenericTrieDB<MemoryDB> transactionManifest(&tm);
-	transactionManifest.init();
+	GenericBatchTrieDB<MemoryDB> transactionManifest(&tm);
 
 	// All ok with the block generally. Play back the transactions now...
 	unsigned i = 0;
@@ -602,7 +758,8 @@ void State::cleanup(bool _fullCommit)
 		paranoia("immediately before database commit", true);
 
 		// Commit the new trie to disk.
-		m_db.commit();
+		StateIndex::note(m_db, (unsigned)m_currentBlock.number, m_currentBlock.hash, m_changes);
+		m_db.commit((unsigned)m_currentBlock.number, m_currentBlock.hash);
 
 		paranoia("immediately after database commit", true);
 		m_previousBlock = m_currentBlock;
@@ -619,11 +776,11 @@ void State::uncommitToMine()
 {
 	if (m_currentBlock.sha3Uncles)
 	{
-		m_cache.clear();
-		if (!m_transactions.size())
+		clearCache();
+		if (!m_transactions->size())
 			m_state.setRoot(m_previousBlock.stateRoot);
 		else
-			m_state.setRoot(m_transactions[m_transactions.size() - 1].stateRoot);
+			m_state.setRoot(m_transactions->back().stateRoot);
 		m_db = m_lastTx;
 		paranoia("Uncommited to mine", true);
 		m_currentBlock.sha3Uncles = h256();
@@ -670,7 +827,7 @@ bool State::amIJustParanoid(BlockChain const& _bc)
 h256 State::bloom() const
 {
 	h256 ret;
-	for (auto const& i: m_transactions)
+	for (auto const& i: *m_transactions)
 		ret |= i.changes.bloom();
 	return ret;
 }
@@ -711,18 +868,17 @@ void State::commitToMine(BlockChain const& _bc)
 		uncles.appendList(0);
 
 	MemoryDB tm;
-	GenericTrieDB<MemoryDB> transactionReceipts(&tm);
-	transactionReceipts.init();
+	GenericBatchTrieDB<MemoryDB> transactionReceipts(&tm);
 
 	RLPStream txs;
-	txs.appendList(m_transactions.size());
+	txs.appendList(m_transactions->size());
 
-	for (unsigned i = 0; i < m_transactions.size(); ++i)
+	for (unsigned i = 0; i < m_transactions->size(); ++i)
 	{
 		RLPStream k;
 		k << i;
 		RLPStream v;
-		m_transactions[i].fillStream(v);
+		(*m_transactions)[i].fillStream(v);
 		transactionReceipts.insert(&k.out(), &v.out());
 		txs.appendRaw(v.out());
 	}
@@ -767,9 +923,6 @@ void State::completeMine()
 	cdebug << "Completing mine!";
 	// Got it!
 
-	// Commit to disk.
-	m_db.commit();
-
 	// Compile block:
 	RLPStream ret;
 	ret.appendList(3);
@@ -778,12 +931,17 @@ void State::completeMine()
 	ret.appendRaw(m_currentUncles);
 	ret.swapOut(m_currentBytes);
 	m_currentBlock.hash = sha3(m_currentBytes);
+
+	// Commit to disk.
+	StateIndex::note(m_db, (unsigned)m_currentBlock.number, m_currentBlock.hash, m_changes);
+	m_db.commit((unsigned)m_currentBlock.number, m_currentBlock.hash);
+
 	cnote << "Mined " << m_currentBlock.hash << "(parent: " << m_currentBlock.parentHash << ")";
 
 	// Quickly reset the transactions.
 	// TODO: Leave this in a better state than this limbo, or at least record that it's in limbo.
-	m_transactions.clear();
-	m_transactionSet.clear();
+	m_transactions.reset();
+	m_transactionSet.reset();
 	m_lastTx = m_db;
 }
 
@@ -819,9 +977,12 @@ void State::noteSending(Address _id)
 	ensureCached(_id, false, false);
 	auto it = m_cache.find(_id);
 	if (it == m_cache.end())
-		m_cache[_id] = AddressState(1, 0, h256(), EmptySHA3);
+		journalAccount(_id) = AddressState(1, 0, h256(), EmptySHA3);
 	else
+	{
+		m_journal.push_back(JournalEntry(JournalEntry::Nonce, _id, it->second.nonce()));
 		it->second.incNonce();
+	}
 }
 
 void State::addBalance(Address _id, u256 _amount)
@@ -829,9 +990,12 @@ void State::addBalance(Address _id, u256 _amount)
 	ensureCached(_id, false, false);
 	auto it = m_cache.find(_id);
 	if (it == m_cache.end())
-		m_cache[_id] = AddressState(0, _amount, h256(), EmptySHA3);
+		journalAccount(_id) = AddressState(0, _amount, h256(), EmptySHA3);
 	else
+	{
+		m_journal.push_back(JournalEntry(JournalEntry::Balance, _id, it->second.balance()));
 		it->second.addBalance(_amount);
+	}
 }
 
 void State::subBalance(Address _id, bigint _amount)
@@ -841,7 +1005,22 @@ void State::subBalance(Address _id, bigint _amount)
 	if (it == m_cache.end() || (bigint)it->second.balance() < _amount)
 		throw NotEnoughCash();
 	else
+	{
+		m_journal.push_back(JournalEntry(JournalEntry::Balance, _id, it->second.balance()));
 		it->second.addBalance(-_amount);
+	}
+}
+
+void State::setStorage(Address _contract, u256 _location, u256 _value)
+{
+	auto it = m_cache.find(_contract);
+	AddressState& s = it == m_cache.end() ? journalAccount(_contract) : it->second;
+	auto sit = s.storage().find(_location);
+	if (sit == s.storage().end())
+		m_journal.push_back(JournalEntry(JournalEntry::Storage, _contract, 0, _location, false));
+	else
+		m_journal.push_back(JournalEntry(JournalEntry::Storage, _contract, sit->second, _location));
+	s.setStorage(_location, _value);
 }
 
 u256 State::transactionsFrom(Address _id) const
@@ -868,37 +1047,52 @@ u256 State::storage(Address _id, u256 _memory) const
 	if (mit != it->second.storage().end())
 		return mit->second;
 
-	// Not in the storage cache - go to the DB.
-	TrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db), it->second.baseRoot());			// promise we won't change the overlay! :)
-	string payload = memdb.at(_memory);
+	// Not in the storage cache - go to the DB: the state index if it's current for this position of this account as loaded
+	// (one that's been replaced since has no base root), otherwise the account's storage trie.
+	string payload;
+	if (!it->second.baseRoot() || m_changes.changed(_id, _memory) || !m_index || !m_index->storage(m_indexBase, _id, _memory, payload))
+	{
+		TrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db), it->second.baseRoot());			// promise we won't change the overlay! :)
+		payload = memdb.at(_memory);
+	}
 	u256 ret = payload.size() ? RLP(payload).toInt<u256>() : 0;
 	it->second.setStorage(_memory, ret);
 	return ret;
 }
 
-map<u256, u256> State::storage(Address _id) const
+map<u256, u256> State::storage(Address _id, u256 _from, unsigned _max) const
 {
 	map<u256, u256> ret;
 
 	ensureCached(_id, false, false);
 	auto it = m_cache.find(_id);
-	if (it != m_cache.end())
+	if (it == m_cache.end())
+		return ret;
+
+	// Walk trie storage from _from alongside the cached storage, which takes precedence (zero meaning removed).
+	TrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db));		// promise we won't alter the overlay! :)
+	auto t = memdb.end();
+	if (it->second.baseRoot())
 	{
-		// Pull out all values from trie storage.
-		if (it->second.baseRoot())
+		memdb.setRoot(it->second.baseRoot());
+		t = memdb.lower_bound(_from);
+	}
+	auto const& cached = it->second.storage();
+	for (auto c = cached.lower_bound(_from); ret.size() < _max && (t != memdb.end() || c != cached.end());)
+		if (t == memdb.end() || (c != cached.end() && c->first <= (u256)(*t).first))
 		{
-			TrieDB<h256, OverlayDB> memdb(const_cast<OverlayDB*>(&m_db), it->second.baseRoot());		// promise we won't alter the overlay! :)
-			for (auto const& i: memdb)
-				ret[i.first] = RLP(i.second).toInt<u256>();
+			if (t != memdb.end() && c->first == (u256)(*t).first)
+				++t;
+			if (c->second)
+				ret[c->first] = c->second;
+			++c;
+		}
+		else
+		{
+			auto i = *t;
+			ret[i.first] = RLP(i.second).toInt<u256>();
+			++t;
 		}
-
-		// Then merge cached storage over the top.
-		for (auto const& i: it->second.storage())
-			if (i.second)
-				ret[i.first] = i.second;
-			else
-				ret.erase(i.first);
-	}
 	return ret;
 }
 
@@ -921,6 +1115,23 @@ bytes const& State::code(Address _contract) const
 	return m_cache[_contract].code();
 }
 
+SharedCode State::sharedCode(Address _contract) const
+{
+	if (!addressHasCode(_contract))
+		return SharedCode();
+	ensureCached(_contract, true, false);
+	return m_cache[_contract].sharedCode();
+}
+
+h256 State::codeHash(Address _contract) const
+{
+	if (!addressHasCode(_contract))
+		return h256();
+	ensureCached(_contract, false, false);
+	AddressState const& a = m_cache[_contract];
+	return a.isFreshCode() ? h256() : a.codeHash();
+}
+
 bool State::isTrieGood(bool _enforceRefs, bool _requireNoLeftOvers) const
 {
 	for (int e = 0; e < (_enforceRefs ? 2 : 1); ++e)
@@ -958,7 +1169,7 @@ bool State::isTrieGood(bool _enforceRefs, bool _requireNoLeftOvers) const
 
 // TODO: maintain node overlay revisions for stateroots -> each commit gives a stateroot + OverlayDB; allow overlay copying for rewind operations.
 
-u256 State::execute(bytesConstRef _rlp, bytes* o_output, bool _commit)
+u256 State::execute(Transaction const& _t, bytes* o_output, bool _commit)
 {
 #ifndef ETH_RELEASE
 	commit();	// get an updated hash
@@ -966,15 +1177,15 @@ u256 State::execute(bytesConstRef _rlp, bytes* o_output, bool _commit)
 
 	paranoia("start of execution.", true);
 
-	State old(*this);
 #if ETH_PARANOIA
+	State old(*this);
 	auto h = rootHash();
 #endif
 
 	Manifest ms;
 
 	Executive e(*this, &ms);
-	e.setup(_rlp);
+	e.setup(_t);
 
 	u256 startGasUsed = gasUsed();
 
@@ -996,7 +1207,7 @@ u256 State::execute(bytesConstRef _rlp, bytes* o_output, bool _commit)
 
 	if (!_commit)
 	{
-		m_cache.clear();
+		clearCache();
 		return e.gasUsed();
 	}
 
@@ -1022,8 +1233,8 @@ u256 State::execute(bytesConstRef _rlp, bytes* o_output, bool _commit)
 	// TODO: CHECK TRIE after level DB flush to make sure exactly the same.
 
 	// Add to the user-originated transactions that we've executed.
-	m_transactions.push_back(TransactionReceipt(e.t(), rootHash(), startGasUsed + e.gasUsed(), ms));
-	m_transactionSet.insert(e.t().sha3());
+	m_transactions.write().push_back(TransactionReceipt(e.t(), rootHash(), startGasUsed + e.gasUsed(), ms));
+	m_transactionSet.write().insert(e.t().sha3());
 	return e.gasUsed();
 }
 
@@ -1045,13 +1256,15 @@ bool State::call(Address _receiveAddress, Address _senderAddress, u256 _value, u
 
 	if (addressHasCode(_receiveAddress))
 	{
-		VM vm(*_gas);
-		ExtVM evm(*this, _receiveAddress, _senderAddress, _originAddress, _value, _gasPrice, _data, &code(_receiveAddress), o_ms, _level);
+		PooledVM vm = pooledVM(*_gas);
+		SharedCode c = sharedCode(_receiveAddress);
+		ExtVM evm(*this, _receiveAddress, _senderAddress, _originAddress, _value, _gasPrice, _data, c ? bytesConstRef(c.get()) : bytesConstRef(), o_ms, _level);
+		evm.codeHash = codeHash(_receiveAddress);
 		bool revert = false;
 
 		try
 		{
-			auto out = vm.go(evm, _onOp);
+			auto out = vm->go(evm, _onOp);
 			memcpy(_out.data(), out.data(), std::min(out.size(), _out.size()));
 			if (o_suicides)
 				for (auto i: evm.suicides)
@@ -1081,7 +1294,7 @@ bool State::call(Address _receiveAddress, Address _senderAddress, u256 _value, u
 		if (revert)
 			evm.revert();
 
-		*_gas = vm.gas();
+		*_gas = vm->gas();
 
 		return !revert;
 	}
@@ -1106,17 +1319,17 @@ h160 State::create(Address _sender, u256 _endowment, u256 _gasPrice, u256* _gas,
 		newAddress = (u160)newAddress + 1;
 
 	// Set up new account...
-	m_cache[newAddress] = AddressState(0, 0, h256(), h256());
+	journalAccount(newAddress) = AddressState(0, 0, h256(), h256());
 
 	// Execute init code.
-	VM vm(*_gas);
+	PooledVM vm = pooledVM(*_gas);
 	ExtVM evm(*this, newAddress, _sender, _origin, _endowment, _gasPrice, bytesConstRef(), _code, o_ms, _level);
 	bool revert = false;
 	bytesConstRef out;
 
 	try
 	{
-		out = vm.go(evm, _onOp);
+		out = vm->go(evm, _onOp);
 		if (o_ms)
 			o_ms->output = out.toBytes();
 		if (o_suicides)
@@ -1149,9 +1362,12 @@ h160 State::create(Address _sender, u256 _endowment, u256 _gasPrice, u256* _gas,
 
 	// Set code.
 	if (addressInUse(newAddress))
+	{
+		m_journal.push_back(JournalEntry(JournalEntry::Code, newAddress));
 		m_cache[newAddress].setCode(out);
+	}
 
-	*_gas = vm.gas();
+	*_gas = vm->gas();
 
 	return newAddress;
 }
@@ -1159,22 +1375,26 @@ h160 State::create(Address _sender, u256 _endowment, u256 _gasPrice, u256* _gas,
 State State::fromPending(unsigned _i) const
 {
 	State ret = *this;
-	ret.m_cache.clear();
-	_i = min<unsigned>(_i, m_transactions.size());
+	ret.clearCache();
+	_i = min<unsigned>(_i, m_transactions->size());
 	if (!_i)
 		ret.m_state.setRoot(m_previousBlock.stateRoot);
 	else
-		ret.m_state.setRoot(m_transactions[_i - 1].stateRoot);
-	while (ret.m_transactions.size() > _i)
+		ret.m_state.setRoot((*m_transactions)[_i - 1].stateRoot);
+	while (ret.m_transactions->size() > _i)
 	{
-		ret.m_transactionSet.erase(ret.m_transactions.back().transaction.sha3());
-		ret.m_transactions.pop_back();
+		ret.m_transactionSet.write().erase(ret.m_transactions->back().transaction.sha3());
+		ret.m_transactions.write().pop_back();
 	}
 	return ret;
 }
 
 void State::applyRewards(Addresses const& _uncleAddresses)
 {
+	Addresses rewarded = _uncleAddresses;
+	rewarded.push_back(m_currentBlock.coinbaseAddress);
+	ensureCached(rewarded);
+
 	u256 r = m_blockReward;
 	for (auto const& i: _uncleAddresses)
 	{
@@ -22,11 +22,15 @@
 #pragma once
 
 #include <array>
+#include <limits>
 #include <map>
+#include <memory>
 #include <unordered_map>
 #include <libethential/Common.h>
+#include <libethential/CopyOnWrite.h>
 #include <libethential/RLP.h>
 #include <libethcore/TrieDB.h>
+#include <libethcore/BatchTrieDB.h>
 #include <libethcore/Exceptions.h>
 #include <libethcore/BlockInfo.h>
 #include <libethcore/Dagger.h>
@@ -34,6 +38,7 @@
 #include <libevm/ExtVMFace.h>
 #include "TransactionQueue.h"
 #include "AddressState.h"
+#include "StateIndex.h"
 #include "Transaction.h"
 #include "Executive.h"
 
@@ -102,6 +107,26 @@ struct StateDiff
 	std::map<Address, AccountDiff> accounts;
 };
 
+/**
+ * @brief A single undoable change to the address cache of a State.
+ * Each mutation of State::m_cache records one of these in the journal; rolling back to a savepoint
+ * replays them backwards. Only the fields relevant to the given kind are meaningful.
+ */
+struct JournalEntry
+{
+	enum Kind { Account, Balance, Nonce, Storage, Code };
+
+	JournalEntry(Kind _kind, Address _address, u256 _value = 0, u256 _key = 0, bool _existed = true): kind(_kind), address(_address), value(_value), key(_key), existed(_existed) {}
+	JournalEntry(Address _address, std::shared_ptr<AddressState const> const& _account): kind(Account), address(_address), account(_account) {}
+
+	Kind kind;
+	Address address;
+	u256 value;										///< Previous balance, nonce or storage value.
+	u256 key;										///< Storage location (Storage only).
+	bool existed = true;							///< Whether the storage location was previously cached (Storage only).
+	std::shared_ptr<AddressState const> account;	///< Previous account state or null if uncached (Account only).
+};
+
 /**
  * @brief Model of the current state of the ledger.
  * Maintains current ledger (m_current) as a fast hash-map. This is hashed only when required (i.e. to create or verify a block).
@@ -128,6 +153,9 @@ public:
 	/// Set the coinbase address for any transactions we do.
 	/// This causes a complete reset of current block.
 	void setAddress(Address _coinbaseAddress) { m_ourAddress = _coinbaseAddress; resetCurrent(); }
+
+	/// Read committed accounts and storage through @a _index where it is of our previous block's state; null reads the trie only.
+	void setIndex(std::shared_ptr<StateIndex const> const& _index) { m_index = _index; }
 	Address address() const { return m_ourAddress; }
 
 	/// Open a DB - useful for passing into the constructor & keeping for other states that are necessary.
@@ -136,7 +164,11 @@ public:
 	OverlayDB const& db() const { return m_db; }
 
 	/// @returns the set containing all addresses currently in use in Ethereum.
-	std::map<Address, u256> addresses() const;
+	std::map<Address, u256> addresses() const { return addresses(Address(), std::numeric_limits<unsigned>::max()); }
+
+	/// @returns up to @a _max of the addresses in use, in order from @a _from, together with their balances.
+	/// Only the part of the state trie being listed is read; for the next page, start one after the last address.
+	std::map<Address, u256> addresses(Address _from, unsigned _max) const;
 
 	BlockInfo const& info() const { return m_currentBlock; }
 
@@ -190,7 +222,9 @@ public:
 	/// Execute a given transaction.
 	/// This will append @a _t to the transaction list and change the state accordingly.
 	u256 execute(bytes const& _rlp, bytes* o_output = nullptr, bool _commit = true) { return execute(&_rlp, o_output, _commit); }
-	u256 execute(bytesConstRef _rlp, bytes* o_output = nullptr, bool _commit = true);
+	u256 execute(bytesConstRef _rlp, bytes* o_output = nullptr, bool _commit = true) { return execute(Transaction(_rlp), o_output, _commit); }
+	/// Execute a transaction that has already been decoded (and perhaps had its sender recovered).
+	u256 execute(Transaction const& _t, bytes* o_output = nullptr, bool _commit = true);
 
 	/// Check if the address is in use.
 	bool addressInUse(Address _address) const;
@@ -220,16 +254,26 @@ public:
 	u256 storage(Address _contract, u256 _memory) const;
 
 	/// Set the value of a storage position of an account.
-	void setStorage(Address _contract, u256 _location, u256 _value) { m_cache[_contract].setStorage(_location, _value); }
+	void setStorage(Address _contract, u256 _location, u256 _value);
 
 	/// Get the storage of an account.
 	/// @note This is expensive. Don't use it unless you need to.
 	/// @returns std::map<u256, u256> if no account exists at that address.
-	std::map<u256, u256> storage(Address _contract) const;
+	std::map<u256, u256> storage(Address _contract) const { return storage(_contract, 0, std::numeric_limits<unsigned>::max()); }
+
+	/// Get up to @a _max of the non-zero storage positions of an account, in order from @a _from.
+	/// Only the part of the storage trie being listed is read; for the next page, start one after the last position.
+	std::map<u256, u256> storage(Address _contract, u256 _from, unsigned _max) const;
 
 	/// Get the code of an account.
 	/// @returns bytes() if no account exists at that address.
 	bytes const& code(Address _contract) const;
+	/// Get the code of an account as shared with all else using it, which a reference to it keeps alive.
+	/// @returns null if no account exists at that address or it has no code.
+	SharedCode sharedCode(Address _contract) const;
+	/// Get the hash of an account's code.
+	/// @returns h256() if no account exists at that address, it has no code, or its code is yet to be committed.
+	h256 codeHash(Address _contract) const;
 
 	/// Note that the given address is sending a transaction and thus increment the associated ticker.
 	void noteSending(Address _id);
@@ -242,16 +286,16 @@ public:
 	h256 rootHash() const { return m_state.root(); }
 
 	/// Get the list of pending transactions.
-	Transactions pending() const { Transactions ret; for (auto const& t: m_transactions) ret.push_back(t.transaction); return ret; }
+	Transactions pending() const { Transactions ret; for (auto const& t: *m_transactions) ret.push_back(t.transaction); return ret; }
 
 	/// Get the list of pending transactions.
-	Manifest changesFromPending(unsigned _i) const { return m_transactions[_i].changes; }
+	Manifest changesFromPending(unsigned _i) const { return (*m_transactions)[_i].changes; }
 
 	/// Get the bloom filter of all changes happened in the block.
 	h256 bloom() const;
 
 	/// Get the bloom filter of a particular transaction that happened in the block.
-	h256 bloom(unsigned _i) const { return m_transactions[_i].changes.bloom(); }
+	h256 bloom(unsigned _i) const { return (*m_transactions)[_i].changes.bloom(); }
 
 	/// Get the State immediately after the given number of pending transactions have been applied.
 	/// If (_i == 0) returns the initial state of the block.
@@ -302,9 +346,29 @@ private:
 	/// Retrieve all information about a given address into a cache.
 	void ensureCached(std::map<Address, AddressState>& _cache, Address _a, bool _requireCode, bool _forceCreate) const;
 
+	/// Retrieve the basic information about each of the given addresses that isn't yet cached, walking the state
+	/// trie only once. Addresses that don't exist in the DB are left out of the cache.
+	void ensureCached(Addresses const& _as) const;
+
+	/// @returns the RLP of account @a _a as committed to the state trie; from the state index if it's known to be current.
+	std::string committedAccount(Address _a) const;
+
 	/// Commit all changes waiting in the address cache to the DB.
 	void commit();
 
+	/// Drop the address cache together with its journal.
+	void clearCache() { m_cache.clear(); m_journal.clear(); }
+
+	/// @returns a savepoint which rollback() may later return the address cache to.
+	unsigned savepoint() const { return m_journal.size(); }
+
+	/// Undo all changes to the address cache made since @a _savepoint was taken.
+	void rollback(unsigned _savepoint);
+
+	/// Record the current state of @a _a in the journal in preparation for it being overwritten, killed or erased wholesale.
+	/// @returns the (possibly freshly default-constructed) cache entry for @a _a.
+	AddressState& journalAccount(Address _a);
+
 	/// Execute the given block, assuming it corresponds to m_currentBlock. If _grandParent is passed, it will be used to check the uncles.
 	/// Throws on failure.
 	u256 enact(bytesConstRef _block, BlockInfo const& _grandParent = BlockInfo(), bool _checkNonce = true);
@@ -329,19 +393,23 @@ private:
 	void refreshManifest(RLPStream* _txs = nullptr);
 
 	/// @returns gas used by transactions thus far executed.
-	u256 gasUsed() const { return m_transactions.size() ? m_transactions.back().gasUsed : 0; }
+	u256 gasUsed() const { return m_transactions->size() ? m_transactions->back().gasUsed : 0; }
 
 	bool isTrieGood(bool _enforceRefs, bool _requireNoLeftOvers) const;
 	void paranoia(std::string const& _when, bool _enforceRefs = false) const;
 
 	OverlayDB m_db;								///< Our overlay for the state tree.
 	TrieDB<Address, OverlayDB> m_state;			///< Our state tree, as an OverlayDB DB.
-	std::vector<TransactionReceipt> m_transactions;	///< The current list of transactions that we've included in the state.
-	std::set<h256> m_transactionSet;			///< The set of transaction hashes that we've included in the state.
+	CopyOnWrite<std::vector<TransactionReceipt>> m_transactions;	///< The current list of transactions that we've included in the state. Shared with copies until altered.
+	CopyOnWrite<std::set<h256>> m_transactionSet;				///< The set of transaction hashes that we've included in the state. Shared with copies until altered.
 //	GenericTrieDB<OverlayDB> m_transactionManifest;	///< The transactions trie; saved from the last commitToMine, or invalid/empty if commitToMine was never called.
 	OverlayDB m_lastTx;
 
 	mutable std::map<Address, AddressState> m_cache;	///< Our address cache. This stores the states of each address that has (or at least might have) been changed.
+	mutable std::vector<JournalEntry> m_journal;		///< Undo log for m_cache since it was last cleared. Savepoints are indices into this.
+	StateIndex::Changes m_changes;				///< Keys committed to the state trie since its root was m_indexBase.
+	h256 m_indexBase;							///< The previous block's state root; the state index, if it's of this state, is current for all keys but m_changes.
+	std::shared_ptr<StateIndex const> m_index;	///< The flat state index we read through, shared with copies; null if none.
 
 	BlockInfo m_previousBlock;					///< The previous block's information.
 	BlockInfo m_currentBlock;					///< The current block's information.
@@ -368,9 +436,11 @@ std::ostream& operator<<(std::ostream& _out, AccountDiff const& _s);
 template <class DB>
 void commit(std::map<Address, AddressState> const& _cache, DB& _db, TrieDB<Address, DB>& _state)
 {
+	// All changes go through in-memory tries so that each touched node is hashed and written only once.
+	BatchTrieDB<Address, DB> state(&_db, _state.root());
 	for (auto const& i: _cache)
 		if (!i.second.isAlive())
-			_state.remove(i.first);
+			state.remove(i.first);
 		else
 		{
 			RLPStream s(4);
@@ -380,12 +450,13 @@ void commit(std::map<Address, AddressState> const& _cache, DB& _db, TrieDB<Addre
 				s.append(i.second.baseRoot(), false, true);
 			else
 			{
-				TrieDB<h256, DB> storageDB(&_db, i.second.baseRoot());
+				BatchTrieDB<h256, DB> storageDB(&_db, i.second.baseRoot());
 				for (auto const& j: i.second.storage())
 					if (j.second)
 						storageDB.insert(j.first, rlp(j.second));
 					else
 						storageDB.remove(j.first);
+				storageDB.commit();
 				s.append(storageDB.root(), false, true);
 			}
 
@@ -393,13 +464,16 @@ void commit(std::map<Address, AddressState> const& _cache, DB& _db, TrieDB<Addre
 			{
 				h256 ch = sha3(i.second.code());
 				_db.insert(ch, &i.second.code());
+				CodeCache::insert(ch, &i.second.code());
 				s << ch;
 			}
 			else
 				s << i.second.codeHash();
 
-			_state.insert(i.first, &s.out());
+			state.insert(i.first, &s.out());
 		}
+	state.commit();
+	_state.setRoot(state.root());
 }
 
 }
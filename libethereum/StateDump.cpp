@@ -0,0 +1,278 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StateDump.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "StateDump.h"
+
+#include <iostream>
+#include <memory>
+#include <set>
+#include <libethential/RLP.h>
+#include <libethcore/Exceptions.h>
+#include <libethcore/TrieDB.h>
+#include <libethcore/BatchTrieDB.h>
+using namespace std;
+using namespace eth;
+
+static const char* c_magic = "ethstate";
+static const unsigned c_version = 0;
+
+/// The size, in bytes, past which a chunk is ended.
+static const size_t c_chunkSize = 1024 * 1024;
+/// The largest frame we'll believe in, lest a corrupt length have us try to read gigabytes.
+static const size_t c_maxFrameSize = 64 * 1024 * 1024;
+
+static void writeFrame(ostream& _out, bytesConstRef _payload)
+{
+	byte n[4];
+	for (unsigned i = 0; i < 4; ++i)
+		n[i] = (byte)(_payload.size() >> (24 - i * 8));
+	_out.write((char const*)n, 4);
+	if (_payload.size())
+	{
+		_out.write((char const*)_payload.data(), _payload.size());
+		_out.write((char const*)sha3(_payload).data(), 32);
+	}
+}
+
+/// Read the next frame into @a o_payload. @returns false if it's the empty frame that ends the dump.
+static bool readFrame(istream& _in, bytes& o_payload)
+{
+	byte n[4];
+	if (!_in.read((char*)n, 4))
+		throw InvalidStateDump("truncated");
+	size_t s = ((size_t)n[0] << 24) | ((size_t)n[1] << 16) | ((size_t)n[2] << 8) | n[3];
+	if (!s)
+		return false;
+	if (s > c_maxFrameSize)
+		throw InvalidStateDump("frame too big");
+	o_payload.resize(s);
+	h256 h;
+	if (!_in.read((char*)o_payload.data(), s) || !_in.read((char*)h.data(), 32))
+		throw InvalidStateDump("truncated");
+	if (sha3(o_payload) != h)
+		throw InvalidStateDump("bad checksum");
+	return true;
+}
+
+/// Read the header frame from @a _in. @returns its block hash and state root.
+static pair<h256, h256> readHeader(istream& _in)
+{
+	bytes f;
+	if (!readFrame(_in, f))
+		throw InvalidStateDump("no header");
+	RLP h(f);
+	if (!h.isList() || h.itemCount() != 5 || h[0].toString() != c_magic)
+		throw InvalidStateDump("not a state dump");
+	if (h[1].toInt<unsigned>() != c_version)
+		throw InvalidStateDump("unknown version " + toString(h[1].toInt<unsigned>()));
+	return make_pair(h[2].toHash<h256>(), h[4].toHash<h256>());
+}
+
+unsigned StateDump::write(OverlayDB const& _db, BlockInfo const& _bi, std::ostream& _out)
+{
+	RLPStream h(5);
+	h << c_magic << c_version << _bi.hash << _bi.number << _bi.stateRoot;
+	writeFrame(_out, &h.out());
+
+	bytes chunk;
+	unsigned records = 0;
+	auto flush = [&]()
+	{
+		if (!records)
+			return;
+		RLPStream s;
+		s.appendList(records).appendRaw(chunk, records);
+		writeFrame(_out, &s.out());
+		chunk.clear();
+		records = 0;
+	};
+	auto append = [&](Address const& _a, RLP const& _account, bytes const& _code, bytes const& _storage, unsigned _positions)
+	{
+		RLPStream r(7);
+		r << _a << _account[0].toInt<u256>() << _account[1].toInt<u256>() << _account[2].toHash<h256>() << _account[3].toHash<h256>() << _code;
+		r.appendList(_positions).appendRaw(_storage, _positions);
+		chunk += r.out();
+		++records;
+		if (chunk.size() >= c_chunkSize)
+			flush();
+	};
+
+	unsigned ret = 0;
+	std::set<h256> codes;
+	TrieDB<Address, OverlayDB> state(const_cast<OverlayDB*>(&_db), _bi.stateRoot);	// promise we won't alter the overlay! :)
+	for (auto const& i: state)
+	{
+		RLP account(i.second);
+		h256 codeHash = account[3].toHash<h256>();
+		bytes code;
+		if (codeHash != EmptySHA3 && codes.insert(codeHash).second)
+			code = asBytes(_db.lookup(codeHash));
+
+		bytes storage;
+		unsigned positions = 0;
+		bool appended = false;
+		if (h256 storageRoot = account[2].toHash<h256>())
+		{
+			TrieDB<h256, OverlayDB> storageDB(const_cast<OverlayDB*>(&_db), storageRoot);
+			for (auto const& j: storageDB)
+			{
+				RLPStream p(2);
+				p << (u256)j.first << RLP(j.second).toInt<u256>();
+				storage += p.out();
+				++positions;
+				if (storage.size() >= c_chunkSize)
+				{
+					append(i.first, account, code, storage, positions);
+					appended = true;
+					code.clear();
+					storage.clear();
+					positions = 0;
+				}
+			}
+		}
+		if (positions || !appended)
+			append(i.first, account, code, storage, positions);
+		++ret;
+	}
+	flush();
+	writeFrame(_out, bytesConstRef());
+	return ret;
+}
+
+h256 StateDump::blockOf(std::istream& _in)
+{
+	return readHeader(_in).first;
+}
+
+namespace
+{
+
+/// The account being read, whose storage may carry on into the next record.
+struct Account
+{
+	Account(OverlayDB& _db, RLP const& _r): address(_r[0].toHash<Address>()), nonce(_r[1].toInt<u256>()), balance(_r[2].toInt<u256>()), storageRoot(_r[3].toHash<h256>()), codeHash(_r[4].toHash<h256>()), storage(&_db, h256()) {}
+
+	bool sameAs(RLP const& _r) const { return _r[0].toHash<Address>() == address && _r[1].toInt<u256>() == nonce && _r[2].toInt<u256>() == balance && _r[3].toHash<h256>() == storageRoot && _r[4].toHash<h256>() == codeHash; }
+
+	Address address;
+	u256 nonce;
+	u256 balance;
+	h256 storageRoot;
+	h256 codeHash;
+	BatchTrieDB<h256, OverlayDB> storage;
+	unsigned positions = 0;
+	u256 lastPosition;
+};
+
+}
+
+unsigned StateDump::read(OverlayDB& _db, BlockInfo const& _bi, std::istream& _in)
+{
+	auto h = readHeader(_in);
+	if (h.first != _bi.hash || h.second != _bi.stateRoot)
+		throw InvalidStateDump("not of block " + toString(_bi.hash));
+
+	unsigned ret = 0;
+	std::set<h256> codes;
+	BatchTrieDB<Address, OverlayDB> state(&_db, h256());
+	std::unique_ptr<Account> a;
+
+	// Rebuild the account's storage trie and put it, now that we know the storage root is right, into the state trie.
+	auto finish = [&]()
+	{
+		if (!a)
+			return;
+		h256 storageRoot = a->storageRoot;
+		if (a->positions)
+		{
+			a->storage.commit();
+			if (a->storage.root() != storageRoot)
+				throw InvalidStateDump("wrong storage root for " + toString(a->address));
+		}
+		else if (storageRoot && storageRoot != c_shaNull)
+			throw InvalidStateDump("missing storage for " + toString(a->address));
+		if (a->codeHash != EmptySHA3 && !codes.count(a->codeHash))
+			throw InvalidStateDump("missing code for " + toString(a->address));
+
+		RLPStream s(4);
+		s << a->nonce << a->balance;
+		s.append(storageRoot, false, true);
+		s << a->codeHash;
+		state.insert(a->address, &s.out());
+		++ret;
+		a.reset();
+	};
+
+	bytes f;
+	while (readFrame(_in, f))
+	{
+		RLP chunk(f);
+		if (!chunk.isList())
+			throw InvalidStateDump("bad chunk");
+		for (auto const& r: chunk)
+		{
+			if (!r.isList() || r.itemCount() != 7 || !r[6].isList())
+				throw InvalidStateDump("bad record");
+			Address address = r[0].toHash<Address>();
+			if (!a || address != a->address)
+			{
+				if (a && address < a->address)
+					throw InvalidStateDump("accounts out of order at " + toString(address));
+				finish();
+				a.reset(new Account(_db, r));
+			}
+			else if (!a->sameAs(r))
+				throw InvalidStateDump("inconsistent records for " + toString(address));
+
+			bytes code = r[5].toBytes();
+			if (code.size())
+			{
+				if (sha3(code) != a->codeHash)
+					throw InvalidStateDump("wrong code for " + toString(address));
+				_db.insert(a->codeHash, &code);
+				codes.insert(a->codeHash);
+			}
+
+			for (auto const& p: r[6])
+			{
+				u256 position = p[0].toInt<u256>();
+				u256 value = p[1].toInt<u256>();
+				if ((a->positions && position <= a->lastPosition) || !value)
+					throw InvalidStateDump("bad storage for " + toString(address));
+				a->storage.insert(position, rlp(value));
+				a->lastPosition = position;
+				++a->positions;
+			}
+		}
+		// The storage tries and code so far are done with; there's no need to keep them in memory.
+		_db.commit();
+	}
+	finish();
+
+	state.commit();
+	if (state.root() != _bi.stateRoot)
+	{
+		_db.rollback();
+		throw InvalidStateRoot();
+	}
+	_db.commit();
+	return ret;
+}
@@ -0,0 +1,60 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StateDump.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <libethential/Common.h>
+#include <libethcore/BlockInfo.h>
+#include <libethcore/OverlayDB.h>
+
+namespace eth
+{
+
+/**
+ * @brief The whole state of a block as a self-contained stream, so that a node may be given the state of some block
+ * rather than having to replay every block from genesis up to it.
+ *
+ * A dump is a sequence of frames, each of which is the length of its payload as 4 bytes big-endian, the payload and
+ * then the payload's SHA3, so that truncation and corruption are caught as it's read. The first frame's payload is the
+ * header, RLP ["ethstate", version, block hash, block number, state root]; each following frame's is a chunk, an RLP
+ * list of account records; an empty frame ends the dump.
+ * An account record is RLP [address, nonce, balance, storage root, code hash, code, [[position, value], ...]], with
+ * accounts, and each account's storage positions, in ascending order. Code is given only with the first account that
+ * has it. An account with more storage than fits in a chunk carries on in records of the same address that follow.
+ */
+class StateDump
+{
+public:
+	/// Write the state of block @a _bi, which must be in @a _db, to @a _out. @returns the number of accounts written.
+	static unsigned write(OverlayDB const& _db, BlockInfo const& _bi, std::ostream& _out);
+
+	/// Read just the header of the dump in @a _in. @returns the hash of the block whose state it is.
+	static h256 blockOf(std::istream& _in);
+
+	/// Read the dump in @a _in of the state of block @a _bi into @a _db, rebuilding the tries from their leaves, and
+	/// commit it. Storage and code are committed chunk by chunk as they're read; the state trie is committed only once
+	/// its root has been found to be @a _bi's state root. @returns the number of accounts read.
+	/// Throws InvalidStateDump if the dump is malformed or of another block, InvalidStateRoot if it's not @a _bi's state.
+	static unsigned read(OverlayDB& _db, BlockInfo const& _bi, std::istream& _in);
+};
+
+}
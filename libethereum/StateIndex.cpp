@@ -0,0 +1,373 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StateIndex.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "StateIndex.h"
+
+#include <memory>
+#include <libethential/RLP.h>
+#include <libethcore/TrieDB.h>
+#include "BlockChain.h"
+using namespace std;
+using namespace eth;
+
+/// How many blocks back the changes of each are kept, bounding how deep a reorganisation can be followed without a rebuild.
+static const unsigned c_changesHistory = 256;
+/// How many writes a rebuild of the index gathers before making them, bounding the memory it takes.
+static const unsigned c_rebuildBatchSize = 16384;
+
+/// State DB keys of the index, all of lengths other than 32 so they can't clash with nodes:
+/// the head block and state root the index is of...
+static const std::string c_indexedKey = "indexed";
+/// ...an account...
+static std::string accountKey(Address const& _a) { return "a" + asString(_a.asBytes()); }
+static const unsigned c_accountKeySize = 21;
+/// ...a storage position...
+static std::string storageKey(Address const& _a, u256 const& _p) { return "s" + asString(_a.asBytes()) + asString(h256(_p).asBytes()); }
+static const unsigned c_storageKeySize = 53;
+/// ...and the changes made by a block.
+static std::string changesKey(unsigned _n, h256 const& _h)
+{
+	bytes n(4);
+	for (unsigned i = 0; i < 4; ++i)
+		n[i] = (byte)(_n >> (24 - i * 8));
+	return "changes" + asString(n) + asString(_h.asBytes());
+}
+
+StateIndex::Changes::Changes(bytesConstRef _rlp)
+{
+	RLP r(_rlp);
+	for (auto const& i: r[0])
+		accounts.insert(i.toHash<Address>());
+	for (auto const& i: r[1])
+	{
+		auto& s = storage[i[0].toHash<Address>()];
+		for (auto const& j: i[1])
+			s.insert(j.toInt<u256>());
+	}
+	for (auto const& i: r[2])
+		wiped.insert(i.toHash<Address>());
+}
+
+bool StateIndex::Changes::changed(Address const& _a, u256 const& _p) const
+{
+	if (wiped.count(_a))
+		return true;
+	auto it = storage.find(_a);
+	return it != storage.end() && it->second.count(_p);
+}
+
+void StateIndex::Changes::merge(Changes const& _c)
+{
+	accounts.insert(_c.accounts.begin(), _c.accounts.end());
+	for (auto const& i: _c.storage)
+		storage[i.first].insert(i.second.begin(), i.second.end());
+	wiped.insert(_c.wiped.begin(), _c.wiped.end());
+}
+
+bytes StateIndex::Changes::rlp() const
+{
+	RLPStream s(3);
+	s.appendList(accounts.size());
+	for (auto const& i: accounts)
+		s << i;
+	s.appendList(storage.size());
+	for (auto const& i: storage)
+	{
+		s.appendList(2) << i.first;
+		s.appendList(i.second.size());
+		for (auto const& j: i.second)
+			s << j;
+	}
+	s.appendList(wiped.size());
+	for (auto const& i: wiped)
+		s << i;
+	return s.out();
+}
+
+void StateIndex::note(OverlayDB& _db, unsigned _number, h256 const& _hash, Changes const& _changes)
+{
+	bytes r = _changes.rlp();
+	_db.insertAux(changesKey(_number, _hash), &r);
+}
+
+StateIndex::StateIndex(OverlayDB const& _db):
+	m_db(_db),
+	m_rebuilt(false),
+	m_abort(false)
+{
+	if (KeyValueDB* db = m_db.db())
+	{
+		std::string indexed = db->get(c_indexedKey);
+		if (!indexed.empty())
+		{
+			m_head = RLP(indexed)[0].toHash<h256>();
+			m_root = RLP(indexed)[1].toHash<h256>();
+		}
+	}
+}
+
+StateIndex::~StateIndex()
+{
+	m_abort = true;
+	join();
+}
+
+void StateIndex::join()
+{
+	if (m_rebuilder.joinable())
+		m_rebuilder.join();
+}
+
+void StateIndex::moveTo(BlockChain const& _bc)
+{
+	KeyValueDB* db = m_db.db();
+	if (!db)
+		return;
+	if (m_rebuilder.joinable())
+	{
+		if (!m_rebuilt)
+			return;
+		m_rebuilder.join();
+	}
+
+	h256 head = _bc.currentHash();
+	h256 from;
+	{
+		ReadGuard l(x_indexed);
+		if (m_head == head)
+			return;
+		from = m_head;
+	}
+	h256 stateRoot = BlockInfo(_bc.block(head)).stateRoot;
+	unsigned number = _bc.number(head);
+
+	// Gather the changes of the blocks from the head the index is of and from the new head back to where they meet.
+	Changes changes;
+	bool traced = !!from;
+	if (traced)
+	{
+		h256 to = head;
+		unsigned fn = _bc.number(from);
+		unsigned tn = number;
+		auto gather = [&](h256& io_h, unsigned& io_n)
+		{
+			std::string s = db->get(changesKey(io_n, io_h));
+			if (s.empty())
+				traced = false;
+			else
+				changes.merge(Changes(bytesConstRef(s)));
+			io_h = _bc.details(io_h).parent;
+			--io_n;
+		};
+		while (traced && fn > tn)
+			gather(from, fn);
+		while (traced && tn > fn)
+			gather(to, tn);
+		while (traced && from != to)
+		{
+			gather(from, fn);
+			gather(to, tn);
+		}
+	}
+
+	if (!traced)
+	{
+		// Mark the index as of no state, on disk too, so that an interrupted rebuild is started over, then leave it to
+		// a thread of its own.
+		{
+			WriteGuard l(x_indexed);
+			db->del(c_indexedKey);
+			m_head = m_root = h256();
+		}
+		m_rebuilt = false;
+		m_rebuilder = std::thread([=]()
+		{
+			rebuild(head, stateRoot, number);
+			m_rebuilt = true;
+		});
+		return;
+	}
+
+	DBBatch batch;
+	TrieDB<Address, OverlayDB> state(&m_db, stateRoot);
+	std::set<Address> all = changes.accounts;
+	for (auto const& i: changes.storage)
+		all.insert(i.first);
+	all.insert(changes.wiped.begin(), changes.wiped.end());
+	Addresses as(all.begin(), all.end());
+	auto rlps = state.atMany(as);
+	for (unsigned i = 0; i < as.size(); ++i)
+	{
+		Address const& a = as[i];
+		if (rlps[i].empty())
+		{
+			batch.del(accountKey(a));
+			deleteAll(db, storageKey(a, 0).substr(0, c_accountKeySize), c_storageKeySize, batch);
+			continue;
+		}
+		batch.put(accountKey(a), rlps[i]);
+		h256 storageRoot = RLP(rlps[i])[2].toHash<h256>();
+		if (changes.wiped.count(a))
+		{
+			deleteAll(db, storageKey(a, 0).substr(0, c_accountKeySize), c_storageKeySize, batch);
+			writeStorage(m_db, a, storageRoot, batch);
+		}
+		else if (changes.storage.count(a))
+		{
+			auto const& ps = changes.storage.at(a);
+			std::vector<h256> keys(ps.begin(), ps.end());
+			std::vector<std::string> values(keys.size());
+			if (storageRoot)
+			{
+				TrieDB<h256, OverlayDB> storageDB(&m_db, storageRoot);
+				values = storageDB.atMany(keys);
+			}
+			for (unsigned j = 0; j < keys.size(); ++j)
+				if (values[j].empty())
+					batch.del(storageKey(a, keys[j]));
+				else
+					batch.put(storageKey(a, keys[j]), values[j]);
+		}
+	}
+
+	RLPStream s(2);
+	s << head << stateRoot;
+	batch.put(c_indexedKey, &s.out());
+	forgetChanges(number, batch);
+
+	WriteGuard l(x_indexed);
+	db->write(batch);
+	m_head = head;
+	m_root = stateRoot;
+}
+
+void StateIndex::rebuild(h256 _head, h256 _root, unsigned _number)
+{
+	// Written in bounded batches rather than all at once. The index is of no state until the last, so no read can use
+	// it half-built.
+	cnote << "Rebuilding state index for" << _head;
+	KeyValueDB* db = m_db.db();
+	try
+	{
+		DBBatch batch;
+		deleteAll(db, "a", c_accountKeySize, batch, db);
+		deleteAll(db, "s", c_storageKeySize, batch, db);
+		TrieDB<Address, OverlayDB> state(&m_db, _root);
+		for (auto const& i: state)
+		{
+			if (m_abort)
+				return;
+			batch.put(accountKey(i.first), i.second);
+			writeStorage(m_db, i.first, RLP(i.second)[2].toHash<h256>(), batch, db);
+			flushIfFull(db, batch);
+		}
+
+		RLPStream s(2);
+		s << _head << _root;
+		batch.put(c_indexedKey, &s.out());
+		forgetChanges(_number, batch);
+
+		WriteGuard l(x_indexed);
+		db->write(batch);
+		m_head = _head;
+		m_root = _root;
+		cnote << "Rebuilt state index for" << _head;
+	}
+	catch (std::exception const& _e)
+	{
+		// E.g. the state was pruned from under us; the next moveTo() will try again with the head as it is then.
+		cwarn << "Couldn't rebuild state index:" << _e.what();
+	}
+}
+
+void StateIndex::forgetChanges(unsigned _head, DBBatch& o_batch) const
+{
+	if (_head <= c_changesHistory)
+		return;
+	std::string end = changesKey(_head - c_changesHistory + 1, h256());
+	m_db.db()->forEach(changesKey(0, h256()), [&](bytesConstRef _k, bytesConstRef)
+	{
+		if (_k.toString() >= end)
+			return false;
+		o_batch.del(_k);
+		return true;
+	});
+}
+
+bool StateIndex::account(h256 const& _stateRoot, Address const& _a, std::string& o_rlp) const
+{
+	return get(_stateRoot, accountKey(_a), o_rlp);
+}
+
+bool StateIndex::storage(h256 const& _stateRoot, Address const& _a, u256 const& _p, std::string& o_rlp) const
+{
+	return get(_stateRoot, storageKey(_a, _p), o_rlp);
+}
+
+bool StateIndex::get(h256 const& _stateRoot, std::string const& _key, std::string& o_value) const
+{
+	KeyValueDB* db = m_db.db();
+	if (!db || !_stateRoot)
+		return false;
+
+	// Hold the index where it is between our checking which state it's of and the lookup.
+	ReadGuard l(x_indexed);
+	if (m_root != _stateRoot)
+		return false;
+	o_value = db->get(_key);
+	return true;
+}
+
+void StateIndex::flushIfFull(KeyValueDB* _db, DBBatch& io_batch)
+{
+	if (_db && io_batch.ops().size() >= c_rebuildBatchSize)
+	{
+		_db->write(io_batch);
+		io_batch.clear();
+	}
+}
+
+void StateIndex::deleteAll(KeyValueDB const* _db, std::string const& _prefix, unsigned _size, DBBatch& o_batch, KeyValueDB* _flushTo)
+{
+	_db->forEach(_prefix, [&](bytesConstRef _k, bytesConstRef)
+	{
+		if (_k.toString().compare(0, _prefix.size(), _prefix))
+			return false;
+		if (_k.size() == _size)
+		{
+			o_batch.del(_k);
+			flushIfFull(_flushTo, o_batch);
+		}
+		return true;
+	});
+}
+
+void StateIndex::writeStorage(OverlayDB const& _db, Address const& _a, h256 const& _root, DBBatch& o_batch, KeyValueDB* _flushTo)
+{
+	if (!_root)
+		return;
+	TrieDB<h256, OverlayDB> storageDB(const_cast<OverlayDB*>(&_db), _root);	// promise we won't alter the overlay! :)
+	for (auto const& i: storageDB)
+	{
+		o_batch.put(storageKey(_a, i.first), i.second);
+		flushIfFull(_flushTo, o_batch);
+	}
+}
@@ -0,0 +1,123 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file StateIndex.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <set>
+#include <thread>
+#include <libethential/Common.h>
+#include <libethcore/CommonEth.h>
+#include <libethcore/OverlayDB.h>
+#include "Guards.h"
+
+namespace eth
+{
+
+class BlockChain;
+
+/**
+ * @brief A flat index of the head block's state, kept in the state DB alongside the trie: the RLP of each account by
+ * address and of each storage value by address and position. A read through it is a single DB lookup, where the trie
+ * takes one for each node on the path.
+ * Each block's state notes the keys it changed (note()); when the head moves, forwards or onto another branch,
+ * moveTo() re-reads the keys changed by the blocks between the old head and the new from the new head's trie. Should
+ * that route not be traceable (e.g. the first time, or after a very deep reorganisation), the index is rebuilt from
+ * the whole trie, in bounded batches, by a thread of its own; until that's done, reads go to the trie.
+ * Which state the index is of is kept in memory as well as in the DB, so a read needn't look it up.
+ * @threadsafe moveTo() is called from one thread at a time; reads may come from any.
+ */
+class StateIndex
+{
+public:
+	/// Keys changed relative to some base state.
+	struct Changes
+	{
+		Changes() {}
+		explicit Changes(bytesConstRef _rlp);
+
+		/// @returns true if the account @a _a may have changed.
+		bool changed(Address const& _a) const { return accounts.count(_a); }
+		/// @returns true if storage position @a _p of account @a _a may have changed.
+		bool changed(Address const& _a, u256 const& _p) const;
+
+		void merge(Changes const& _c);
+		void clear() { accounts.clear(); storage.clear(); wiped.clear(); }
+		bytes rlp() const;
+
+		std::set<Address> accounts;
+		std::map<Address, std::set<u256>> storage;
+		std::set<Address> wiped;	///< Accounts killed or replaced, all of whose previous storage has gone.
+	};
+
+	/// Use the index kept in @a _db, which is shared with the caller's copy.
+	explicit StateIndex(OverlayDB const& _db);
+	/// Abandons any rebuild under way; the next moveTo() of another StateIndex on the same DB starts it over.
+	~StateIndex();
+
+	/// Note in @a _db, to be written with its next commit, the @a _changes made by block @a _hash (number @a _number) to its parent's state.
+	static void note(OverlayDB& _db, unsigned _number, h256 const& _hash, Changes const& _changes);
+
+	/// Bring the index into line with the state of the head of @a _bc, unless a rebuild is under way.
+	void moveTo(BlockChain const& _bc);
+	/// Wait for any rebuild under way to finish.
+	void join();
+
+	/// @returns the state root the index is of, or h256() if it's of none (e.g. while being rebuilt).
+	h256 root() const { ReadGuard l(x_indexed); return m_root; }
+
+	/// If the index is of the state @a _stateRoot, put account @a _a's RLP (empty if there is none) in @a o_rlp.
+	/// @returns false if the index is of some other state.
+	bool account(h256 const& _stateRoot, Address const& _a, std::string& o_rlp) const;
+	/// If the index is of the state @a _stateRoot, put the RLP of account @a _a's storage position @a _p (empty if it's
+	/// zero) in @a o_rlp. @returns false if the index is of some other state.
+	bool storage(h256 const& _stateRoot, Address const& _a, u256 const& _p, std::string& o_rlp) const;
+
+private:
+	/// Rebuild the index from the whole of state trie @a _root, that of block @a _head, number @a _number.
+	void rebuild(h256 _head, h256 _root, unsigned _number);
+	/// Put in @a o_batch the deletion of the changes of blocks so far back from number @a _head that we'll never go back past them.
+	void forgetChanges(unsigned _head, DBBatch& o_batch) const;
+
+	/// If @a _db is given and @a io_batch has grown to the rebuild batch size, write it to @a _db and clear it.
+	static void flushIfFull(KeyValueDB* _db, DBBatch& io_batch);
+	/// Put in @a o_batch the deletion of every key that starts with @a _prefix and is @a _size bytes long.
+	/// If @a _flushTo is given, @a o_batch is written to it whenever it's full.
+	static void deleteAll(KeyValueDB const* _db, std::string const& _prefix, unsigned _size, DBBatch& o_batch, KeyValueDB* _flushTo = nullptr);
+	/// Put in @a o_batch the whole of storage trie @a _root as that of account @a _a.
+	/// If @a _flushTo is given, @a o_batch is written to it whenever it's full.
+	static void writeStorage(OverlayDB const& _db, Address const& _a, h256 const& _root, DBBatch& o_batch, KeyValueDB* _flushTo = nullptr);
+	/// Look up @a _key in the index, returning false if the index is not of state @a _stateRoot.
+	bool get(h256 const& _stateRoot, std::string const& _key, std::string& o_value) const;
+
+	OverlayDB m_db;
+
+	mutable boost::shared_mutex x_indexed;	///< Held shared by each read, exclusively while the index moves.
+	h256 m_head;							///< The block whose state the index is of; h256() if none.
+	h256 m_root;							///< The state root of m_head.
+
+	std::thread m_rebuilder;
+	std::atomic<bool> m_rebuilt;			///< Set by m_rebuilder when it's finished.
+	std::atomic<bool> m_abort;				///< Set to have m_rebuilder give up.
+};
+
+}
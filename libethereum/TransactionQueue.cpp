@@ -21,6 +21,7 @@
 
 #include "TransactionQueue.h"
 
+#include <secp256k1/secp256k1.h>
 #include <libethential/Log.h>
 #include <libethcore/Exceptions.h>
 #include "Transaction.h"
@@ -31,8 +32,11 @@ bool TransactionQueue::import(bytesConstRef _transactionRLP)
 {
 	// Check if we already know this transaction.
 	h256 h = sha3(_transactionRLP);
-	if (m_known.count(h))
-		return false;
+	{
+		ReadGuard l(m_lock);
+		if (m_known.count(h))
+			return false;
+	}
 
 	try
 	{
@@ -42,7 +46,8 @@ bool TransactionQueue::import(bytesConstRef _transactionRLP)
 		Transaction t(_transactionRLP, true);
 
 		// If valid, append to blocks.
-		m_current[h] = _transactionRLP.toBytes();
+		WriteGuard l(m_lock);
+		return insertWithoutWriteGuard(h, _transactionRLP, t);
 	}
 	catch (InvalidTransactionFormat const& _e)
 	{
@@ -54,25 +59,134 @@ bool TransactionQueue::import(bytesConstRef _transactionRLP)
 		cwarn << "Ignoring invalid transaction: " << _e.what();
 		return false;
 	}
+}
+
+unsigned TransactionQueue::import(std::vector<bytes> const& _txs, h256s* o_ignored)
+{
+	// Weed out those we know already (or that are repeated in the batch) before doing any real work.
+	std::vector<std::pair<h256, bytes const*>> todo;
+	{
+		ReadGuard l(m_lock);
+		std::set<h256> batch;
+		for (auto const& tx: _txs)
+		{
+			h256 h = sha3(tx);
+			if (m_known.count(h) || !batch.insert(h).second)
+			{
+				if (o_ignored)
+					o_ignored->push_back(h);
+			}
+			else
+				todo.push_back(make_pair(h, &tx));
+		}
+	}
+
+	// Decode & recover senders; thread i takes every n-th transaction starting at i.
+	std::vector<Transaction> decoded(todo.size());
+	std::vector<char> valid(todo.size(), 0);
+	auto verify = [&](unsigned _first, unsigned _step)
+	{
+		for (unsigned i = _first; i < todo.size(); i += _step)
+			try
+			{
+				decoded[i] = Transaction(*todo[i].second, true);
+				valid[i] = 1;
+			}
+			catch (...) {}
+	};
+
+	unsigned n = std::min<unsigned>(m_verifiers, todo.size());
+	if (n > 1)
+	{
+		secp256k1_start();	// not threadsafe: make sure the tables exist before the workers need them.
+		std::vector<std::thread> workers;
+		for (unsigned i = 1; i < n; ++i)
+			workers.push_back(std::thread(verify, i, n));
+		verify(0, n);
+		for (auto& w: workers)
+			w.join();
+	}
+	else
+		verify(0, 1);
 
+	unsigned ret = 0;
+	WriteGuard l(m_lock);
+	for (unsigned i = 0; i < todo.size(); ++i)
+		if (valid[i] && insertWithoutWriteGuard(todo[i].first, bytesConstRef(todo[i].second), decoded[i]))
+			++ret;
+		else
+		{
+			if (!valid[i])
+				cwarn << "Ignoring invalid transaction: " << todo[i].first.abridged();
+			if (o_ignored)
+				o_ignored->push_back(todo[i].first);
+		}
+	return ret;
+}
+
+bool TransactionQueue::insertWithoutWriteGuard(h256 _h, bytesConstRef _tx, Transaction const& _t)
+{
+	if (!m_known.insert(_h).second)
+		return false;
+	m_current[_h] = _tx.toBytes();
+	m_decoded[_h] = _t;
+	m_senders[_t.sender()].insert(make_pair(_t.nonce, _h));
 	return true;
 }
 
-void TransactionQueue::setFuture(std::pair<h256, bytes> const& _t)
+std::map<h256, Transaction> TransactionQueue::verified() const
+{
+	ReadGuard l(m_lock);
+	std::map<h256, Transaction> ret;
+	for (auto const& i: m_current)
+		ret.insert(*m_decoded.find(i.first));
+	return ret;
+}
+
+std::map<Address, std::vector<std::pair<h256, Transaction>>> TransactionQueue::bySender() const
 {
-	if (m_current.count(_t.first))
+	ReadGuard l(m_lock);
+	std::map<Address, std::vector<std::pair<h256, Transaction>>> ret;
+	for (auto const& s: m_senders)
 	{
-		m_current.erase(_t.first);
-		m_future.insert(make_pair(Transaction(_t.second).sender(), _t));
+		auto& txs = ret[s.first];
+		txs.reserve(s.second.size());
+		for (auto const& i: s.second)
+			txs.push_back(*m_decoded.find(i.second));
 	}
+	return ret;
 }
 
-void TransactionQueue::noteGood(std::pair<h256, bytes> const& _t)
+void TransactionQueue::setFuture(h256 _txHash)
 {
-	auto r = m_future.equal_range(Transaction(_t.second).sender());
-	for (auto it = r.first; it != r.second; ++it)
-		m_current.insert(it->second);
-	m_future.erase(r.first, r.second);
+	WriteGuard l(m_lock);
+	auto it = m_current.find(_txHash);
+	if (it != m_current.end())
+	{
+		m_future.insert(*it);
+		m_current.erase(it);
+	}
+}
+
+void TransactionQueue::noteGood(h256 _txHash)
+{
+	WriteGuard l(m_lock);
+	auto d = m_decoded.find(_txHash);
+	if (d == m_decoded.end())
+		return;
+	// Only the sender's transactions with the next nonce can have become good; each of those, once it's executed, will
+	// see to those after it in turn.
+	auto s = m_senders.find(d->second.sender());
+	auto r = s->second.equal_range(d->second.nonce + 1);
+	for (auto i = r.first; i != r.second; ++i)
+	{
+		auto it = m_future.find(i->second);
+		if (it != m_future.end())
+		{
+			m_current.insert(*it);
+			m_future.erase(it);
+		}
+	}
 }
 
 void TransactionQueue::drop(h256 _txHash)
@@ -81,15 +195,19 @@ void TransactionQueue::drop(h256 _txHash)
 	if (!m_known.erase(_txHash))
 		return;
 
-	if (m_current.count(_txHash))
-		m_current.erase(_txHash);
-	else
-	{
-		for (auto i = m_future.begin(); i != m_future.end(); ++i)
-			if (i->second.first == _txHash)
-			{
-				m_future.erase(i);
-				break;
-			}
-	}
+	m_current.erase(_txHash);
+	m_future.erase(_txHash);
+
+	auto d = m_decoded.find(_txHash);
+	auto s = m_senders.find(d->second.sender());
+	auto r = s->second.equal_range(d->second.nonce);
+	for (auto it = r.first; it != r.second; ++it)
+		if (it->second == _txHash)
+		{
+			s->second.erase(it);
+			break;
+		}
+	if (s->second.empty())
+		m_senders.erase(s);
+	m_decoded.erase(d);
 }
@@ -21,9 +21,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <thread>
 #include <boost/thread.hpp>
 #include <libethential/Common.h>
 #include "libethcore/CommonEth.h"
+#include "Transaction.h"
 #include "Guards.h"
 
 namespace eth
@@ -33,28 +36,51 @@ class BlockChain;
 
 /**
  * @brief A queue of Transactions, each stored as RLP.
+ * Each transaction is decoded and has its sender recovered exactly once, as it is imported; the result is kept
+ * alongside the RLP so that nothing downstream need do the signature recovery again. Batches of transactions
+ * are verified across several threads. Transactions are also indexed by sender and, for each sender, ordered by
+ * nonce, so that block assembly can go through each account's transactions in turn.
  * @threadsafe
  */
 class TransactionQueue
 {
 public:
+	TransactionQueue(): m_verifiers(std::max(1u, std::thread::hardware_concurrency())) {}
+
 	bool attemptImport(bytesConstRef _tx) { try { import(_tx); return true; } catch (...) { return false; } }
 	bool attemptImport(bytes const& _tx) { return attemptImport(&_tx); }
 	bool import(bytesConstRef _tx);
+	/// Import a batch of transactions, decoding them and recovering their senders on up to verifiers() threads.
+	/// @returns the number imported. The hashes of those that were not (because they're known already or invalid) are placed in @a o_ignored.
+	unsigned import(std::vector<bytes> const& _txs, h256s* o_ignored = nullptr);
 
 	void drop(h256 _txHash);
 
 	std::map<h256, bytes> transactions() const { ReadGuard l(m_lock); return m_current; }
+	/// @returns the current transactions decoded, each with its sender already determined.
+	std::map<h256, Transaction> verified() const;
+	/// @returns all transactions (current and future) decoded and grouped by sender, each group in nonce order.
+	std::map<Address, std::vector<std::pair<h256, Transaction>>> bySender() const;
 	std::pair<unsigned, unsigned> items() const { ReadGuard l(m_lock); return std::make_pair(m_current.size(), m_future.size()); }
 
-	void setFuture(std::pair<h256, bytes> const& _t);
-	void noteGood(std::pair<h256, bytes> const& _t);
+	void setFuture(h256 _txHash);
+	void noteGood(h256 _txHash);
+
+	/// Set the number of threads used for verifying a batch of transactions.
+	void setVerifiers(unsigned _n) { m_verifiers = std::max(1u, _n); }
+	unsigned verifiers() const { return m_verifiers; }
 
 private:
+	/// Note a transaction that has been verified. @returns false if it is already known.
+	bool insertWithoutWriteGuard(h256 _h, bytesConstRef _tx, Transaction const& _t);
+
 	mutable boost::shared_mutex m_lock;							///< General lock.
 	std::set<h256> m_known;										///< Hashes of transactions in both sets.
 	std::map<h256, bytes> m_current;							///< Map of SHA3(tx) to tx.
-	std::multimap<Address, std::pair<h256, bytes>> m_future;	///< For transactions that have a future nonce; we map their sender address to the tx stuff, and insert once the sender has a valid TX.
+	std::map<h256, bytes> m_future;								///< For transactions that have a future nonce; we move them back into m_current once their sender has a valid TX.
+	std::map<h256, Transaction> m_decoded;						///< Map of SHA3(tx) to the decoded tx (sender recovered) for every tx in m_known.
+	std::map<Address, std::multimap<u256, h256>> m_senders;		///< Map of sender to the nonces and SHA3s of its txs, for every tx in m_known.
+	std::atomic<unsigned> m_verifiers;							///< Number of threads with which to verify batches.
 };
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "CodeAnalysis.h"
 #include "ExtVMFace.h"
 #include "FeeStructure.h"
 #include "VM.h"
+#include "VMTrace.h"
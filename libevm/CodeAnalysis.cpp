@@ -0,0 +1,187 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeAnalysis.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "CodeAnalysis.h"
+
+#include <mutex>
+#include <unordered_map>
+#include <libevmface/Instruction.h>
+#include "FeeStructure.h"
+using namespace std;
+using namespace eth;
+
+/// Analyses are kept for code totalling at most this many bytes before the lot is thrown away.
+static const size_t c_maxAnalysedCode = 16 * 1024 * 1024;
+
+/// Runs are counted for at most this many different codes before the lot is thrown away.
+static const size_t c_maxCounted = 64 * 1024;
+
+/// Each thread keeps at most this many analyses to hand before it forgets them all.
+static const size_t c_maxHad = 1024;
+
+static bool endsBlock(Instruction _inst)
+{
+	switch (_inst)
+	{
+	case Instruction::STOP:
+	case Instruction::JUMP:
+	case Instruction::JUMPI:
+	case Instruction::RETURN:
+	case Instruction::SUICIDE:
+	case Instruction::GAS:
+	case Instruction::CALL:
+	case Instruction::CREATE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+CodeAnalysis::CodeAnalysis(bytesConstRef _code):
+	m_blocks(_code.size()),
+	m_indices(_code.size(), c_undecoded)
+{
+	std::vector<unsigned> boundaries;
+	for (unsigned pc = 0; pc < _code.size(); ++pc)
+	{
+		boundaries.push_back(pc);
+		auto it = c_instructionInfo.find((Instruction)_code[pc]);
+		if (it != c_instructionInfo.end())
+			pc += it->second.additional;
+	}
+
+	// Backwards, so that each block can be built from the one following it.
+	BasicBlock const* next = nullptr;
+	for (auto i = boundaries.rbegin(); i != boundaries.rend(); ++i)
+	{
+		Instruction inst = (Instruction)_code[*i];
+		auto it = c_instructionInfo.find(inst);
+		if (it == c_instructionInfo.end())
+		{
+			next = nullptr;
+			continue;
+		}
+		InstructionInfo const& info = it->second;
+		BasicBlock& b = m_blocks[*i];
+		b.gas = staticFee(inst);
+		b.required = info.args;
+		b.instructions = 1;
+		if (next && !endsBlock(inst))
+		{
+			b.gas += next->gas;
+			b.required = max<int>(info.args, (int)next->required - info.ret + info.args);
+			b.instructions += next->instructions;
+		}
+		next = &b;
+	}
+
+	for (unsigned pc: boundaries)
+	{
+		m_indices[pc] = m_decoded.size();
+		m_decoded.push_back(DecodedInstruction());
+		DecodedInstruction& d = m_decoded.back();
+		d.inst = (Instruction)_code[pc];
+		d.dynamicFee = hasDynamicFee(d.inst);
+		d.pc = pc;
+		d.block = blockAt(pc);
+		if (d.inst >= Instruction::PUSH1 && d.inst <= Instruction::PUSH32)
+		{
+			// Past the end of the code is all zeroes.
+			unsigned n = (unsigned)d.inst - (unsigned)Instruction::PUSH1 + 1;
+			byte b[32] = {};
+			for (unsigned i = 0; i < n && pc + 1 + i < _code.size(); ++i)
+				b[i] = _code[pc + 1 + i];
+			d.immediate = w256::fromBigEndian(bytesConstRef(b, n));
+		}
+	}
+	m_decoded.push_back(DecodedInstruction());
+	m_decoded.back().pc = _code.size();
+
+	// Where a PUSH is straight away jumped to, the threaded core can go there without looking it up.
+	for (unsigned i = 0; i + 1 < m_decoded.size(); ++i)
+	{
+		DecodedInstruction& d = m_decoded[i];
+		Instruction next = m_decoded[i + 1].inst;
+		if (d.inst >= Instruction::PUSH1 && d.inst <= Instruction::PUSH32 && (next == Instruction::JUMP || next == Instruction::JUMPI))
+			d.jump = indexAt(d.immediate.fits64() ? (uint64_t)d.immediate : ~(uint64_t)0);
+	}
+}
+
+shared_ptr<CodeAnalysis const> CodeAnalysis::get(h256 const& _codeHash, bytesConstRef _code, unsigned _after)
+{
+	// Code of unknown hash can't be counted or shared, so it's decoded afresh if wanted the first time.
+	if (!_codeHash)
+		return _after ? nullptr : make_shared<CodeAnalysis const>(_code);
+
+	// Each thread keeps the analyses it's already had, so that in the usual case there's no lock to take.
+	static thread_local unordered_map<h256, shared_ptr<CodeAnalysis const>> s_had;
+	auto had = s_had.find(_codeHash);
+	if (had != s_had.end())
+		return had->second;
+
+	struct Counted
+	{
+		unsigned runs = 0;
+		shared_ptr<CodeAnalysis const> analysis;
+	};
+	static mutex s_x;
+	static unordered_map<h256, Counted> s_counted;
+	static size_t s_bytes = 0;
+
+	shared_ptr<CodeAnalysis const> ret;
+	{
+		lock_guard<mutex> l(s_x);
+		auto it = s_counted.find(_codeHash);
+		if (it == s_counted.end())
+		{
+			if (s_counted.size() >= c_maxCounted)
+			{
+				s_counted.clear();
+				s_bytes = 0;
+			}
+			it = s_counted.insert(make_pair(_codeHash, Counted())).first;
+		}
+		Counted& c = it->second;
+		if (c.runs < _after)
+		{
+			++c.runs;
+			return nullptr;
+		}
+		if (!c.analysis)
+		{
+			if (s_bytes + _code.size() > c_maxAnalysedCode)
+			{
+				// Throw away the analyses, though not the counts, so hot code is analysed again the next time it runs.
+				for (auto& i: s_counted)
+					i.second.analysis.reset();
+				s_bytes = 0;
+			}
+			s_bytes += _code.size();
+			c.analysis = make_shared<CodeAnalysis const>(_code);
+		}
+		ret = c.analysis;
+	}
+
+	if (s_had.size() >= c_maxHad)
+		s_had.clear();
+	s_had.insert(make_pair(_codeHash, ret));
+	return ret;
+}
@@ -0,0 +1,93 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file CodeAnalysis.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <memory>
+#include <libethential/Common.h>
+#include <libethential/FixedHash.h>
+#include <libethential/W256.h>
+#include <libevmface/Instruction.h>
+
+namespace eth
+{
+
+/**
+ * @brief The run of instructions from some instruction boundary up to and including the next one that jumps, halts or
+ * looks at (or hands on) the remaining gas. Since nothing inside can change the flow of control, the static fees of
+ * the whole run may be paid and its stack requirement checked as it's entered.
+ */
+struct BasicBlock
+{
+	w256 gas;					///< Total of the static fees of its instructions.
+	unsigned required = 0;		///< Number of stack items needed on entry for none of its instructions to underflow.
+	unsigned instructions = 0;	///< Number of instructions in the run; 0 if it must be stepped through.
+};
+
+/**
+ * @brief An instruction as the threaded interpreter sees it: decoded once, with any PUSH data already in a word.
+ */
+struct DecodedInstruction
+{
+	Instruction inst = Instruction::STOP;
+	bool dynamicFee = false;			///< hasDynamicFee(inst).
+	uint64_t pc = 0;
+	BasicBlock const* block = nullptr;	///< The block starting here, if any.
+	w256 immediate;						///< The value a PUSH pushes.
+	unsigned jump = (unsigned)-1;		///< For a PUSH followed by a JUMP or JUMPI, the index of the instruction it'd go to.
+};
+
+/**
+ * @brief The basic blocks of some code, one for each instruction boundary found by decoding it from the start.
+ * A jump elsewhere (e.g. into PUSH data) has no block and is stepped through until one is reached. An invalid
+ * instruction has no block and ends the runs of those before it, so it's always reached by stepping.
+ * @threadsafe
+ */
+class CodeAnalysis
+{
+public:
+	explicit CodeAnalysis(bytesConstRef _code);
+
+	/// @returns the block starting at @a _pc, or nullptr if there isn't one.
+	BasicBlock const* blockAt(uint64_t _pc) const { return _pc < m_blocks.size() && m_blocks[_pc].instructions ? &m_blocks[_pc] : nullptr; }
+
+	/// @returns the instructions found decoding from the start, in order, ending with the STOP that running off the end
+	/// amounts to.
+	std::vector<DecodedInstruction> const& decoded() const { return m_decoded; }
+
+	/// @returns the index into decoded() of the instruction at @a _pc (the final STOP if it's past the end), or
+	/// c_undecoded if it's inside PUSH data.
+	unsigned indexAt(uint64_t _pc) const { return _pc < m_indices.size() ? m_indices[_pc] : (unsigned)m_decoded.size() - 1; }
+
+	static const unsigned c_undecoded = (unsigned)-1;
+
+	/// Note a run of @a _code, whose hash is @a _codeHash. @returns its analysis, shared with any previous request for the
+	/// same code, if it's been run at least @a _after times before; otherwise nullptr. Code whose hash isn't known (a null
+	/// @a _codeHash) is never counted: it's analysed anew each time if @a _after is zero, and otherwise not at all.
+	static std::shared_ptr<CodeAnalysis const> get(h256 const& _codeHash, bytesConstRef _code, unsigned _after = 0);
+
+private:
+	std::vector<BasicBlock> m_blocks;	///< Indexed by PC.
+	std::vector<DecodedInstruction> m_decoded;
+	std::vector<unsigned> m_indices;	///< Indexed by PC.
+};
+
+}
@@ -78,11 +78,15 @@ public:
 	u256 gasPrice;				///< Price of gas (that we already paid).
 	bytesConstRef data;			///< Current input data.
 	bytesConstRef code;			///< Current code that is executing.
+	h256 codeHash;				///< Hash of code, if known (null for init code); analyses of the code are cached by it.
 	BlockInfo previousBlock;	///< The previous block's information.
 	BlockInfo currentBlock;		///< The current block's information.
 	std::set<Address> suicides;	///< Any accounts that have suicided.
+	unsigned level = 0;			///< Depth of the message call; 0 for that of a transaction itself.
 };
 
-typedef std::function<void(uint64_t /*steps*/, Instruction /*instr*/, unsigned /*newMemSize*/, bigint /*gasCost*/, void/*VM*/*, void/*ExtVM*/ const*)> OnOpFunc;
+/// Called before each instruction a VM runs. The VM is passed as a VM*, and its externalities (whatever the VM was run
+/// with) as an ExtVMFace const*, which may be static_cast back to the type they really are.
+typedef std::function<void(uint64_t /*steps*/, Instruction /*instr*/, unsigned /*newMemSize*/, bigint /*gasCost*/, void/*VM*/*, void/*ExtVMFace*/ const*)> OnOpFunc;
 
 }
@@ -34,3 +34,66 @@ u256 const eth::c_callGas = 20;
 u256 const eth::c_memoryGas = 1;
 u256 const eth::c_txDataGas = 5;
 u256 const eth::c_txGas = 500;
+
+static u256 const c_noGas = 0;
+
+static u256 const& staticFeeOf(Instruction _inst)
+{
+	switch (_inst)
+	{
+	case Instruction::STOP:
+	case Instruction::SUICIDE:
+	case Instruction::SSTORE:
+		return c_noGas;
+	case Instruction::SLOAD:
+		return c_sloadGas;
+	case Instruction::SHA3:
+		return c_sha3Gas;
+	case Instruction::BALANCE:
+		return c_balanceGas;
+	case Instruction::CALL:
+		return c_callGas;
+	case Instruction::CREATE:
+		return c_createGas;
+	default:
+		return c_stepGas;
+	}
+}
+
+namespace
+{
+
+/// The fees as w256, worked out once, for the VM's inner loop.
+struct Fees
+{
+	Fees(): sstore(c_sstoreGas), sstoreSet(c_sstoreGas * 2), memory(c_memoryGas)
+	{
+		for (unsigned i = 0; i < 256; ++i)
+			statics[i] = w256(staticFeeOf((Instruction)i));
+	}
+
+	w256 statics[256];
+	w256 none;
+	w256 sstore;
+	w256 sstoreSet;
+	w256 memory;
+};
+
+static Fees const s_fees;
+
+}
+
+w256 const& eth::staticFee(Instruction _inst)
+{
+	return s_fees.statics[(byte)_inst];
+}
+
+w256 const& eth::sstoreFee(bool _wasSet, bool _willBeSet)
+{
+	return !_wasSet && _willBeSet ? s_fees.sstoreSet : _wasSet && !_willBeSet ? s_fees.none : s_fees.sstore;
+}
+
+w256 eth::memoryFee(unsigned _words)
+{
+	return s_fees.memory * _words;
+}
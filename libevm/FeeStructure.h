@@ -22,6 +22,8 @@
 #pragma once
 
 #include <libethential/Common.h>
+#include <libethential/W256.h>
+#include <libevmface/Instruction.h>
 
 namespace eth
 {
@@ -37,4 +39,33 @@ extern u256 const c_memoryGas;			///< Times the address of the (highest referenc
 extern u256 const c_txDataGas;			///< Per byte of data attached to a transaction. NOTE: Not payable on data of calls between transactions.
 extern u256 const c_txGas;				///< Per transaction. NOTE: Not payable on data of calls between transactions.
 
+/// @returns the part of the fee for @a _inst that depends on nothing but the instruction itself; the rest (for SSTORE,
+/// CALL and memory expansion) is figured at run time.
+w256 const& staticFee(Instruction _inst);
+/// @returns the fee for an SSTORE to a slot that was non-zero if @a _wasSet and will be if @a _willBeSet.
+w256 const& sstoreFee(bool _wasSet, bool _willBeSet);
+/// @returns the fee for growing memory by @a _words words.
+w256 memoryFee(unsigned _words);
+
+/// @returns true if the fee for @a _inst has a part besides the static one.
+inline bool hasDynamicFee(Instruction _inst)
+{
+	switch (_inst)
+	{
+	case Instruction::SSTORE:
+	case Instruction::MSTORE:
+	case Instruction::MSTORE8:
+	case Instruction::MLOAD:
+	case Instruction::RETURN:
+	case Instruction::SHA3:
+	case Instruction::CALLDATACOPY:
+	case Instruction::CODECOPY:
+	case Instruction::CALL:
+	case Instruction::CREATE:
+		return true;
+	default:
+		return false;
+	}
+}
+
 }
@@ -24,8 +24,49 @@
 using namespace std;
 using namespace eth;
 
+/// Spare VMs kept per thread; enough for any call chain gas allows in practice.
+static const unsigned c_maxPooled = 1024;
+
+static thread_local std::vector<std::unique_ptr<VM>> s_pool;
+
+#if ETH_THREADED_VM
+VMCore VM::s_core = VMCore::Threaded;
+#else
+VMCore VM::s_core = VMCore::Switch;
+#endif
+
+unsigned VM::s_decodeAfter = 0;
+
+void VM::setCore(VMCore _core)
+{
+#if ETH_THREADED_VM
+	s_core = _core;
+#else
+	(void)_core;
+#endif
+}
+
 void VM::reset(u256 _gas)
 {
-	m_gas = _gas;
+	m_gas = w256(_gas);
 	m_curPC = 0;
+	m_stack.clear();
+	m_temp.clear();
+}
+
+void VMRecycler::operator()(VM* _vm) const
+{
+	std::unique_ptr<VM> vm(_vm);
+	if (s_pool.size() < c_maxPooled)
+		s_pool.push_back(std::move(vm));
+}
+
+PooledVM eth::pooledVM(u256 _gas)
+{
+	if (s_pool.empty())
+		return PooledVM(new VM(_gas));
+	PooledVM ret(s_pool.back().release());
+	s_pool.pop_back();
+	ret->reset(_gas);
+	return ret;
 }
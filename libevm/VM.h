@@ -29,6 +29,9 @@
 #include <libethcore/BlockInfo.h>
 #include "FeeStructure.h"
 #include "ExtVMFace.h"
+#include "CodeAnalysis.h"
+#include "VMMemory.h"
+#include "VMTrace.h"
 
 namespace eth
 {
@@ -56,346 +59,217 @@ inline u256 fromAddress(Address _a)
 //	return ret;
 }
 
+/// As asAddress() and fromAddress(), for the VM's own words.
+inline Address asAddress(w256 const& _item) { return right160(_item.toHash()); }
+inline w256 toWord(Address const& _a) { return w256::fromBigEndian(_a.ref()); }
+
+// The threaded core needs labels as values, a GCC extension (that Clang has too).
+#if defined(__GNUC__) && !defined(ETH_NO_THREADED_VM)
+#define ETH_THREADED_VM 1
+#endif
+
+/// Applies X to the name of each instruction that neither branches, nor stops, nor reads the code. VM::execute() has
+/// the one body of each, which both cores expand in place.
+#define ETH_VM_STRAIGHT_OPS(X) \
+	X(ADD) X(MUL) X(SUB) X(DIV) X(SDIV) X(MOD) X(SMOD) X(EXP) X(NEG) X(LT) X(GT) X(SLT) X(SGT) X(EQ) X(NOT) \
+	X(AND) X(OR) X(XOR) X(BYTE) X(SHA3) X(ADDRESS) X(ORIGIN) X(BALANCE) X(CALLER) X(CALLVALUE) X(CALLDATALOAD) \
+	X(CALLDATASIZE) X(CALLDATACOPY) X(CODESIZE) X(CODECOPY) X(GASPRICE) X(PREVHASH) X(COINBASE) X(TIMESTAMP) \
+	X(NUMBER) X(DIFFICULTY) X(GASLIMIT) X(POP) X(DUP) X(SWAP) X(MLOAD) X(MSTORE) X(MSTORE8) X(SLOAD) X(SSTORE) \
+	X(MSIZE) X(GAS) X(CREATE) X(CALL)
+
+/// The interpreters VM::go() can run code with.
+enum class VMCore
+{
+	Switch,		///< Decodes and dispatches on each instruction as it comes to it; the reference.
+	Threaded	///< Runs code decoded up front, jumping from each instruction's handler straight to the next's.
+};
+
 /**
  */
 class VM
 {
 public:
 	/// Construct VM object.
-	explicit VM(u256 _gas = 0) { reset(_gas); }
+	explicit VM(u256 _gas = 0) { m_stack.reserve(c_stackReserve); reset(_gas); }
 
+	/// Set it up to run afresh with @a _gas: empty stack and memory, though both keep what they've allocated.
 	void reset(u256 _gas = 0);
 
+	/// Run the code of @a _ext for at most @a _steps instructions, calling @a _onOp (if given) before each.
 	template <class Ext>
 	bytesConstRef go(Ext& _ext, OnOpFunc const& _onOp = OnOpFunc(), uint64_t _steps = (uint64_t)-1);
 
-	void require(u256 _n) { if (m_stack.size() < _n) throw StackTooSmall(_n, m_stack.size()); }
-	void requireMem(unsigned _n) { if (m_temp.size() < _n) { m_temp.resize(_n); } }
-	u256 gas() const { return m_gas; }
-	u256 curPC() const { return m_curPC; }
-
-	bytes const& memory() const { return m_temp; }
-	u256s const& stack() const { return m_stack; }
+	/// As go(), but tracing with the policy @a _tracer (see VMTrace.h), which is compiled in rather than called through.
+	template <class Tracer, class Ext>
+	bytesConstRef run(Ext& _ext, Tracer& _tracer, uint64_t _steps = (uint64_t)-1);
 
-private:
-	u256 m_gas = 0;
-	u256 m_curPC = 0;
-	bytes m_temp;
-	u256s m_stack;
-};
-
-}
-
-// INLINE:
-template <class Ext> eth::bytesConstRef eth::VM::go(Ext& _ext, OnOpFunc const& _onOp, uint64_t _steps)
-{
-	u256 nextPC = m_curPC + 1;
-	auto osteps = _steps;
-	for (bool stopped = false; !stopped && _steps--; m_curPC = nextPC, nextPC = m_curPC + 1)
-	{
-		// INSTRUCTION...
-		Instruction inst = (Instruction)_ext.getCode(m_curPC);
-
-		// FEES...
-		bigint runGas = c_stepGas;
-		unsigned newTempSize = (unsigned)m_temp.size();
-		switch (inst)
-		{
-		case Instruction::STOP:
-			runGas = 0;
-			break;
-
-		case Instruction::SUICIDE:
-			runGas = 0;
-			break;
+	void require(unsigned _n) { if (m_stack.size() < _n) throw StackTooSmall(_n, m_stack.size()); }
+	void requireMem(unsigned _n) { m_temp.grow(_n); }
+	u256 gas() const { return m_gas.toU256(); }
+	u256 curPC() const { return m_curPC; }
+	uint64_t pc() const { return m_curPC; }
+	w256 const& gasWord() const { return m_gas; }
 
-		case Instruction::SSTORE:
-			require(2);
-			if (!_ext.store(m_stack.back()) && m_stack[m_stack.size() - 2])
-				runGas = c_sstoreGas * 2;
-			else if (_ext.store(m_stack.back()) && !m_stack[m_stack.size() - 2])
-				runGas = 0;
-			else
-				runGas = c_sstoreGas;
-			break;
+	bytesConstRef memory() const { return m_temp.ref(); }
+	/// @returns a copy of the stack, bottom first.
+	u256s stack() const { u256s ret; for (auto const& i: m_stack) ret.push_back(i.toU256()); return ret; }
 
-		case Instruction::SLOAD:
-            runGas = c_sloadGas;
-			break;
+	/// Select the core that runs pre-decoded code from now on (in every VM). Tracing and stepping, code not yet decoded
+	/// and anything after a jump into PUSH data are always run by the switch core. Without threaded core support this
+	/// does nothing.
+	static void setCore(VMCore _core);
+	static VMCore core() { return s_core; }
 
-		// These all operate on memory and therefore potentially expand it:
-		case Instruction::MSTORE:
-			require(2);
-			newTempSize = (unsigned)m_stack.back() + 32;
-			break;
-		case Instruction::MSTORE8:
-			require(2);
-			newTempSize = (unsigned)m_stack.back() + 1;
-			break;
-		case Instruction::MLOAD:
-			require(1);
-			newTempSize = (unsigned)m_stack.back() + 32;
-			break;
-		case Instruction::RETURN:
-			require(2);
-			newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 2];
-			break;
-		case Instruction::SHA3:
-			require(2);
-			runGas = c_sha3Gas;
-			newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 2];
-			break;
-		case Instruction::CALLDATACOPY:
-			require(3);
-			newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 3];
-			break;
-		case Instruction::CODECOPY:
-			require(3);
-			newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 3];
-			break;
+	/// Have code pre-decoded (and analysed into basic blocks for the threaded core) once it's been run @a _runs times,
+	/// counted by its hash; until then it's interpreted a byte at a time. 0, the default, decodes everything before its
+	/// first run; ~0 nothing.
+	static void setDecodeAfter(unsigned _runs) { s_decodeAfter = _runs; }
+	static unsigned decodeAfter() { return s_decodeAfter; }
 
-		case Instruction::BALANCE:
-			runGas = c_balanceGas;
-			break;
+	/// Room is made for this many stack items up front; only deeper stacks ever reallocate.
+	static const unsigned c_stackReserve = 1024;
 
-		case Instruction::CALL:
-			require(7);
-			runGas = c_callGas + (unsigned)m_stack[m_stack.size() - 1];
-			newTempSize = std::max((unsigned)m_stack[m_stack.size() - 6] + (unsigned)m_stack[m_stack.size() - 7], (unsigned)m_stack[m_stack.size() - 4] + (unsigned)m_stack[m_stack.size() - 5]);
-			break;
+private:
+	/// Run the code from m_curPC on with the threaded core, leaving what it returns in @a o_out.
+	/// @returns false if it jumped into PUSH data, for the switch core to carry on from m_curPC.
+	template <class Ext> bool goThreaded(Ext& _ext, CodeAnalysis const& _analysis, bytesConstRef& o_out);
 
-		case Instruction::CREATE:
+	/// Pay what's due on reaching @a _op: its block's static fees if it starts one we can enter (and we're not in one
+	/// already), and whatever else it costs.
+	template <class Ext> void payFor(Ext& _ext, DecodedInstruction const& _op, unsigned& io_blockLeft)
+	{
+		if (!io_blockLeft && _op.block && m_gas >= _op.block->gas && m_stack.size() >= _op.block->required)
 		{
-			require(3);
-			unsigned inOff = (unsigned)m_stack[m_stack.size() - 2];
-			unsigned inSize = (unsigned)m_stack[m_stack.size() - 3];
-			newTempSize = inOff + inSize;
-            runGas = c_createGas;
-			break;
+			m_gas -= _op.block->gas;
+			io_blockLeft = _op.block->instructions;
 		}
-
-		default:
-			break;
+		bool paid = !!io_blockLeft;
+		if (paid)
+			--io_blockLeft;
+		if (!paid || _op.dynamicFee)
+		{
+			unsigned newTempSize;
+			w256 runGas = fee(_ext, _op.inst, paid, newTempSize);
+			charge(runGas, newTempSize);
 		}
+	}
+
+	/// Carry out @a _I, one of ETH_VM_STRAIGHT_OPS, with the stack and memory as they are; any calls and creations it makes
+	/// are traced with @a _onOp.
+	template <Instruction _I, class Ext> void execute(Ext& _ext, OnOpFunc const& _onOp);
 
-		newTempSize = (newTempSize + 31) / 32 * 32;
-		if (newTempSize > m_temp.size())
-			runGas += c_memoryGas * (newTempSize - m_temp.size()) / 32;
+	/// The PC a jump to @a _w goes to. Beyond 64 bits it's the last, where (as anywhere past the code) is STOP.
+	static uint64_t pcOf(w256 const& _w) { return _w.fits64() ? (uint64_t)_w : ~(uint64_t)0; }
 
-		if (_onOp)
-			_onOp(osteps - _steps - 1, inst, newTempSize > m_temp.size() ? (newTempSize - m_temp.size()) / 32 : 0, runGas, this, &_ext);
+	/// @returns the fee for @a _inst with the stack as it is, leaving in @a o_newTempSize the size memory would grow to.
+	/// If @a _paid, its static fee was paid with its block, so only the dynamic part is due.
+	template <class Ext> w256 fee(Ext& _ext, Instruction _inst, bool _paid, unsigned& o_newTempSize);
 
-		if (m_gas < runGas)
+	/// Take @a _runGas, or throw OutOfGas if there isn't enough; then grow memory to @a _newTempSize.
+	void charge(w256 const& _runGas, unsigned _newTempSize)
+	{
+		if (m_gas < _runGas)
 		{
 			// Out of gas!
 			m_gas = 0;
 			throw OutOfGas();
 		}
+		m_gas -= _runGas;
+		m_temp.grow(_newTempSize);
+	}
 
-		m_gas = (u256)((bigint)m_gas - runGas);
+	// All in fixed-width words: nothing in go()'s loop allocates save for the stack and memory growing.
+	w256 m_gas = 0;
+	uint64_t m_curPC = 0;
+	VMMemory m_temp;
+	std::vector<w256> m_stack;
 
-		if (newTempSize > m_temp.size())
-			m_temp.resize(newTempSize);
+	static VMCore s_core;
+	static unsigned s_decodeAfter;
+};
 
-		// EXECUTE...
-		switch (inst)
-		{
-		case Instruction::ADD:
-			//pops two items and pushes S[-1] + S[-2] mod 2^256.
-			require(2);
-			m_stack[m_stack.size() - 2] += m_stack.back();
-			m_stack.pop_back();
-			break;
-		case Instruction::MUL:
-			//pops two items and pushes S[-1] * S[-2] mod 2^256.
-			require(2);
-			m_stack[m_stack.size() - 2] *= m_stack.back();
-			m_stack.pop_back();
-			break;
-		case Instruction::SUB:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() - m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			break;
-		case Instruction::DIV:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack[m_stack.size() - 2] ? m_stack.back() / m_stack[m_stack.size() - 2] : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::SDIV:
-			require(2);
-            m_stack[m_stack.size() - 2] = m_stack[m_stack.size() - 2] ? s2u(u2s(m_stack.back()) / u2s(m_stack[m_stack.size() - 2])) : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::MOD:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack[m_stack.size() - 2] ? m_stack.back() % m_stack[m_stack.size() - 2] : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::SMOD:
-			require(2);
-            m_stack[m_stack.size() - 2] = m_stack[m_stack.size() - 2] ? s2u(u2s(m_stack.back()) % u2s(m_stack[m_stack.size() - 2])) : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::EXP:
-		{
-			require(2);
-			auto base = m_stack.back();
-			unsigned expon = (unsigned)m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			m_stack.back() = boost::multiprecision::pow(base, expon);
-			break;
-		}
-		case Instruction::NEG:
-			require(1);
-			m_stack.back() = ~(m_stack.back() - 1);
-			break;
-		case Instruction::LT:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() < m_stack[m_stack.size() - 2] ? 1 : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::GT:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() > m_stack[m_stack.size() - 2] ? 1 : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::SLT:
-			require(2);
-            m_stack[m_stack.size() - 2] = u2s(m_stack.back()) < u2s(m_stack[m_stack.size() - 2]) ? 1 : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::SGT:
-			require(2);
-            m_stack[m_stack.size() - 2] = u2s(m_stack.back()) > u2s(m_stack[m_stack.size() - 2]) ? 1 : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::EQ:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() == m_stack[m_stack.size() - 2] ? 1 : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::NOT:
-			require(1);
-			m_stack.back() = m_stack.back() ? 0 : 1;
-			break;
-		case Instruction::AND:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() & m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			break;
-		case Instruction::OR:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() | m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			break;
-		case Instruction::XOR:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() ^ m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			break;
-		case Instruction::BYTE:
-			require(2);
-			m_stack[m_stack.size() - 2] = m_stack.back() < 32 ? (m_stack[m_stack.size() - 2] >> (uint)(8 * (31 - m_stack.back()))) & 0xff : 0;
-			m_stack.pop_back();
-			break;
-		case Instruction::SHA3:
-		{
-			require(2);
-			unsigned inOff = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned inSize = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			m_stack.push_back(sha3(bytesConstRef(m_temp.data() + inOff, inSize)));
-			break;
-		}
-		case Instruction::ADDRESS:
-			m_stack.push_back(fromAddress(_ext.myAddress));
-			break;
-		case Instruction::ORIGIN:
-			m_stack.push_back(fromAddress(_ext.origin));
-			break;
-		case Instruction::BALANCE:
-		{
-			require(1);
-			m_stack.back() = _ext.balance(asAddress(m_stack.back()));
-			break;
-		}
-		case Instruction::CALLER:
-			m_stack.push_back(fromAddress(_ext.caller));
-			break;
-		case Instruction::CALLVALUE:
-			m_stack.push_back(_ext.value);
-			break;
-		case Instruction::CALLDATALOAD:
-		{
-			require(1);
-			if ((unsigned)m_stack.back() + 31 < _ext.data.size())
-				m_stack.back() = (u256)*(h256 const*)(_ext.data.data() + (unsigned)m_stack.back());
-			else
-			{
-				h256 r;
-				for (unsigned i = (unsigned)m_stack.back(), e = (unsigned)m_stack.back() + 32, j = 0; i < e; ++i, ++j)
-					r[j] = i < _ext.data.size() ? _ext.data[i] : 0;
-				m_stack.back() = (u256)r;
-			}
-			break;
-		}
-		case Instruction::CALLDATASIZE:
-			m_stack.push_back(_ext.data.size());
-			break;
-		case Instruction::CALLDATACOPY:
+/// Returns a VM to the pool of the thread that's done with it.
+struct VMRecycler { void operator()(VM* _vm) const; };
+using PooledVM = std::unique_ptr<VM, VMRecycler>;
+
+/// @returns a VM, reset to @a _gas, from this thread's pool (or a new one if it's empty). It goes back when the
+/// pointer is done with, so once a thread has run a call chain as deep as this one, neither the VMs nor their
+/// stacks and memories need allocating again.
+PooledVM pooledVM(u256 _gas);
+
+}
+
+// INLINE:
+template <class Ext> eth::bytesConstRef eth::VM::go(Ext& _ext, OnOpFunc const& _onOp, uint64_t _steps)
+{
+	if (!_onOp)
+	{
+		NoTracer t;
+		return run(_ext, t, _steps);
+	}
+	if (TraceRecorderHook const* h = _onOp.target<TraceRecorderHook>())
+		return run(_ext, *h->recorder, _steps);
+	OnOpTracer t(_onOp);
+	return run(_ext, t, _steps);
+}
+
+template <class Tracer, class Ext> eth::bytesConstRef eth::VM::run(Ext& _ext, Tracer& _tracer, uint64_t _steps)
+{
+	// Code that's run often enough is pre-decoded. Then, when neither tracing nor counting steps, we go a basic block at a
+	// time: whenever one starts here and there's enough gas and stack for the whole of it, its static fees are paid up
+	// front. An instruction inside such a block then pays only its dynamic fees (if any) and can't fail for want of
+	// stack. Running out of gas part way through is still possible, but since that reverts everything, where exactly it
+	// happens doesn't matter.
+	std::shared_ptr<CodeAnalysis const> analysis = Tracer::enabled || _steps != (uint64_t)-1 ? nullptr : CodeAnalysis::get(_ext.codeHash, _ext.code, s_decodeAfter);
+	unsigned blockLeft = 0;
+
+#if ETH_THREADED_VM
+	if (!Tracer::enabled && analysis && s_core == VMCore::Threaded)
+	{
+		bytesConstRef out;
+		if (goThreaded(_ext, *analysis, out))
+			return out;
+		// Jumped into PUSH data; we carry on from there.
+	}
+#endif
+
+	bytesConstRef code = _ext.code;
+	auto codeAt = [&](uint64_t _pc) { return _pc < code.size() ? code[_pc] : (byte)0; };
+
+	uint64_t nextPC = m_curPC + 1;
+	auto osteps = _steps;
+	for (bool stopped = false; !stopped && _steps--; m_curPC = nextPC, nextPC = m_curPC + 1)
+	{
+		// INSTRUCTION...
+		Instruction inst = (Instruction)codeAt(m_curPC);
+
+		if (!blockLeft && analysis)
+			if (BasicBlock const* b = analysis->blockAt(m_curPC))
+				if (m_gas >= b->gas && m_stack.size() >= b->required)
+				{
+					m_gas -= b->gas;
+					blockLeft = b->instructions;
+				}
+		bool paid = !!blockLeft;
+		if (paid)
+			--blockLeft;
+
+		// FEES...
+		if (!paid || hasDynamicFee(inst))
 		{
-			require(3);
-			unsigned mf = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned cf = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned l = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned el = cf + l > _ext.data.size() ? _ext.data.size() < cf ? 0 : _ext.data.size() - cf : l;
-			memcpy(m_temp.data() + mf, _ext.data.data() + cf, el);
-			memset(m_temp.data() + mf + el, 0, l - el);
-			break;
+			unsigned newTempSize;
+			w256 runGas = fee(_ext, inst, paid, newTempSize);
+			if (Tracer::enabled)
+				_tracer(osteps - _steps - 1, inst, newTempSize > m_temp.size() ? (newTempSize - m_temp.size()) / 32 : 0, runGas, *this, _ext);
+			charge(runGas, newTempSize);
 		}
-		case Instruction::CODESIZE:
-			m_stack.push_back(_ext.code.size());
-			break;
-		case Instruction::CODECOPY:
+
+		// EXECUTE...
+		switch (inst)
 		{
-			require(3);
-			unsigned mf = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned cf = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned l = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned el = cf + l > _ext.code.size() ? _ext.code.size() < cf ? 0 : _ext.code.size() - cf : l;
-			memcpy(m_temp.data() + mf, _ext.code.data() + cf, el);
-			memset(m_temp.data() + mf + el, 0, l - el);
-			break;
-		}
-		case Instruction::GASPRICE:
-			m_stack.push_back(_ext.gasPrice);
-			break;
-		case Instruction::PREVHASH:
-			m_stack.push_back(_ext.previousBlock.hash);
-			break;
-		case Instruction::COINBASE:
-			m_stack.push_back((u160)_ext.currentBlock.coinbaseAddress);
-			break;
-		case Instruction::TIMESTAMP:
-			m_stack.push_back(_ext.currentBlock.timestamp);
-			break;
-		case Instruction::NUMBER:
-			m_stack.push_back(_ext.currentBlock.number);
-			break;
-		case Instruction::DIFFICULTY:
-			m_stack.push_back(_ext.currentBlock.difficulty);
-			break;
-		case Instruction::GASLIMIT:
-			m_stack.push_back(1000000);
-			break;
+#define ETH_CASE(Name) case Instruction::Name: execute<Instruction::Name>(_ext, _tracer.nested()); break;
+		ETH_VM_STRAIGHT_OPS(ETH_CASE)
+#undef ETH_CASE
 		case Instruction::PUSH1:
 		case Instruction::PUSH2:
 		case Instruction::PUSH3:
@@ -429,154 +303,36 @@ template <class Ext> eth::bytesConstRef eth::VM::go(Ext& _ext, OnOpFunc const& _
 		case Instruction::PUSH31:
 		case Instruction::PUSH32:
 		{
-			int i = (int)inst - (int)Instruction::PUSH1 + 1;
-			nextPC = m_curPC + 1;
-			m_stack.push_back(0);
-			for (; i--; nextPC++)
-				m_stack.back() = (m_stack.back() << 8) | _ext.getCode(nextPC);
-			break;
-		}
-		case Instruction::POP:
-			require(1);
-			m_stack.pop_back();
-			break;
-		case Instruction::DUP:
-			require(1);
-			m_stack.push_back(m_stack.back());
-			break;
-		/*case Instruction::DUPN:
-		{
-			auto s = store(curPC + 1);
-			if (s == 0 || s > stack.size())
-				throw OperandOutOfRange(1, stack.size(), s);
-			stack.push_back(stack[stack.size() - (uint)s]);
-			nextPC = curPC + 2;
-			break;
-		}*/
-		case Instruction::SWAP:
-		{
-			require(2);
-			auto d = m_stack.back();
-			m_stack.back() = m_stack[m_stack.size() - 2];
-			m_stack[m_stack.size() - 2] = d;
-			break;
-		}
-		/*case Instruction::SWAPN:
-		{
-			require(1);
-			auto d = stack.back();
-			auto s = store(curPC + 1);
-			if (s == 0 || s > stack.size())
-				throw OperandOutOfRange(1, stack.size(), s);
-			stack.back() = stack[stack.size() - (uint)s];
-			stack[stack.size() - (uint)s] = d;
-			nextPC = curPC + 2;
-			break;
-		}*/
-		case Instruction::MLOAD:
-		{
-			require(1);
-			m_stack.back() = (u256)*(h256 const*)(m_temp.data() + (unsigned)m_stack.back());
-			break;
-		}
-		case Instruction::MSTORE:
-		{
-			require(2);
-			*(h256*)&m_temp[(unsigned)m_stack.back()] = (h256)m_stack[m_stack.size() - 2];
-			m_stack.pop_back();
-			m_stack.pop_back();
-			break;
-		}
-		case Instruction::MSTORE8:
-		{
-			require(2);
-			m_temp[(unsigned)m_stack.back()] = (byte)(m_stack[m_stack.size() - 2] & 0xff);
-			m_stack.pop_back();
-			m_stack.pop_back();
+			unsigned n = (unsigned)inst - (unsigned)Instruction::PUSH1 + 1;
+			uint64_t from = m_curPC + 1;
+			nextPC = from + n;
+			if (nextPC <= code.size())
+				m_stack.push_back(w256::fromBigEndian(code.cropped(from, n)));
+			else
+			{
+				// Past the end of the code is all zeroes.
+				byte b[32];
+				for (unsigned i = 0; i < n; ++i)
+					b[i] = codeAt(from + i);
+				m_stack.push_back(w256::fromBigEndian(bytesConstRef(b, n)));
+			}
 			break;
 		}
-		case Instruction::SLOAD:
-			require(1);
-			m_stack.back() = _ext.store(m_stack.back());
-			break;
-		case Instruction::SSTORE:
-			require(2);
-			_ext.setStore(m_stack.back(), m_stack[m_stack.size() - 2]);
-			m_stack.pop_back();
-			m_stack.pop_back();
-			break;
 		case Instruction::JUMP:
 			require(1);
-			nextPC = m_stack.back();
+			nextPC = pcOf(m_stack.back());
 			m_stack.pop_back();
 			break;
 		case Instruction::JUMPI:
 			require(2);
 			if (m_stack[m_stack.size() - 2])
-				nextPC = m_stack.back();
+				nextPC = pcOf(m_stack.back());
 			m_stack.pop_back();
 			m_stack.pop_back();
 			break;
 		case Instruction::PC:
 			m_stack.push_back(m_curPC);
 			break;
-		case Instruction::MSIZE:
-			m_stack.push_back(m_temp.size());
-			break;
-		case Instruction::GAS:
-			m_stack.push_back(m_gas);
-			break;
-		case Instruction::CREATE:
-		{
-			require(3);
-
-			u256 endowment = m_stack.back();
-			m_stack.pop_back();
-			unsigned initOff = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned initSize = (unsigned)m_stack.back();
-			m_stack.pop_back();
-
-			if (_ext.balance(_ext.myAddress) >= endowment)
-			{
-				_ext.subBalance(endowment);
-				m_stack.push_back((u160)_ext.create(endowment, &m_gas, bytesConstRef(m_temp.data() + initOff, initSize), _onOp));
-			}
-			else
-				m_stack.push_back(0);
-			break;
-		}
-		case Instruction::CALL:
-		{
-			require(7);
-
-			u256 gas = m_stack.back();
-			m_stack.pop_back();
-			u160 receiveAddress = asAddress(m_stack.back());
-			m_stack.pop_back();
-			u256 value = m_stack.back();
-			m_stack.pop_back();
-
-			unsigned inOff = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned inSize = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned outOff = (unsigned)m_stack.back();
-			m_stack.pop_back();
-			unsigned outSize = (unsigned)m_stack.back();
-			m_stack.pop_back();
-
-			if (_ext.balance(_ext.myAddress) >= value)
-			{
-				_ext.subBalance(value);
-				m_stack.push_back(_ext.call(receiveAddress, value, bytesConstRef(m_temp.data() + inOff, inSize), &gas, bytesRef(m_temp.data() + outOff, outSize), _onOp));
-			}
-			else
-				m_stack.push_back(0);
-
-			m_gas += gas;
-			break;
-		}
 		case Instruction::RETURN:
 		{
 			require(2);
@@ -589,12 +345,8 @@ template <class Ext> eth::bytesConstRef eth::VM::go(Ext& _ext, OnOpFunc const& _
 			return bytesConstRef(m_temp.data() + b, s);
 		}
 		case Instruction::SUICIDE:
-		{
-			require(1);
-			Address dest = asAddress(m_stack.back());
-			_ext.suicide(dest);
+			execute<Instruction::SUICIDE>(_ext, _tracer.nested());
 			// ...follow through to...
-		}
 		case Instruction::STOP:
 			return bytesConstRef();
 		default:
@@ -606,3 +358,546 @@ template <class Ext> eth::bytesConstRef eth::VM::go(Ext& _ext, OnOpFunc const& _
 	return bytesConstRef();
 }
 
+#if ETH_THREADED_VM
+template <class Ext> bool eth::VM::goThreaded(Ext& _ext, CodeAnalysis const& _analysis, bytesConstRef& o_out)
+{
+	// The handler of each instruction, by opcode. Each handler ends by paying for the next instruction and jumping
+	// straight to its handler, so that every one has its own indirect branch for the CPU to learn.
+	static void const* const c_handlers[256] =
+	{
+		&&l_STOP, &&l_ADD, &&l_MUL, &&l_SUB, &&l_DIV, &&l_SDIV, &&l_MOD, &&l_SMOD,
+		&&l_EXP, &&l_NEG, &&l_LT, &&l_GT, &&l_SLT, &&l_SGT, &&l_EQ, &&l_NOT,
+		&&l_AND, &&l_OR, &&l_XOR, &&l_BYTE, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_SHA3, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_ADDRESS, &&l_BALANCE, &&l_ORIGIN, &&l_CALLER, &&l_CALLVALUE, &&l_CALLDATALOAD, &&l_CALLDATASIZE, &&l_CALLDATACOPY,
+		&&l_CODESIZE, &&l_CODECOPY, &&l_GASPRICE, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_PREVHASH, &&l_COINBASE, &&l_TIMESTAMP, &&l_NUMBER, &&l_DIFFICULTY, &&l_GASLIMIT, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_POP, &&l_DUP, &&l_SWAP, &&l_MLOAD, &&l_MSTORE, &&l_MSTORE8, &&l_SLOAD, &&l_SSTORE,
+		&&l_JUMP, &&l_JUMPI, &&l_PC, &&l_MSIZE, &&l_GAS, &&l_bad, &&l_bad, &&l_bad,
+		&&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH,
+		&&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH,
+		&&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH,
+		&&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH, &&l_PUSH,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_CREATE, &&l_CALL, &&l_RETURN, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad,
+		&&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_bad, &&l_SUICIDE
+	};
+
+	DecodedInstruction const* op;
+	unsigned blockLeft = 0;
+	OnOpFunc const none;
+	uint64_t target = m_curPC;
+
+#define ETH_DISPATCH { payFor(_ext, *op, blockLeft); goto *c_handlers[(byte)op->inst]; }
+#define ETH_NEXT { ++op; ETH_DISPATCH; }
+
+	// Start from the current PC (normally the first) as though we'd jumped there.
+	goto jump;
+
+#define ETH_LABEL(Name) l_##Name: execute<Instruction::Name>(_ext, none); ETH_NEXT;
+	ETH_VM_STRAIGHT_OPS(ETH_LABEL)
+#undef ETH_LABEL
+
+	l_PUSH:
+		m_stack.push_back(op->immediate);
+		if (op->jump != CodeAnalysis::c_undecoded)
+		{
+			// Straight away jumped to: the JUMP(I) is paid for and checked as ever, but needn't look up where it goes.
+			unsigned to = op->jump;
+			++op;
+			payFor(_ext, *op, blockLeft);
+			if (op->inst == Instruction::JUMPI)
+			{
+				require(2);
+				bool go = !!m_stack[m_stack.size() - 2];
+				m_stack.pop_back();
+				m_stack.pop_back();
+				if (!go)
+					ETH_NEXT;
+			}
+			else
+				m_stack.pop_back();
+			op = &_analysis.decoded()[to];
+			ETH_DISPATCH;
+		}
+		ETH_NEXT;
+	l_JUMP:
+		require(1);
+		target = pcOf(m_stack.back());
+		m_stack.pop_back();
+		goto jump;
+	l_JUMPI:
+		require(2);
+		if (m_stack[m_stack.size() - 2])
+		{
+			target = pcOf(m_stack.back());
+			m_stack.pop_back();
+			m_stack.pop_back();
+			goto jump;
+		}
+		m_stack.pop_back();
+		m_stack.pop_back();
+		ETH_NEXT;
+	l_PC:
+		m_stack.push_back(op->pc);
+		ETH_NEXT;
+	l_RETURN:
+	{
+		require(2);
+
+		unsigned b = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned s = (unsigned)m_stack.back();
+		m_stack.pop_back();
+
+		o_out = bytesConstRef(m_temp.data() + b, s);
+		return true;
+	}
+	l_SUICIDE:
+		execute<Instruction::SUICIDE>(_ext, none);
+		// ...follow through to...
+	l_STOP:
+		o_out = bytesConstRef();
+		return true;
+	l_bad:
+		throw BadInstruction();
+
+	jump:
+	{
+		// JUMP and JUMPI end blocks, so there's none part-paid to worry about if we hand over.
+		unsigned i = _analysis.indexAt(target);
+		if (i == CodeAnalysis::c_undecoded)
+		{
+			m_curPC = target;
+			return false;
+		}
+		op = &_analysis.decoded()[i];
+		ETH_DISPATCH;
+	}
+
+#undef ETH_NEXT
+#undef ETH_DISPATCH
+}
+#endif
+
+template <eth::Instruction _I, class Ext> void eth::VM::execute(Ext& _ext, OnOpFunc const& _onOp)
+{
+	// _I is known at compile time: all but its own case goes.
+	switch (_I)
+	{
+	case Instruction::ADD:
+		//pops two items and pushes S[-1] + S[-2] mod 2^256.
+		require(2);
+		m_stack[m_stack.size() - 2] += m_stack.back();
+		m_stack.pop_back();
+		break;
+	case Instruction::MUL:
+		//pops two items and pushes S[-1] * S[-2] mod 2^256.
+		require(2);
+		m_stack[m_stack.size() - 2] *= m_stack.back();
+		m_stack.pop_back();
+		break;
+	case Instruction::SUB:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() - m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::DIV:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() / m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::SDIV:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back().sdiv(m_stack[m_stack.size() - 2]);
+		m_stack.pop_back();
+		break;
+	case Instruction::MOD:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() % m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::SMOD:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back().smod(m_stack[m_stack.size() - 2]);
+		m_stack.pop_back();
+		break;
+	case Instruction::EXP:
+	{
+		require(2);
+		auto base = m_stack.back();
+		unsigned expon = (unsigned)m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		m_stack.back() = base.pow(expon);
+		break;
+	}
+	case Instruction::NEG:
+		require(1);
+		m_stack.back() = -m_stack.back();
+		break;
+	case Instruction::LT:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() < m_stack[m_stack.size() - 2] ? 1 : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::GT:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() > m_stack[m_stack.size() - 2] ? 1 : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::SLT:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back().slt(m_stack[m_stack.size() - 2]) ? 1 : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::SGT:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back().sgt(m_stack[m_stack.size() - 2]) ? 1 : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::EQ:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() == m_stack[m_stack.size() - 2] ? 1 : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::NOT:
+		require(1);
+		m_stack.back() = m_stack.back() ? 0 : 1;
+		break;
+	case Instruction::AND:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() & m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::OR:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() | m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::XOR:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() ^ m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		break;
+	case Instruction::BYTE:
+		require(2);
+		m_stack[m_stack.size() - 2] = m_stack.back() < 32 ? m_stack[m_stack.size() - 2].byteAt((unsigned)m_stack.back()) : 0;
+		m_stack.pop_back();
+		break;
+	case Instruction::SHA3:
+	{
+		require(2);
+		unsigned inOff = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned inSize = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		m_stack.push_back(w256(sha3(bytesConstRef(m_temp.data() + inOff, inSize))));
+		break;
+	}
+	case Instruction::ADDRESS:
+		m_stack.push_back(toWord(_ext.myAddress));
+		break;
+	case Instruction::ORIGIN:
+		m_stack.push_back(toWord(_ext.origin));
+		break;
+	case Instruction::BALANCE:
+	{
+		require(1);
+		m_stack.back() = w256(_ext.balance(asAddress(m_stack.back())));
+		break;
+	}
+	case Instruction::CALLER:
+		m_stack.push_back(toWord(_ext.caller));
+		break;
+	case Instruction::CALLVALUE:
+		m_stack.push_back(w256(_ext.value));
+		break;
+	case Instruction::CALLDATALOAD:
+	{
+		require(1);
+		unsigned off = (unsigned)m_stack.back();
+		if (off + 31 < _ext.data.size())
+			m_stack.back() = w256::fromBigEndian(bytesConstRef(_ext.data.data() + off, 32));
+		else
+		{
+			h256 r;
+			for (unsigned i = off, e = off + 32, j = 0; i < e; ++i, ++j)
+				r[j] = i < _ext.data.size() ? _ext.data[i] : 0;
+			m_stack.back() = w256(r);
+		}
+		break;
+	}
+	case Instruction::CALLDATASIZE:
+		m_stack.push_back(_ext.data.size());
+		break;
+	case Instruction::CALLDATACOPY:
+	{
+		require(3);
+		unsigned mf = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned cf = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned l = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned el = cf + l > _ext.data.size() ? _ext.data.size() < cf ? 0 : _ext.data.size() - cf : l;
+		memcpy(m_temp.data() + mf, _ext.data.data() + cf, el);
+		memset(m_temp.data() + mf + el, 0, l - el);
+		break;
+	}
+	case Instruction::CODESIZE:
+		m_stack.push_back(_ext.code.size());
+		break;
+	case Instruction::CODECOPY:
+	{
+		require(3);
+		unsigned mf = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned cf = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned l = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned el = cf + l > _ext.code.size() ? _ext.code.size() < cf ? 0 : _ext.code.size() - cf : l;
+		memcpy(m_temp.data() + mf, _ext.code.data() + cf, el);
+		memset(m_temp.data() + mf + el, 0, l - el);
+		break;
+	}
+	case Instruction::GASPRICE:
+		m_stack.push_back(w256(_ext.gasPrice));
+		break;
+	case Instruction::PREVHASH:
+		m_stack.push_back(w256(_ext.previousBlock.hash));
+		break;
+	case Instruction::COINBASE:
+		m_stack.push_back(toWord(_ext.currentBlock.coinbaseAddress));
+		break;
+	case Instruction::TIMESTAMP:
+		m_stack.push_back(w256(_ext.currentBlock.timestamp));
+		break;
+	case Instruction::NUMBER:
+		m_stack.push_back(w256(_ext.currentBlock.number));
+		break;
+	case Instruction::DIFFICULTY:
+		m_stack.push_back(w256(_ext.currentBlock.difficulty));
+		break;
+	case Instruction::GASLIMIT:
+		m_stack.push_back(1000000);
+		break;
+	case Instruction::POP:
+		require(1);
+		m_stack.pop_back();
+		break;
+	case Instruction::DUP:
+		require(1);
+		m_stack.push_back(m_stack.back());
+		break;
+	/*case Instruction::DUPN:
+	{
+		auto s = store(curPC + 1);
+		if (s == 0 || s > stack.size())
+			throw OperandOutOfRange(1, stack.size(), s);
+		stack.push_back(stack[stack.size() - (uint)s]);
+		nextPC = curPC + 2;
+		break;
+	}*/
+	case Instruction::SWAP:
+	{
+		require(2);
+		std::swap(m_stack.back(), m_stack[m_stack.size() - 2]);
+		break;
+	}
+	/*case Instruction::SWAPN:
+	{
+		require(1);
+		auto d = stack.back();
+		auto s = store(curPC + 1);
+		if (s == 0 || s > stack.size())
+			throw OperandOutOfRange(1, stack.size(), s);
+		stack.back() = stack[stack.size() - (uint)s];
+		stack[stack.size() - (uint)s] = d;
+		nextPC = curPC + 2;
+		break;
+	}*/
+	case Instruction::MLOAD:
+	{
+		require(1);
+		m_stack.back() = w256::fromBigEndian(bytesConstRef(m_temp.data() + (unsigned)m_stack.back(), 32));
+		break;
+	}
+	case Instruction::MSTORE:
+	{
+		require(2);
+		m_stack[m_stack.size() - 2].toBigEndian(m_temp.data() + (unsigned)m_stack.back());
+		m_stack.pop_back();
+		m_stack.pop_back();
+		break;
+	}
+	case Instruction::MSTORE8:
+	{
+		require(2);
+		m_temp[(unsigned)m_stack.back()] = (byte)(unsigned)m_stack[m_stack.size() - 2];
+		m_stack.pop_back();
+		m_stack.pop_back();
+		break;
+	}
+	case Instruction::SLOAD:
+		require(1);
+		m_stack.back() = w256(_ext.store(m_stack.back().toU256()));
+		break;
+	case Instruction::SSTORE:
+		require(2);
+		_ext.setStore(m_stack.back().toU256(), m_stack[m_stack.size() - 2].toU256());
+		m_stack.pop_back();
+		m_stack.pop_back();
+		break;
+	case Instruction::MSIZE:
+		m_stack.push_back(m_temp.size());
+		break;
+	case Instruction::GAS:
+		m_stack.push_back(m_gas);
+		break;
+	case Instruction::CREATE:
+	{
+		require(3);
+
+		u256 endowment = m_stack.back().toU256();
+		m_stack.pop_back();
+		unsigned initOff = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned initSize = (unsigned)m_stack.back();
+		m_stack.pop_back();
+
+		if (_ext.balance(_ext.myAddress) >= endowment)
+		{
+			_ext.subBalance(endowment);
+			u256 gas = m_gas.toU256();
+			m_stack.push_back(toWord(_ext.create(endowment, &gas, bytesConstRef(m_temp.data() + initOff, initSize), _onOp)));
+			m_gas = w256(gas);
+		}
+		else
+			m_stack.push_back(0);
+		break;
+	}
+	case Instruction::CALL:
+	{
+		require(7);
+
+		u256 gas = m_stack.back().toU256();
+		m_stack.pop_back();
+		Address receiveAddress = asAddress(m_stack.back());
+		m_stack.pop_back();
+		u256 value = m_stack.back().toU256();
+		m_stack.pop_back();
+
+		unsigned inOff = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned inSize = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned outOff = (unsigned)m_stack.back();
+		m_stack.pop_back();
+		unsigned outSize = (unsigned)m_stack.back();
+		m_stack.pop_back();
+
+		if (_ext.balance(_ext.myAddress) >= value)
+		{
+			_ext.subBalance(value);
+			m_stack.push_back(_ext.call(receiveAddress, value, bytesConstRef(m_temp.data() + inOff, inSize), &gas, bytesRef(m_temp.data() + outOff, outSize), _onOp));
+		}
+		else
+			m_stack.push_back(0);
+
+		m_gas += w256(gas);
+		break;
+	}
+	case Instruction::SUICIDE:
+		require(1);
+		_ext.suicide(asAddress(m_stack.back()));
+		break;
+	default:
+		break;
+	}
+}
+
+template <class Ext> eth::w256 eth::VM::fee(Ext& _ext, Instruction _inst, bool _paid, unsigned& o_newTempSize)
+{
+	w256 runGas = _paid ? w256() : staticFee(_inst);
+	unsigned newTempSize = (unsigned)m_temp.size();
+	switch (_inst)
+	{
+	case Instruction::SSTORE:
+		require(2);
+		runGas = sstoreFee(!!_ext.store(m_stack.back().toU256()), !!m_stack[m_stack.size() - 2]);
+		break;
+
+	// These all operate on memory and therefore potentially expand it:
+	case Instruction::MSTORE:
+		require(2);
+		newTempSize = (unsigned)m_stack.back() + 32;
+		break;
+	case Instruction::MSTORE8:
+		require(2);
+		newTempSize = (unsigned)m_stack.back() + 1;
+		break;
+	case Instruction::MLOAD:
+		require(1);
+		newTempSize = (unsigned)m_stack.back() + 32;
+		break;
+	case Instruction::RETURN:
+		require(2);
+		newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 2];
+		break;
+	case Instruction::SHA3:
+		require(2);
+		newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 2];
+		break;
+	case Instruction::CALLDATACOPY:
+		require(3);
+		newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 3];
+		break;
+	case Instruction::CODECOPY:
+		require(3);
+		newTempSize = (unsigned)m_stack.back() + (unsigned)m_stack[m_stack.size() - 3];
+		break;
+
+	case Instruction::CALL:
+		require(7);
+		runGas += (unsigned)m_stack[m_stack.size() - 1];	// NB only the low bits of the gas given the call.
+		newTempSize = std::max((unsigned)m_stack[m_stack.size() - 6] + (unsigned)m_stack[m_stack.size() - 7], (unsigned)m_stack[m_stack.size() - 4] + (unsigned)m_stack[m_stack.size() - 5]);
+		break;
+
+	case Instruction::CREATE:
+	{
+		require(3);
+		unsigned inOff = (unsigned)m_stack[m_stack.size() - 2];
+		unsigned inSize = (unsigned)m_stack[m_stack.size() - 3];
+		newTempSize = inOff + inSize;
+		break;
+	}
+
+	default:
+		break;
+	}
+
+	newTempSize = (newTempSize + 31) / 32 * 32;
+	if (newTempSize > m_temp.size())
+		runGas += memoryFee((newTempSize - (unsigned)m_temp.size()) / 32);
+	o_newTempSize = newTempSize;
+	return runGas;
+}
+
+#undef ETH_VM_STRAIGHT_OPS
@@ -0,0 +1,163 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMMemory.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "VMMemory.h"
+
+#include <atomic>
+#include <cstring>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+#include <libethential/Log.h>
+using namespace std;
+using namespace eth;
+
+/// How much address space to reserve to begin with (and after clear()). Every pooled VM keeps this much, so it's
+/// enough for most code rather than all of it.
+static const size_t c_reserve = 256 * 1024;
+
+/// The most address space a reservation grows to; beyond it memory goes on the heap. Memory costs gas, so real code
+/// stays far below this.
+static const size_t c_maxReserve = sizeof(void*) >= 8 ? 256 * 1024 * 1024 : 16 * 1024 * 1024;
+
+/// Up to this much used memory is zeroed in place on clear(); beyond it the pages go back to the OS.
+static const size_t c_keepResident = 64 * 1024;
+
+#ifndef _WIN32
+static int mapFlags()
+{
+	int ret = MAP_PRIVATE | MAP_ANONYMOUS;
+#ifdef MAP_NORESERVE
+	ret |= MAP_NORESERVE;
+#endif
+	return ret;
+}
+
+/// @returns a fresh span of @a _bytes of zeroed pages, or nullptr (having said so, the first time) if the OS won't
+/// give it, as under strict overcommit accounting.
+static byte* mapFresh(size_t _bytes)
+{
+	void* p = mmap(nullptr, _bytes, PROT_READ | PROT_WRITE, mapFlags(), -1, 0);
+	if (p != MAP_FAILED)
+		return (byte*)p;
+	static atomic<bool> s_noted(false);
+	if (!s_noted.exchange(true))
+		cwarn << "Couldn't reserve" << _bytes << "bytes of address space for VM memory; falling back to the heap.";
+	return nullptr;
+}
+#endif
+
+VMMemory::VMMemory()
+{
+	reserve(c_reserve);
+	m_data = m_map;
+}
+
+VMMemory::~VMMemory()
+{
+#ifndef _WIN32
+	if (m_map)
+		munmap(m_map, m_reserved);
+#endif
+}
+
+void VMMemory::reserve(size_t _bytes)
+{
+#ifndef _WIN32
+	if (m_map)
+		munmap(m_map, m_reserved);
+	m_map = mapFresh(_bytes);
+	m_reserved = m_map ? _bytes : 0;
+#else
+	(void)_bytes;
+#endif
+}
+
+void VMMemory::grow(size_t _size)
+{
+	if (_size <= m_size)
+		return;
+	if (inPlace() && _size <= m_reserved)
+	{
+		m_size = _size;
+		return;
+	}
+#ifndef _WIN32
+	if (inPlace() && _size <= c_maxReserve)
+	{
+		// Outgrown the reservation: move to one at least twice the size. Only what's used need be copied.
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t n = min(c_maxReserve, max(m_reserved * 2, (_size + page - 1) / page * page));
+		if (byte* p = mapFresh(n))
+		{
+			memcpy(p, m_map, m_size);
+			munmap(m_map, m_reserved);
+			m_map = m_data = p;
+			m_reserved = n;
+			m_size = _size;
+			return;
+		}
+	}
+#endif
+	if (inPlace())
+	{
+		// Outgrown any reservation: move over to the heap.
+		m_heap.assign(m_data, m_data + m_size);
+		wipeMap(m_size);
+	}
+	m_heap.resize(_size);
+	m_data = m_heap.data();
+	m_size = _size;
+}
+
+void VMMemory::clear()
+{
+	bool wasInPlace = inPlace();
+	if (m_map && m_reserved > c_reserve)
+		reserve(c_reserve);		// Grown for an outsized one-off; go back to a small span of fresh pages.
+	else if (wasInPlace)
+		wipeMap(m_size);
+	if (!wasInPlace)
+	{
+		if (m_map)
+			bytes().swap(m_heap);	// An outsized one-off; don't hang on to it.
+		else
+			m_heap.clear();			// Keeps its capacity for next time.
+	}
+	m_data = m_map ? m_map : m_heap.data();
+	m_size = 0;
+}
+
+void VMMemory::wipeMap(size_t _used)
+{
+#ifndef _WIN32
+	if (_used > c_keepResident)
+	{
+		// Map fresh pages over the old ones: they read as zero and cost nothing until touched.
+		size_t page = sysconf(_SC_PAGESIZE);
+		size_t n = min(m_reserved, (_used + page - 1) / page * page);
+		if (mmap(m_map, n, PROT_READ | PROT_WRITE, mapFlags() | MAP_FIXED, -1, 0) != MAP_FAILED)
+			return;
+	}
+#endif
+	memset(m_map, 0, _used);
+}
@@ -0,0 +1,75 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMMemory.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <libethential/Common.h>
+
+namespace eth
+{
+
+/**
+ * @brief A VM's memory: bytes that only grow (until clear()), every one of them zero until written.
+ * Where it can, it reserves a span of address space, which the OS backs with zeroed pages only as they're touched;
+ * growing within it is then just moving the end, with nothing copied or filled. The span starts small, since every
+ * pooled VM keeps one, and is replaced by one at least twice the size whenever it's outgrown (up to a limit), going
+ * back to the small one on clear(). Beyond the limit (or if no span could be had) the memory lives in an ordinary
+ * heap buffer.
+ */
+class VMMemory
+{
+public:
+	VMMemory();
+	~VMMemory();
+	VMMemory(VMMemory const&) = delete;
+	VMMemory& operator=(VMMemory const&) = delete;
+
+	byte* data() { return m_data; }
+	byte const* data() const { return m_data; }
+	size_t size() const { return m_size; }
+	bytesConstRef ref() const { return bytesConstRef(m_data, m_size); }
+	byte& operator[](size_t _i) { return m_data[_i]; }
+
+	/// Grow to @a _size bytes if smaller; the new ones are zero.
+	void grow(size_t _size);
+
+	/// Empty it, ready to be used afresh. Zeroes what was used, or if that was a lot, hands it back to the OS.
+	void clear();
+
+	/// @returns true if the memory is in the reservation (and thus grows without being filled).
+	bool inPlace() const { return m_data == m_map && m_map; }
+	/// @returns the size of the reservation; 0 if there's none.
+	size_t reserved() const { return m_reserved; }
+
+private:
+	/// Replace the reservation (if any) with a fresh one of @a _bytes, or none if it can't be had.
+	void reserve(size_t _bytes);
+	/// Zero the first @a _used bytes of the reservation.
+	void wipeMap(size_t _used);
+
+	byte* m_map = nullptr;		///< The reserved span, or null if we couldn't have one.
+	size_t m_reserved = 0;
+	byte* m_data = nullptr;		///< Either m_map or m_heap's data.
+	size_t m_size = 0;
+	bytes m_heap;
+};
+
+}
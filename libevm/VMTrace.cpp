@@ -0,0 +1,125 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMTrace.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#include "VMTrace.h"
+
+#include <iostream>
+#include <iomanip>
+#include "VM.h"
+using namespace std;
+using namespace eth;
+
+/// What a dump starts with.
+static const char c_magic[4] = {'E', 'V', 'M', 'T'};
+
+/// Bytes per instruction in a dump: opcode, depth, PC and gas, big-endian.
+static const unsigned c_entrySize = 1 + 2 + 8 + 8;
+
+/// Entries made room for up front when reading a dump; any more and the vector grows as they're read.
+static const uint64_t c_maxReserved = 65536;
+
+static void putBE(byte* o_p, uint64_t _v, unsigned _bytes)
+{
+	for (unsigned i = _bytes; i--; _v >>= 8)
+		o_p[i] = (byte)_v;
+}
+
+static uint64_t getBE(byte const* _p, unsigned _bytes)
+{
+	uint64_t ret = 0;
+	for (unsigned i = 0; i < _bytes; ++i)
+		ret = (ret << 8) | _p[i];
+	return ret;
+}
+
+void TraceRecorderHook::operator()(uint64_t, Instruction _inst, unsigned, bigint, void* _vm, void const* _ext) const
+{
+	VM const& vm = *static_cast<VM const*>(_vm);
+	recorder->record(_inst, vm.pc(), vm.gasWord(), static_cast<ExtVMFace const*>(_ext)->level);
+}
+
+TraceRecorder::TraceRecorder(unsigned _capacity)
+{
+	unsigned n = 1;
+	while (n < _capacity)
+		n *= 2;
+	m_ring.resize(n);
+	m_onOp = TraceRecorderHook{this};
+}
+
+std::vector<TraceEntry> TraceRecorder::entries() const
+{
+	uint64_t n = std::min<uint64_t>(m_total, m_ring.size());
+	std::vector<TraceEntry> ret;
+	ret.reserve(n);
+	for (uint64_t i = m_total - n; i < m_total; ++i)
+		ret.push_back(m_ring[i & (m_ring.size() - 1)]);
+	return ret;
+}
+
+void TraceRecorder::writeBinary(std::ostream& _out) const
+{
+	auto es = entries();
+	byte header[8];
+	memcpy(header, c_magic, 4);
+	putBE(header + 4, es.size(), 4);
+	_out.write((char const*)header, 8);
+	for (auto const& e: es)
+	{
+		byte b[c_entrySize];
+		b[0] = (byte)e.inst;
+		putBE(b + 1, e.depth, 2);
+		putBE(b + 3, e.pc, 8);
+		putBE(b + 11, e.gas, 8);
+		_out.write((char const*)b, c_entrySize);
+	}
+}
+
+std::vector<TraceEntry> TraceRecorder::readBinary(std::istream& _in)
+{
+	byte header[8];
+	if (!_in.read((char*)header, 8) || memcmp(header, c_magic, 4))
+		throw BadTrace();
+	// The count is only as good as the stream it came from; entries are read one by one until it runs out.
+	uint64_t count = getBE(header + 4, 4);
+	std::vector<TraceEntry> ret;
+	ret.reserve(std::min<uint64_t>(count, c_maxReserved));
+	for (uint64_t i = 0; i < count; ++i)
+	{
+		byte b[c_entrySize];
+		if (!_in.read((char*)b, c_entrySize))
+			throw BadTrace();
+		ret.push_back(TraceEntry());
+		TraceEntry& e = ret.back();
+		e.inst = (Instruction)b[0];
+		e.depth = (uint16_t)getBE(b + 1, 2);
+		e.pc = getBE(b + 3, 8);
+		e.gas = getBE(b + 11, 8);
+	}
+	return ret;
+}
+
+std::ostream& eth::operator<<(std::ostream& _out, TraceEntry const& _e)
+{
+	auto it = c_instructionInfo.find(_e.inst);
+	_out << std::string(_e.depth, ' ') << std::setw(2) << _e.depth << " " << std::hex << std::setfill('0') << std::setw(4) << _e.pc << std::dec << std::setfill(' ') << " : " << (it != c_instructionInfo.end() ? it->second.name : "INVALID") << " | " << _e.gas;
+	return _out;
+}
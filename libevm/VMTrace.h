@@ -0,0 +1,134 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file VMTrace.h
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ */
+
+#pragma once
+
+#include <iosfwd>
+#include <libethential/Exceptions.h>
+#include <libethential/W256.h>
+#include <libevmface/Instruction.h>
+#include "ExtVMFace.h"
+
+namespace eth
+{
+
+class BadTrace: public Exception {};
+
+// Tracer policies for VM::run(). If a tracer is enabled, it's called as tracer(steps, inst, newMemWords, gasCost, vm, ext)
+// before each instruction is paid for and run. nested() is the OnOpFunc handed on to the calls and creations it makes.
+
+/// The tracer that isn't: with it, VM::run() has no tracing in it at all.
+struct NoTracer
+{
+	static const bool enabled = false;
+
+	template <class VMType, class Ext> void operator()(uint64_t, Instruction, unsigned, w256 const&, VMType&, Ext const&) {}
+	OnOpFunc const& nested() const { static OnOpFunc const s_none; return s_none; }
+};
+
+/// Calls an OnOpFunc, as VM::go() always used to.
+struct OnOpTracer
+{
+	static const bool enabled = true;
+
+	explicit OnOpTracer(OnOpFunc const& _onOp): m_onOp(_onOp) {}
+
+	template <class VMType, class Ext> void operator()(uint64_t _steps, Instruction _inst, unsigned _newMemWords, w256 const& _gasCost, VMType& _vm, Ext const& _ext) { m_onOp(_steps, _inst, _newMemWords, (bigint)_gasCost.toU256(), &_vm, static_cast<ExtVMFace const*>(&_ext)); }
+	OnOpFunc const& nested() const { return m_onOp; }
+
+private:
+	OnOpFunc const& m_onOp;
+};
+
+/// One instruction, as recorded by a TraceRecorder.
+struct TraceEntry
+{
+	bool operator==(TraceEntry const& _c) const { return pc == _c.pc && gas == _c.gas && depth == _c.depth && inst == _c.inst; }
+
+	uint64_t pc = 0;
+	uint64_t gas = 0;			///< Gas left before it was paid for; all ones if beyond 64 bits.
+	uint16_t depth = 0;			///< 0 for a transaction's own code, 1 for that of a call it makes and so on.
+	Instruction inst = Instruction::STOP;
+};
+
+class TraceRecorder;
+
+/// What TraceRecorder::onOp() wraps, so that a VM given it can find the recorder and call it directly.
+struct TraceRecorderHook
+{
+	void operator()(uint64_t, Instruction _inst, unsigned, bigint, void* _vm, void const* _ext) const;
+	TraceRecorder* recorder;
+};
+
+/**
+ * @brief A tracer that keeps the last so many instructions run, in a ring of fixed-size binary entries, for
+ * dumping after the fact. Recording is a handful of stores into memory allocated up front.
+ * Hand onOp() to anything taking an OnOpFunc (e.g. Executive::go()); a VM given it, at any depth, records directly.
+ */
+class TraceRecorder
+{
+public:
+	static const bool enabled = true;
+
+	/// Keeps the last @a _capacity instructions, rounded up to a power of two.
+	explicit TraceRecorder(unsigned _capacity = 65536);
+	TraceRecorder(TraceRecorder const&) = delete;
+	TraceRecorder& operator=(TraceRecorder const&) = delete;
+
+	template <class VMType, class Ext> void operator()(uint64_t, Instruction _inst, unsigned, w256 const&, VMType& _vm, Ext const& _ext) { record(_inst, _vm.pc(), _vm.gasWord(), _ext.level); }
+	OnOpFunc const& nested() const { return m_onOp; }
+
+	void record(Instruction _inst, uint64_t _pc, w256 const& _gas, unsigned _depth)
+	{
+		TraceEntry& e = m_ring[m_total++ & (m_ring.size() - 1)];
+		e.pc = _pc;
+		e.gas = _gas.fits64() ? (uint64_t)_gas : ~(uint64_t)0;
+		e.depth = (uint16_t)_depth;
+		e.inst = _inst;
+	}
+
+	/// @returns the OnOpFunc that records here.
+	OnOpFunc const& onOp() const { return m_onOp; }
+
+	/// @returns how many instructions have been recorded in all, kept or not.
+	uint64_t total() const { return m_total; }
+
+	/// @returns the instructions kept, oldest first.
+	std::vector<TraceEntry> entries() const;
+
+	void clear() { m_total = 0; }
+
+	/// Write the instructions kept, oldest first, in a compact binary form that readBinary() reads.
+	void writeBinary(std::ostream& _out) const;
+
+	/// @returns the instructions written by writeBinary(). Throws BadTrace if it's not such a dump.
+	static std::vector<TraceEntry> readBinary(std::istream& _in);
+
+private:
+	std::vector<TraceEntry> m_ring;
+	uint64_t m_total = 0;
+	OnOpFunc m_onOp;
+};
+
+/// Human-readable, one instruction per line.
+std::ostream& operator<<(std::ostream& _out, TraceEntry const& _e);
+
+}
@@ -0,0 +1,75 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file byteBoundedLRU.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * Node and code cache test functions.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethcore/NodeCache.h>
+#include <libethcore/SHA3.h>
+#include <libethereum/CodeCache.h>
+using namespace std;
+using namespace eth;
+
+BOOST_AUTO_TEST_CASE(nodeCache)
+{
+	cnote << "Testing the node cache...";
+	NodeCache c(10);
+	c.insert(h256(1), "aaaa");
+	c.insert(h256(2), "bbbb");
+	BOOST_REQUIRE_EQUAL(c.lookup(h256(1)), "aaaa");
+
+	// 2 is now the least recently used, so it goes to make room.
+	c.insert(h256(3), "cccc");
+	BOOST_REQUIRE(c.lookup(h256(2)).empty());
+	BOOST_REQUIRE_EQUAL(c.lookup(h256(3)), "cccc");
+
+	// Too big to hold at all.
+	c.insert(h256(4), std::string(11, 'd'));
+	BOOST_REQUIRE(c.lookup(h256(4)).empty());
+
+	c.erase(h256(1));
+	BOOST_REQUIRE(c.lookup(h256(1)).empty());
+	CacheStats s = c.stats();
+	BOOST_REQUIRE_EQUAL(s.entries, 1u);
+	BOOST_REQUIRE_EQUAL(s.bytes, 4u);
+	BOOST_REQUIRE_EQUAL(s.evictions, 1u);
+	BOOST_REQUIRE_EQUAL(s.hits, 2u);
+	BOOST_REQUIRE_EQUAL(s.misses, 3u);
+
+	c.setCapacity(3);
+	BOOST_REQUIRE(c.lookup(h256(3)).empty());
+	BOOST_REQUIRE_EQUAL(c.stats().bytes, 0u);
+}
+
+BOOST_AUTO_TEST_CASE(codeCache)
+{
+	cnote << "Testing the code cache...";
+	bytes code = fromHex("600160015700");
+	h256 h = sha3(code);
+
+	// Inserted twice, the code is held once and handed out as the same buffer.
+	SharedCode a = CodeCache::insert(h, &code);
+	SharedCode b = CodeCache::insert(h, &code);
+	BOOST_REQUIRE(a == b);
+	BOOST_REQUIRE(*a == code);
+	BOOST_REQUIRE(CodeCache::lookup(h) == a);
+	BOOST_REQUIRE(!CodeCache::lookup(sha3(h.asBytes())));
+}
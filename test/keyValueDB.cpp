@@ -0,0 +1,144 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file keyValueDB.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * KeyValueDB test functions.
+ */
+
+#include <fstream>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethential/CommonIO.h>
+#include <libethcore/KeyValueDB.h>
+#include <libethcore/LogDB.h>
+using namespace std;
+using namespace eth;
+
+namespace
+{
+
+std::string tempPath(std::string const& _name)
+{
+	auto p = boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ethtest-" + _name + "-%%%%%%");
+	return p.string();
+}
+
+std::vector<std::string> keysFrom(KeyValueView const& _db, std::string const& _from)
+{
+	std::vector<std::string> ret;
+	_db.forEach(_from, [&](bytesConstRef _k, bytesConstRef) { ret.push_back(_k.toString()); return true; });
+	return ret;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(keyValueDB)
+{
+	cnote << "Testing KeyValueDB...";
+
+	for (DBEngine e: {DBEngine::LevelDB, DBEngine::Memory, DBEngine::Log})
+	{
+		std::string path = tempPath("kv");
+		{
+			auto db = KeyValueDB::open(e, path);
+			BOOST_REQUIRE(db->get(std::string("a")).empty());
+
+			DBBatch b;
+			for (unsigned i = 0; i < 100; ++i)
+				b.put(toString(1000 + i), toString(i * i));
+			b.put(std::string("gone"), std::string("soon"));
+			b.del(std::string("gone"));
+			db->write(b, true);
+			BOOST_REQUIRE_EQUAL(db->get(std::string("1042")), "1764");
+			BOOST_REQUIRE(db->get(std::string("gone")).empty());
+
+			// Snapshots see neither later writes nor deletions.
+			auto s = db->snapshot();
+			db->put(std::string("1042"), std::string("x"));
+			db->del(std::string("1043"));
+			db->put(std::string("2000"), std::string("y"));
+			BOOST_REQUIRE_EQUAL(db->get(std::string("1042")), "x");
+			BOOST_REQUIRE(db->get(std::string("1043")).empty());
+			BOOST_REQUIRE_EQUAL(s->get(std::string("1042")), "1764");
+			BOOST_REQUIRE_EQUAL(s->get(std::string("1043")), "1849");
+			BOOST_REQUIRE(s->get(std::string("2000")).empty());
+
+			// Each of several snapshots sees the DB as it was when it was taken.
+			auto s2 = db->snapshot();
+			db->put(std::string("1042"), std::string("z"));
+			BOOST_REQUIRE_EQUAL(s->get(std::string("1042")), "1764");
+			BOOST_REQUIRE_EQUAL(s2->get(std::string("1042")), "x");
+			s2.reset();
+			BOOST_REQUIRE_EQUAL(db->get(std::string("1042")), "z");
+			db->put(std::string("1042"), std::string("x"));
+
+			// Iteration is in order, from the given key.
+			auto ks = keysFrom(*db, "1095");
+			BOOST_REQUIRE((ks == std::vector<std::string>{"1095", "1096", "1097", "1098", "1099", "2000"}));
+			BOOST_REQUIRE_EQUAL(keysFrom(*db, "").size(), 100u);
+			BOOST_REQUIRE_EQUAL(keysFrom(*s, "").size(), 100u);
+			BOOST_REQUIRE_EQUAL(keysFrom(*s, "1099").size(), 1u);
+		}
+
+		if (e != DBEngine::Memory)
+		{
+			// What was written is still there when reopened.
+			auto db = KeyValueDB::open(e, path);
+			BOOST_REQUIRE_EQUAL(db->get(std::string("1042")), "x");
+			BOOST_REQUIRE(db->get(std::string("1043")).empty());
+			BOOST_REQUIRE_EQUAL(db->get(std::string("1099")), "9801");
+		}
+		boost::filesystem::remove_all(path);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(logDBTornBatch)
+{
+	cnote << "Testing LogDB recovery...";
+
+	std::string path = tempPath("log");
+	{
+		LogDB db(path);
+		db.put(std::string("a"), std::string("1"));
+		db.put(std::string("b"), std::string("2"));
+	}
+	auto size = boost::filesystem::file_size(path + "/log");
+	{
+		// A crash part way through appending a batch.
+		LogDB db(path);
+		DBBatch b;
+		b.put(std::string("c"), std::string(1000, 'c'));
+		b.del(std::string("a"));
+		db.write(b);
+	}
+	boost::filesystem::resize_file(path + "/log", size + 500);
+	{
+		LogDB db(path);
+		BOOST_REQUIRE_EQUAL(db.get(std::string("a")), "1");
+		BOOST_REQUIRE(db.get(std::string("c")).empty());
+		BOOST_REQUIRE_EQUAL(boost::filesystem::file_size(path + "/log"), size);
+		db.put(std::string("d"), std::string("4"));
+	}
+	{
+		LogDB db(path);
+		BOOST_REQUIRE_EQUAL(db.get(std::string("b")), "2");
+		BOOST_REQUIRE_EQUAL(db.get(std::string("d")), "4");
+	}
+	boost::filesystem::remove_all(path);
+}
@@ -0,0 +1,130 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file pruning.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * State DB pruning test functions.
+ */
+
+#include <map>
+#include <set>
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethential/CommonIO.h>
+#include <libethcore/KeyValueDB.h>
+#include <libethcore/OverlayDB.h>
+#include <libethcore/TrieDB.h>
+using namespace std;
+using namespace eth;
+
+namespace
+{
+
+/// The keys of all nodes (those 32 bytes long) in @a _db.
+std::set<h256> nodesIn(KeyValueDB const& _db)
+{
+	std::set<h256> ret;
+	_db.forEach(bytesConstRef(), [&](bytesConstRef _k, bytesConstRef) { if (_k.size() == 32) ret.insert(h256(_k.data(), h256::ConstructFromPointer)); return true; });
+	return ret;
+}
+
+/// A value of block @a _n's state, long enough that the leaf holding it is a node of its own.
+std::string valueOf(unsigned _n, unsigned _i, std::string const& _fork = std::string())
+{
+	return "value " + toString(_i) + " as of block " + toString(_n) + _fork + std::string(16, '.');
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(pruning)
+{
+	cnote << "Testing state DB pruning...";
+
+	unsigned const history = 8;
+	unsigned const blocks = 40;
+	unsigned const keys = 20;
+
+	OverlayDB db(KeyValueDB::open(DBEngine::Memory, std::string()).release());
+	db.setPruning(history);
+	GenericTrieDB<OverlayDB> t(&db);
+	t.init();
+	for (unsigned i = 0; i < keys; ++i)
+		t.insert(toString(i), valueOf(0, i));
+	db.commit();
+	h256 genesis = t.root();
+
+	// Each block changes a few values and adds one; every fifth has a sibling off the canonical chain.
+	std::vector<h256> ids{sha3("block 0")};
+	std::vector<h256> roots{genesis};
+	std::map<unsigned, h256> forkRoots;
+	auto makeBlock = [&](unsigned _n, std::string const& _fork)
+	{
+		db.startJournal();
+		t.setRoot(roots[_n - 1]);
+		for (unsigned i = _n % 7; i < keys; i += 7)
+			t.insert(toString(i), valueOf(_n, i, _fork));
+		t.insert(toString(keys + _n), valueOf(_n, keys + _n, _fork));
+		if (_n % 3 == 0)
+			t.remove(toString(keys + _n - 2));
+		h256 id = sha3("block " + toString(_n) + _fork);
+		db.commit(_n, id);
+		return id;
+	};
+	for (unsigned n = 1; n <= blocks; ++n)
+	{
+		if (n % 5 == 0)
+		{
+			makeBlock(n, " (fork)");
+			forkRoots[n] = t.root();
+		}
+		ids.push_back(makeBlock(n, std::string()));
+		roots.push_back(t.root());
+
+		// Look up an old root through the node cache, so it's there to be (wrongly) found once pruned.
+		BOOST_REQUIRE(!db.lookup(roots[n - 1]).empty());
+		if (n > history)
+			db.prune(n - history, [&](unsigned _n) { return ids[_n]; });
+	}
+
+	// The states of the last blocks are whole, and together with genesis and the forks not yet pruned they account for
+	// every node left on disk.
+	std::set<h256> left = nodesIn(*db.db());
+	auto keep = [&](h256 const& _root)
+	{
+		t.setRoot(_root);
+		t.descendKey(_root, left, false, nullptr);
+	};
+	for (unsigned n = blocks - history; n <= blocks; ++n)
+	{
+		keep(roots[n]);
+		for (unsigned i = 0; i < keys; ++i)
+			BOOST_REQUIRE(!t.at(toString(i)).empty());
+		BOOST_REQUIRE_EQUAL(t.at(toString(keys + n)), valueOf(n, keys + n));
+		if (forkRoots.count(n))
+			keep(forkRoots[n]);
+	}
+	keep(genesis);
+	BOOST_REQUIRE(left.empty());
+
+	// Older states are gone, from the disk and from the node cache alike.
+	for (unsigned n = 1; n < blocks - history; ++n)
+		if (roots[n] != genesis)
+		{
+			BOOST_REQUIRE(db.db()->get(roots[n].ref()).empty());
+			BOOST_REQUIRE(db.lookup(roots[n]).empty());
+		}
+}
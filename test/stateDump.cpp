@@ -0,0 +1,102 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file stateDump.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * StateDump test functions.
+ */
+
+#include <sstream>
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethcore/Exceptions.h>
+#include <libethereum/State.h>
+#include <libethereum/StateDump.h>
+using namespace std;
+using namespace eth;
+
+BOOST_AUTO_TEST_CASE(stateDump)
+{
+	cnote << "Testing StateDump...";
+
+	// A state with plain accounts, two contracts sharing code and one contract with more storage than fits in a chunk.
+	OverlayDB db;
+	TrieDB<Address, OverlayDB> t(&db);
+	t.init();
+	std::map<Address, AddressState> cache;
+	bytes code = fromHex("60016000546002600155");
+	for (unsigned i = 1; i <= 100; ++i)
+		cache[Address(i * 7919)] = AddressState(i, i * 1000, h256(), EmptySHA3);
+	for (unsigned i = 1; i <= 3; ++i)
+	{
+		AddressState& a = cache[Address(i * 104729)];
+		a = AddressState(0, i, h256(), h256());
+		a.setCode(&code);
+		for (unsigned j = 0; j < (i == 3 ? 30000u : 10u); ++j)
+			a.setStorage(j * 13 + i, (u256)sha3(toString(j)));
+	}
+	eth::commit(cache, db, t);
+
+	BlockInfo bi;
+	bi.hash = sha3("block");
+	bi.number = 42;
+	bi.stateRoot = t.root();
+
+	stringstream dump;
+	BOOST_REQUIRE_EQUAL(StateDump::write(db, bi, dump), 103u);
+	string d = dump.str();
+
+	{
+		stringstream in(d);
+		BOOST_REQUIRE(StateDump::blockOf(in) == bi.hash);
+	}
+
+	OverlayDB db2;
+	{
+		stringstream in(d);
+		BOOST_REQUIRE_EQUAL(StateDump::read(db2, bi, in), 103u);
+	}
+	TrieDB<Address, OverlayDB> t2(&db2, bi.stateRoot);
+	string rlp = t2.at(Address(3 * 104729));
+	RLP a(rlp);
+	BOOST_REQUIRE(asBytes(db2.lookup(a[3].toHash<h256>())) == code);
+	TrieDB<h256, OverlayDB> s2(&db2, a[2].toHash<h256>());
+	BOOST_REQUIRE(RLP(s2.at(h256(29999 * 13 + 3))).toInt<u256>() == (u256)sha3(toString(29999)));
+
+	// Corruption, truncation and a dump of some other state are all refused.
+	auto refused = [&](BlockInfo const& _bi, string const& _d)
+	{
+		OverlayDB db3;
+		stringstream in(_d);
+		try
+		{
+			StateDump::read(db3, _bi, in);
+		}
+		catch (InvalidStateDump const&)
+		{
+			return true;
+		}
+		return false;
+	};
+	string corrupt = d;
+	corrupt[d.size() / 2] ^= 1;
+	BOOST_REQUIRE(refused(bi, corrupt));
+	BOOST_REQUIRE(refused(bi, d.substr(0, d.size() - 4)));
+	BlockInfo other = bi;
+	other.stateRoot = sha3("other");
+	BOOST_REQUIRE(refused(other, d));
+}
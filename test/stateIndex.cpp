@@ -0,0 +1,178 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file stateIndex.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * StateIndex test functions.
+ */
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <secp256k1/secp256k1.h>
+#include <libethential/Log.h>
+#include <libethcore/TrieDB.h>
+#include <libethereum/BlockChain.h>
+#include <libethereum/State.h>
+#include <libethereum/Defaults.h>
+using namespace std;
+using namespace eth;
+
+namespace
+{
+
+/// A contract that, called with a zero word, suicides to its caller and otherwise stores the word at position 3.
+/// Its initialiser stores 1 and 2 at positions 1 and 2.
+bytes const c_contract = fromHex(
+	"6001600157" "6002600257"			// SSTORE(1, 1); SSTORE(2, 2)
+	"600f6016600039" "600f6000f2"		// CODECOPY(0, 22, 15); RETURN(0, 15)
+	"600035600859" "33ff"				// JUMPI(8, CALLDATALOAD(0)); SUICIDE(CALLER)
+	"600035600357" "00");				// SSTORE(3, CALLDATALOAD(0)); STOP
+
+bytes transaction(KeyPair const& _from, u256 _nonce, Address const& _to, u256 _value, bytes const& _data = bytes())
+{
+	Transaction t;
+	t.nonce = _nonce;
+	t.value = _value;
+	t.gasPrice = 10 * szabo;
+	t.gas = 10000;
+	t.receiveAddress = _to;
+	t.data = _data;
+	t.sign(_from.secret());
+	return t.rlp();
+}
+
+/// Mine what @a _s has executed into a block, import it and move @a _index to the new head, waiting out any
+/// rebuild. @returns the block's hash.
+h256 mineAndImport(State& _s, BlockChain& _bc, OverlayDB const& _db, StateIndex& _index)
+{
+	_s.commitToMine(_bc);
+	while (!_s.mine(100).completed) {}
+	_s.completeMine();
+	_bc.import(_s.blockData(), _db);
+	_index.moveTo(_bc);
+	_index.join();
+	_index.moveTo(_bc);
+	return BlockInfo(_s.blockData()).hash;
+}
+
+/// Check that the index is of the head's state, and that every account and storage value read through it (and the
+/// given storage positions of the given accounts, whether or not they're in the trie) matches the trie.
+void checkIndex(StateIndex const& _index, OverlayDB const& _db, BlockChain const& _bc, std::map<Address, std::vector<u256>> const& _also)
+{
+	h256 root = BlockInfo(_bc.block()).stateRoot;
+	BOOST_REQUIRE(_index.root() == root);
+	TrieDB<Address, OverlayDB> state(const_cast<OverlayDB*>(&_db), root);
+	std::string rlp;
+	unsigned accounts = 0;
+	for (auto const& i: state)
+	{
+		BOOST_REQUIRE(_index.account(root, i.first, rlp));
+		BOOST_REQUIRE(rlp == i.second.toString());
+		h256 storageRoot = RLP(i.second)[2].toHash<h256>();
+		if (storageRoot)
+		{
+			TrieDB<h256, OverlayDB> storage(const_cast<OverlayDB*>(&_db), storageRoot);
+			for (auto const& j: storage)
+			{
+				BOOST_REQUIRE(_index.storage(root, i.first, (u256)j.first, rlp));
+				BOOST_REQUIRE(rlp == j.second.toString());
+			}
+		}
+		++accounts;
+	}
+	BOOST_REQUIRE(accounts > 0);
+
+	for (auto const& i: _also)
+	{
+		std::string a = state.at(i.first);
+		BOOST_REQUIRE(_index.account(root, i.first, rlp));
+		BOOST_REQUIRE(rlp == a);
+		h256 storageRoot = a.empty() ? h256() : RLP(a)[2].toHash<h256>();
+		for (u256 p: i.second)
+		{
+			std::string v = storageRoot ? TrieDB<h256, OverlayDB>(const_cast<OverlayDB*>(&_db), storageRoot).at(h256(p)) : std::string();
+			BOOST_REQUIRE(_index.storage(root, i.first, p, rlp));
+			BOOST_REQUIRE(rlp == v);
+		}
+	}
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(stateIndex)
+{
+	cnote << "Testing StateIndex...";
+
+	secp256k1_start();
+	KeyPair myMiner = sha3("Gav's Miner");
+	KeyPair otherMiner = sha3("Gav's Other Miner");
+	Address you = sha3("123");
+	Address contract = right160(sha3(rlpList(myMiner.address(), 0)));
+
+	std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ethtest-index-%%%%%%")).string();
+	OverlayDB stateDB = State::openDB(path, true);
+	BlockChain bc(path, true);
+	auto index = make_shared<StateIndex>(stateDB);
+	State s(myMiner.address(), stateDB);
+	s.setIndex(index);
+	s.sync(bc);
+
+	// Mine to get some ether; the first move builds the index from scratch.
+	mineAndImport(s, bc, stateDB, *index);
+	s.sync(bc);
+	checkIndex(*index, stateDB, bc, {});
+
+	// Create the contract and pay someone.
+	s.execute(transaction(myMiner, 0, Address(), 1000, c_contract));
+	s.execute(transaction(myMiner, 1, you, 1000));
+	mineAndImport(s, bc, stateDB, *index);
+	s.sync(bc);
+	BOOST_REQUIRE_EQUAL(s.storage(contract, 2), 2);
+	checkIndex(*index, stateDB, bc, {{contract, {1, 2, 3}}});
+
+	// Another miner who'll fork from here.
+	State fork(otherMiner.address(), stateDB);
+	fork.setIndex(index);
+	fork.sync(bc);
+
+	// Have the contract suicide, then re-create its account by paying it, all in one block: none of its storage may
+	// be read through the index thereafter.
+	s.execute(transaction(myMiner, 2, contract, 0, bytes(32, 0)));
+	s.execute(transaction(myMiner, 3, contract, 500));
+	mineAndImport(s, bc, stateDB, *index);
+	s.sync(bc);
+	BOOST_REQUIRE_EQUAL(s.balance(contract), 500);
+	BOOST_REQUIRE_EQUAL(s.storage(contract, 1), 0);
+	checkIndex(*index, stateDB, bc, {{contract, {1, 2, 3}}});
+
+	// A longer chain from before the suicide, in which the contract lives on and stores something else, takes over.
+	h256 w = h256(u256(7));
+	fork.execute(transaction(myMiner, 2, contract, 0, w.asBytes()));
+	h256 forked = mineAndImport(fork, bc, stateDB, *index);
+	fork.sync(bc, forked);
+	fork.execute(transaction(myMiner, 3, you, 1000));
+	mineAndImport(fork, bc, stateDB, *index);
+	BOOST_REQUIRE(BlockInfo(bc.block()).coinbaseAddress == otherMiner.address());
+	s.sync(bc);
+	BOOST_REQUIRE_EQUAL(s.balance(contract), 1000);
+	BOOST_REQUIRE_EQUAL(s.storage(contract, 1), 1);
+	BOOST_REQUIRE_EQUAL(s.storage(contract, 3), 7);
+	BOOST_REQUIRE_EQUAL(s.balance(you), 2000);
+	checkIndex(*index, stateDB, bc, {{contract, {1, 2, 3}}, {you, {}}});
+
+	boost::filesystem::remove_all(path);
+}
@@ -0,0 +1,78 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file stateListing.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * Paginated account listing test functions.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethcore/KeyValueDB.h>
+#include <libethcore/TrieDB.h>
+#include <libethereum/State.h>
+using namespace std;
+using namespace eth;
+
+namespace
+{
+
+/// All of @a _s's addresses, read a page of @a _page at a time, each page starting just after the last.
+std::map<Address, u256> paged(State const& _s, unsigned _page)
+{
+	std::map<Address, u256> ret;
+	Address from;
+	while (true)
+	{
+		auto p = _s.addresses(from, _page);
+		ret.insert(p.begin(), p.end());
+		if (p.size() < _page || p.rbegin()->first == Address(~u160(0)))
+			return ret;
+		from = (u160)p.rbegin()->first + 1;
+	}
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(stateAddresses)
+{
+	cnote << "Testing paginated account listings...";
+
+	OverlayDB db(KeyValueDB::open(DBEngine::Memory, std::string()).release());
+	State s(Address(), db);
+
+	// Just the genesis accounts, all in the trie: a bare seek, and a page from the zero address, start at the first.
+	auto all = s.addresses();
+	BOOST_REQUIRE(all.size() > 3);
+	TrieDB<Address, OverlayDB> t(&db, s.rootHash());
+	BOOST_REQUIRE(t.lower_bound(Address()) == t.begin());
+	BOOST_REQUIRE((*t.lower_bound(Address())).first == all.begin()->first);
+	auto first = s.addresses(Address(), 3);
+	BOOST_REQUIRE_EQUAL(first.size(), 3u);
+	std::map<Address, u256> firstThree(all.begin(), next(all.begin(), 3));
+	BOOST_REQUIRE(first == firstThree);
+	BOOST_REQUIRE(paged(s, 3) == all);
+
+	// With accounts only in the cache, at either end and among those in the trie.
+	s.addBalance(Address(1), 1);
+	s.addBalance((u160)all.begin()->first + 1, 2);
+	s.addBalance(Address(~u160(0)), 3);
+	all = s.addresses();
+	BOOST_REQUIRE(s.addresses(Address(), 1).begin()->first == Address(1));
+	for (unsigned page: {1u, 2u, 5u, 100u})
+		BOOST_REQUIRE(paged(s, page) == all);
+}
@@ -0,0 +1,136 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file transactionQueue.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * TransactionQueue test functions.
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <secp256k1/secp256k1.h>
+#include <libethential/Log.h>
+#include <libethereum/TransactionQueue.h>
+#include <libethereum/BlockChain.h>
+#include <libethereum/State.h>
+using namespace std;
+using namespace eth;
+
+BOOST_AUTO_TEST_CASE(transactionQueue)
+{
+	cnote << "Testing TransactionQueue...";
+	secp256k1_start();
+
+	KeyPair me = sha3("Gav Wood");
+	std::vector<bytes> txs;
+	for (unsigned i = 0; i < 200; ++i)
+	{
+		Transaction t;
+		t.nonce = i;
+		t.value = 1000;
+		t.gas = 10000;
+		t.receiveAddress = Address(i + 1);
+		t.sign(me.secret());
+		txs.push_back(t.rlp());
+	}
+	reverse(txs.begin(), txs.end());
+	txs.push_back(txs.front());				// repeated.
+	txs.push_back(bytes(txs.front().size(), 0xff));	// garbage.
+
+	unsigned maxVerifiers = max(2u, thread::hardware_concurrency());
+	for (unsigned n = 1; n <= maxVerifiers; ++n)
+	{
+		TransactionQueue tq;
+		tq.setVerifiers(n);
+		h256s ignored;
+		auto start = chrono::high_resolution_clock::now();
+		unsigned imported = tq.import(txs, &ignored);
+		double secs = chrono::duration<double>(chrono::high_resolution_clock::now() - start).count();
+		cnote << n << "verifier(s):" << (unsigned)(imported / max(secs, 1e-6)) << "tx/s";
+
+		BOOST_REQUIRE_EQUAL(imported, 200u);
+		BOOST_REQUIRE_EQUAL(ignored.size(), 2u);
+		BOOST_REQUIRE_EQUAL(tq.items().first, 200u);
+		for (auto const& i: tq.verified())
+			BOOST_REQUIRE(i.second.sender() == me.address());
+		auto bs = tq.bySender();
+		BOOST_REQUIRE_EQUAL(bs.size(), 1u);
+		BOOST_REQUIRE_EQUAL(bs[me.address()].size(), 200u);
+		for (unsigned i = 0; i < 200; ++i)
+			BOOST_REQUIRE_EQUAL(bs[me.address()][i].second.nonce, i);
+
+		// Known already.
+		BOOST_REQUIRE(!tq.import(&txs[1]));
+		tq.drop(sha3(txs[1]));
+		BOOST_REQUIRE_EQUAL(tq.items().first, 199u);
+		BOOST_REQUIRE_EQUAL(tq.bySender()[me.address()].size(), 199u);
+		BOOST_REQUIRE(tq.import(&txs[1]));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(transactionQueueSync)
+{
+	cnote << "Testing State::sync() with a long chain of transactions from one sender...";
+	secp256k1_start();
+
+	KeyPair myMiner = sha3("Gav's Miner");
+	std::string path = (boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("ethtest-tq-%%%%%%")).string();
+	OverlayDB stateDB = State::openDB(path, true);
+	BlockChain bc(path, true);
+	State s(myMiner.address(), stateDB);
+	s.sync(bc);
+
+	// Mine to get some ether.
+	s.commitToMine(bc);
+	while (!s.mine(100).completed) {}
+	s.completeMine();
+	bc.attemptImport(s.blockData(), stateDB);
+	s.sync(bc);
+
+	unsigned const count = 250;
+	std::vector<bytes> txs;
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Transaction t;
+		t.nonce = i;
+		t.value = 1;
+		t.gasPrice = 10 * szabo;
+		t.gas = 500;
+		t.receiveAddress = Address(i + 1);
+		t.sign(myMiner.secret());
+		txs.push_back(t.rlp());
+	}
+
+	// Without the first, none can be executed, so all are put aside for the future.
+	TransactionQueue tq;
+	BOOST_REQUIRE_EQUAL(tq.import(std::vector<bytes>(txs.begin() + 1, txs.end())), count - 1);
+	s.sync(tq);
+	BOOST_REQUIRE_EQUAL(s.transactionsFrom(myMiner.address()), 0);
+	BOOST_REQUIRE(tq.items() == make_pair(0u, count - 1));
+
+	// With it, each that's executed brings back the next.
+	BOOST_REQUIRE(tq.import(&txs[0]));
+	auto start = chrono::high_resolution_clock::now();
+	s.sync(tq);
+	cnote << count << "transactions synced in" << chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count() << "ms";
+	BOOST_REQUIRE_EQUAL(s.transactionsFrom(myMiner.address()), count);
+	BOOST_REQUIRE(tq.items() == make_pair(count, 0u));
+
+	boost::filesystem::remove_all(path);
+}
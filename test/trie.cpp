@@ -22,8 +22,10 @@
 
 #include <fstream>
 #include <random>
+#include <thread>
 #include "JsonSpiritHeaders.h"
 #include <libethcore/TrieDB.h>
+#include <libethcore/BatchTrieDB.h>
 #include "TrieHash.h"
 #include "MemTrie.h"
 #include <boost/test/unit_test.hpp>
@@ -307,3 +309,246 @@ BOOST_AUTO_TEST_CASE(trieStess)
 	}
 }
 
+
+BOOST_AUTO_TEST_CASE(batchTrie)
+{
+	cnote << "Testing batched Trie against Trie...";
+	MemoryDB dm;
+	EnforceRefs e(dm, true);
+	GenericTrieDB<MemoryDB> d(&dm);
+	d.init();	// initialise as empty tree.
+	MemoryDB bm;
+	EnforceRefs be(bm, true);
+	GenericBatchTrieDB<MemoryDB> b(&bm);
+	b.commit();
+	for (int a = 0; a < 20; ++a)
+	{
+		StringMap m;
+		for (int i = 0; i < 50; ++i)
+		{
+			auto k = randomWord();
+			auto v = toString(i);
+			m[k] = v;
+			d.insert(k, v);
+			b.insert(k, v);
+			if (i % 7 == 0)
+				BOOST_REQUIRE_EQUAL(hash256(m), b.root());
+			if (i % 11 == 0)
+				b.commit();
+		}
+		BOOST_REQUIRE_EQUAL(d.root(), b.root());
+		for (auto const& i: m)
+			BOOST_REQUIRE_EQUAL(b.at(i.first), i.second);
+		b.commit();
+		BOOST_REQUIRE(dm.get() == bm.get());
+
+		while (!m.empty())
+		{
+			auto k = m.begin()->first;
+			d.remove(k);
+			b.remove(k);
+			m.erase(k);
+			BOOST_REQUIRE(!b.contains(k));
+			if (m.size() % 5 == 0)
+				BOOST_REQUIRE_EQUAL(hash256(m), b.root());
+			if (m.size() % 13 == 0)
+				b.commit();
+		}
+		BOOST_REQUIRE_EQUAL(d.root(), b.root());
+		b.commit();
+		BOOST_REQUIRE(dm.get() == bm.get());
+
+		// reopen on the committed root, as State does for each block.
+		b.setRoot(b.root());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(parallelBatchTrie)
+{
+	cnote << "Testing batched Trie hashed in parallel against serially...";
+	MemoryDB sm;
+	GenericBatchTrieDB<MemoryDB> s(&sm);
+	s.setHashers(1);
+	MemoryDB pm;
+	GenericBatchTrieDB<MemoryDB> p(&pm);
+	p.setHashers(max(4u, thread::hardware_concurrency()));
+	for (unsigned a = 0; a < 4; ++a)
+	{
+		// each round changes fewer keys, so both the parallel and the serial paths get taken.
+		for (unsigned i = 0; i < 4000u >> (a * 2); ++i)
+		{
+			h256 const k = sha3(toString(a * 7919 + i));
+			string v = toString(i * a);
+			s.insert(k.ref(), bytesConstRef(v));
+			p.insert(k.ref(), bytesConstRef(v));
+		}
+		for (unsigned i = 0; i < 1000u >> (a * 2); ++i)
+		{
+			h256 const k = sha3(toString(i * 3));
+			s.remove(k.ref());
+			p.remove(k.ref());
+		}
+		BOOST_REQUIRE_EQUAL(s.root(), p.root());
+		s.commit();
+		p.commit();
+		BOOST_REQUIRE_EQUAL(s.root(), p.root());
+		BOOST_REQUIRE(sm.get() == pm.get());
+	}
+}
+
+BOOST_AUTO_TEST_CASE(concurrentBatchTries)
+{
+	cnote << "Testing batched Tries hashed in parallel from several threads at once...";
+	auto fill = [](GenericBatchTrieDB<MemoryDB>& _t, unsigned _seed)
+	{
+		for (unsigned i = 0; i < 2000; ++i)
+		{
+			h256 const k = sha3(toString(_seed * 7919 + i));
+			string v = toString(i);
+			_t.insert(k.ref(), bytesConstRef(v));
+		}
+	};
+
+	// Each thread's trie shares the one worker pool with the others'.
+	std::vector<h256> roots(4);
+	std::vector<thread> threads;
+	for (unsigned t = 0; t < roots.size(); ++t)
+		threads.push_back(thread([&, t]()
+		{
+			MemoryDB m;
+			GenericBatchTrieDB<MemoryDB> p(&m);
+			p.setHashers(4);
+			for (unsigned r = 0; r < 5; ++r)
+			{
+				fill(p, t * 5 + r);
+				p.commit();
+			}
+			roots[t] = p.root();
+		}));
+	for (auto& t: threads)
+		t.join();
+
+	for (unsigned t = 0; t < roots.size(); ++t)
+	{
+		MemoryDB m;
+		GenericBatchTrieDB<MemoryDB> s(&m);
+		s.setHashers(1);
+		for (unsigned r = 0; r < 5; ++r)
+			fill(s, t * 5 + r);
+		BOOST_REQUIRE_EQUAL(s.root(), roots[t]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(trieAtMany)
+{
+	cnote << "Testing Trie multi-key lookups against single ones...";
+	MemoryDB dm;
+	GenericTrieDB<MemoryDB> d(&dm);
+	d.init();
+	vector<bytes> keys;
+	for (unsigned i = 0; i < 500; ++i)
+	{
+		string k = randomWord();
+		d.insert(k, toString(i));
+		keys.push_back(asBytes(k));
+		// some keys that aren't there: prefixes, extensions and neighbours of those that are.
+		keys.push_back(asBytes(k.substr(0, k.size() / 2)));
+		keys.push_back(asBytes(k + "x"));
+		keys.push_back(asBytes(k.substr(0, k.size() - 1) + "~"));
+	}
+	keys.push_back(bytes());
+	sort(keys.begin(), keys.end());
+	for (unsigned readers: {1u, 4u})
+	{
+		auto values = d.atMany(keys, readers);
+		BOOST_REQUIRE_EQUAL(values.size(), keys.size());
+		for (unsigned i = 0; i < keys.size(); ++i)
+			BOOST_REQUIRE_EQUAL(values[i], d.at(&keys[i]));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(trieLowerBound)
+{
+	cnote << "Testing Trie seeks against an ordered map...";
+	for (int a = 0; a < 20; ++a)
+	{
+		MemoryDB dm;
+		GenericTrieDB<MemoryDB> d(&dm);
+		d.init();
+		StringMap m;
+		for (int i = 0; i < 1 + a * 10; ++i)
+		{
+			auto k = randomWord();
+			m[k] = toString(i);
+			d.insert(k, m[k]);
+		}
+		vector<string> probes = { "", "\xff\xff" };
+		for (auto const& i: m)
+		{
+			// the key itself, something just before and just after it, and its prefixes.
+			probes.push_back(i.first);
+			probes.push_back(i.first + '\0');
+			probes.push_back(i.first.substr(0, i.first.size() - 1) + char(i.first.back() - 1));
+			for (unsigned j = 0; j < i.first.size(); ++j)
+				probes.push_back(i.first.substr(0, j));
+		}
+		for (auto const& p: probes)
+		{
+			auto mit = m.lower_bound(p);
+			auto dit = d.lower_bound(bytesConstRef(p));
+			for (unsigned j = 0; j < 3 && mit != m.end(); ++j, ++mit, ++dit)
+			{
+				BOOST_REQUIRE(dit != d.end());
+				BOOST_REQUIRE_EQUAL((*dit).first.toString(), mit->first);
+				BOOST_REQUIRE_EQUAL((*dit).second.toString(), mit->second);
+			}
+			if (mit == m.end())
+				BOOST_REQUIRE(dit == d.end());
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(memoryDB)
+{
+	cnote << "Testing MemoryDB...";
+
+	// Enough nodes for the table to grow several times and the arena to need several blocks, one too big for any.
+	MemoryDB m;
+	std::vector<bytes> vs;
+	for (unsigned i = 0; i < 5000; ++i)
+		vs.push_back(sha3Bytes(toString(i)) + bytes(i % 100, (byte)i));
+	vs.push_back(bytes(100000, 42));
+	for (auto const& v: vs)
+		m.insert(sha3(v), &v);
+	m.insert(sha3(vs[0]), &vs[0]);
+	for (auto const& v: vs)
+		BOOST_REQUIRE(m.lookup(sha3(v)) == asString(v));
+	BOOST_REQUIRE(m.lookup(sha3("absent")).empty());
+
+	// Copies are independent once written.
+	MemoryDB c = m;
+	for (unsigned i = 1; i < vs.size(); i += 2)
+		m.kill(sha3(vs[i]));
+	m.kill(sha3(vs[0]));
+	BOOST_REQUIRE_EQUAL(m.keys().size(), vs.size() - vs.size() / 2);
+	BOOST_REQUIRE_EQUAL(c.keys().size(), vs.size());
+	{
+		EnforceRefs r(m, true);
+		BOOST_REQUIRE(m.exists(sha3(vs[0])) && !m.exists(sha3(vs[1])));
+	}
+	BOOST_REQUIRE(m.exists(sha3(vs[1])));
+
+	// Purging drops the unreferenced, keeping the rest and their counts.
+	m.purge();
+	BOOST_REQUIRE(!m.exists(sha3(vs[1])));
+	for (unsigned i = 0; i < vs.size(); i += 2)
+		BOOST_REQUIRE(m.lookup(sha3(vs[i])) == asString(vs[i]));
+	m.kill(sha3(vs[0]));
+	BOOST_REQUIRE(m.keys().count(sha3(vs[0])) == 0);
+	BOOST_REQUIRE(c.lookup(sha3(vs[1])) == asString(vs[1]));
+
+	c.clear();
+	BOOST_REQUIRE(c.keys().empty() && c.lookup(sha3(vs[2])).empty());
+	c.insert(sha3(vs[2]), &vs[2]);
+	BOOST_REQUIRE(c.lookup(sha3(vs[2])) == asString(vs[2]));
+}
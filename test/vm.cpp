@@ -21,7 +21,11 @@
  */
 
 #include <fstream>
+#include <chrono>
 #include <cstdint>
+#include <random>
+#include <typeinfo>
+#include <sstream>
 #include <libethential/Log.h>
 #include <libevmface/Instruction.h>
 #include <libevm/ExtVMFace.h>
@@ -471,6 +475,30 @@ void doTests(json_spirit::mValue& v, bool _fillin)
 
 } } // Namespace Close
 
+namespace
+{
+
+/// The ways code can be run: interpreted a byte at a time, or pre-decoded and then run by either core.
+struct Tier
+{
+	char const* name;
+	VMCore core;
+	unsigned decodeAfter;
+};
+Tier const c_interpreted = {"interpreted", VMCore::Switch, ~0u};
+Tier const c_preDecoded = {"pre-decoded", VMCore::Switch, 0};
+Tier const c_preDecodedThreaded = {"pre-decoded, threaded", VMCore::Threaded, 0};
+
+void useTier(Tier const& _t)
+{
+	VM::setCore(_t.core);
+	VM::setDecodeAfter(_t.decodeAfter);
+}
+
+Tier const c_defaultTier = {"default", VM::core(), VM::decodeAfter()};
+
+}
+
 BOOST_AUTO_TEST_CASE(vm_tests)
 {
 	// Populate tests first:
@@ -481,6 +509,7 @@ BOOST_AUTO_TEST_CASE(vm_tests)
 		string s = asString(contents("../../../cpp-ethereum/test/vmtests.json"));
 		BOOST_REQUIRE_MESSAGE(s.length() > 0, "Contents of 'vmtests.json' is empty.");
 		json_spirit::read_string(s, v);
+		useTier(c_interpreted);
 		eth::test::doTests(v, true);
 		writeFile("../../../tests/vmtests.json", asBytes(json_spirit::write_string(v, true)));
 	}
@@ -496,10 +525,218 @@ BOOST_AUTO_TEST_CASE(vm_tests)
 		string s = asString(contents("../../../tests/vmtests.json"));
 		BOOST_REQUIRE_MESSAGE(s.length() > 0, "Contents of 'vmtests.json' is empty. Have you cloned the 'tests' repo branch develop?");
 		json_spirit::read_string(s, v);
-		eth::test::doTests(v, false);
+		// Filled in by the interpreter, so pre-decoded code must agree with it.
+		for (Tier const& t: {c_interpreted, c_preDecoded, c_preDecodedThreaded})
+		{
+			cnote << "..." << t.name;
+			useTier(t);
+			eth::test::doTests(v, false);
+		}
 	}
 	catch (std::exception const& e)
 	{
 		BOOST_ERROR("Failed VM Test with Exception: " << e.what()); 
 	}
+	useTier(c_defaultTier);
+}
+
+BOOST_AUTO_TEST_CASE(vm_cores)
+{
+	cnote << "Testing VM tiers and cores against each other...";
+
+	struct Outcome
+	{
+		bool operator==(Outcome const& _c) const { return exception == _c.exception && gas == _c.gas && out == _c.out && stack == _c.stack && memory == _c.memory && addresses == _c.addresses && callcreates == _c.callcreates; }
+
+		std::string exception;
+		u256 gas;
+		bytes out;
+		u256s stack;
+		bytes memory;
+		decltype(eth::test::FakeExtVM::addresses) addresses;
+		Transactions callcreates;
+	};
+
+	auto run = [](Tier const& _tier, bytes const& _code, bytes const& _data, u256 _gas)
+	{
+		useTier(_tier);
+		eth::test::FakeExtVM fev;
+		fev.setContract(right160(sha3("contract")), 1000, 0, map<u256, u256>(), _code);
+		fev.setTransaction(right160(sha3("sender")), 5, 1, _data);
+		fev.code = &_code;
+		VM vm(_gas);
+		Outcome ret;
+		try
+		{
+			ret.out = vm.go(fev).toBytes();
+		}
+		catch (VMException const& _e)
+		{
+			ret.exception = typeid(_e).name();
+		}
+		ret.gas = vm.gas();
+		ret.stack = vm.stack();
+		ret.memory = vm.memory().toBytes();
+		ret.addresses = fev.addresses;
+		ret.callcreates = fev.callcreates;
+		return ret;
+	};
+
+	// Instructions that can't touch memory, and so can be jumped to with anything at all on the stack.
+	bytes anywhere;
+	for (unsigned i = 0; i < 256; ++i)
+		if ((i < 0x14 || (i >= 0x30 && i <= 0x3a) || (i >= 0x40 && i <= 0x5c) || (i >= 0x60 && i <= 0x7f) || i == 0xff || i == 0x21 || i == 0xa0)
+			&& i != 0x35 && i != 0x37 && i != 0x39 && (i < 0x53 || i > 0x55))
+			anywhere.push_back(i);
+	// Instructions that work on memory, each with operands that keep it within bounds.
+	std::vector<std::pair<byte, unsigned>> memoryOps = {{0x53, 1}, {0x54, 2}, {0x55, 2}, {0x20, 2}, {0x35, 1}, {0x37, 3}, {0x39, 3}, {0xf2, 2}, {0xf1, 7}, {0xf0, 3}};
+
+	std::mt19937 rng(1);
+	for (unsigned t = 0; t < 4000; ++t)
+	{
+		// Half go anywhere, even into PUSH data; the rest use memory but never jump, so operands stay where they're put.
+		bool jumpy = t % 2;
+		bytes code;
+		unsigned size = rng() % 80 + 1;
+		while (code.size() < size)
+		{
+			unsigned r = rng() % 10;
+			if (r < 3)
+			{
+				code.push_back(0x60);
+				code.push_back(rng() % size);
+			}
+			else if (jumpy || r < 7)
+			{
+				byte b = anywhere[rng() % anywhere.size()];
+				if (!jumpy && (b == 0x58 || b == 0x59))
+					continue;
+				code.push_back(b);
+				if (b >= 0x60 && b <= 0x7f)
+					for (unsigned i = b - 0x5f; i--;)
+						code.push_back(jumpy ? anywhere[rng() % anywhere.size()] : (byte)rng());
+			}
+			else
+			{
+				auto const& m = memoryOps[rng() % memoryOps.size()];
+				for (unsigned i = 0; i < m.second; ++i)
+				{
+					code.push_back(0x60);
+					code.push_back(rng() % 100);
+				}
+				code.push_back(m.first);
+			}
+		}
+		bytes data(rng() % 40);
+		for (auto& i: data)
+			i = (byte)rng();
+		u256 gas = rng() % 3000;
+
+		Outcome in = run(c_interpreted, code, data, gas);
+		Outcome s = run(c_preDecoded, code, data, gas);
+		Outcome th = run(c_preDecodedThreaded, code, data, gas);
+		BOOST_REQUIRE_MESSAGE(s == th, "Cores differ on " << toHex(code) << " with " << gas << " gas: " << s.exception << "/" << th.exception << ", " << s.gas << "/" << th.gas);
+
+		// Pre-decoded code pays for whole blocks up front, so when it runs out of gas it may have got less far. Since that
+		// reverts everything, all that need agree then is that it did.
+		bool outOfGas = in.exception == typeid(OutOfGas).name();
+		BOOST_REQUIRE_MESSAGE(outOfGas ? in.exception == s.exception && in.gas == s.gas : in == s, "Tiers differ on " << toHex(code) << " with " << gas << " gas: " << in.exception << "/" << s.exception << ", " << in.gas << "/" << s.gas);
+	}
+	useTier(c_defaultTier);
+}
+
+BOOST_AUTO_TEST_CASE(vm_bench)
+{
+	cnote << "Timing the default against always pre-decoding, and against interpreting...";
+
+	// Count down from 100000, then the same with some arithmetic thrown away in the loop.
+	std::vector<bytes> programs = {
+		{0x62, 0x01, 0x86, 0xa0, 0x60, 0x01, 0x52, 0x03, 0x51, 0x60, 0x04, 0x59},
+		{0x62, 0x01, 0x86, 0xa0, 0x60, 0x01, 0x52, 0x60, 7, 0x60, 3, 0x02, 0x60, 5, 0x06, 0x50, 0x03, 0x51, 0x60, 0x04, 0x59}
+	};
+	for (bytes& code: programs)
+	{
+		// Each tier sees the code as new, as it would be the first time it's run.
+		unsigned tiers = 0;
+		auto run = [&](Tier const& _tier, double& o_ms)
+		{
+			useTier(_tier);
+			eth::test::FakeExtVM fev;
+			fev.code = &code;
+			fev.codeHash = sha3(asString(code) + toString(++tiers));
+			VM vm(100000000);
+			auto start = chrono::high_resolution_clock::now();
+			vm.go(fev);
+			o_ms = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - start).count();
+			return make_pair(vm.gas(), vm.memory().toBytes());
+		};
+		// What ran before tiering was made configurable: everything pre-decoded, on the threaded core where there is one.
+		Tier const preTiering = {"pre-decoded, threaded", c_defaultTier.core, 0};
+		double defaultMs;
+		double preTieringMs;
+		double interpretedMs;
+		auto byDefault = run(c_defaultTier, defaultMs);
+		auto preDecoded = run(preTiering, preTieringMs);
+		auto interpreted = run(c_interpreted, interpretedMs);
+		BOOST_REQUIRE(byDefault == preDecoded);
+		BOOST_REQUIRE(byDefault == interpreted);
+		cnote << toHex(code) << ": default" << defaultMs << "ms, always pre-decoded" << preTieringMs << "ms, interpreted" << interpretedMs << "ms";
+	}
+	useTier(c_defaultTier);
+}
+
+BOOST_AUTO_TEST_CASE(vm_trace)
+{
+	cnote << "Testing VM trace recording...";
+
+	// Count down from 5.
+	bytes code = {0x60, 5, 0x60, 1, 0x52, 0x03, 0x51, 0x60, 2, 0x59};
+	auto run = [&](std::function<bytesConstRef(VM&, eth::test::FakeExtVM&)> const& _go)
+	{
+		eth::test::FakeExtVM fev;
+		fev.code = &code;
+		VM vm(1000);
+		_go(vm, fev);
+		return vm.gas();
+	};
+
+	// What an OnOpFunc sees...
+	std::vector<TraceEntry> seen;
+	u256 gas = run([&](VM& vm, eth::test::FakeExtVM& fev)
+	{
+		return vm.go(fev, [&](uint64_t, Instruction _inst, unsigned, bigint, void* _vm, void const*)
+		{
+			TraceEntry e;
+			e.inst = _inst;
+			e.pc = ((VM*)_vm)->pc();
+			e.gas = (uint64_t)((VM*)_vm)->gas();
+			seen.push_back(e);
+		});
+	});
+	BOOST_REQUIRE_EQUAL(seen.size(), 2u + 5 * 6);
+	BOOST_REQUIRE(run([](VM& vm, eth::test::FakeExtVM& fev) { return vm.go(fev); }) == gas);
+
+	// ...is what's recorded, whether through go() or run().
+	TraceRecorder r;
+	BOOST_REQUIRE(run([&](VM& vm, eth::test::FakeExtVM& fev) { return vm.go(fev, r.onOp()); }) == gas);
+	BOOST_REQUIRE(r.entries() == seen);
+	r.clear();
+	BOOST_REQUIRE(run([&](VM& vm, eth::test::FakeExtVM& fev) { return vm.run(fev, r); }) == gas);
+	BOOST_REQUIRE(r.entries() == seen);
+
+	// Only the last so many are kept.
+	TraceRecorder small(5);
+	run([&](VM& vm, eth::test::FakeExtVM& fev) { return vm.go(fev, small.onOp()); });
+	BOOST_REQUIRE_EQUAL(small.total(), seen.size());
+	BOOST_REQUIRE(small.entries() == std::vector<TraceEntry>(seen.end() - 8, seen.end()));
+
+	// Dumps read back the same.
+	std::stringstream ss;
+	r.writeBinary(ss);
+	BOOST_REQUIRE(TraceRecorder::readBinary(ss) == seen);
+	std::stringstream bad("EVMX");
+	BOOST_CHECK_THROW(TraceRecorder::readBinary(bad), BadTrace);
+	// A dump claiming more entries than it has.
+	std::stringstream truncated(ss.str().substr(0, 4) + std::string(4, '\xff') + ss.str().substr(8, 30));
+	BOOST_CHECK_THROW(TraceRecorder::readBinary(truncated), BadTrace);
 }
@@ -0,0 +1,99 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file vmPool.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * VM pool and memory test functions.
+ */
+
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libevm/VM.h>
+using namespace std;
+using namespace eth;
+
+namespace
+{
+
+bool allZero(bytesConstRef _b)
+{
+	for (auto i: _b)
+		if (i)
+			return false;
+	return true;
+}
+
+}
+
+BOOST_AUTO_TEST_CASE(vmMemory)
+{
+	cnote << "Testing VMMemory...";
+
+	// A little use (zeroed in place), a lot (outgrowing the first reservation, whose pages are handed back), then enough
+	// to outgrow any reservation.
+	for (size_t n: {size_t(1000), size_t(1 << 20), size_t(300 << 20)})
+	{
+		VMMemory m;
+		size_t reserved = m.reserved();
+		for (unsigned round = 0; round < 2; ++round)
+		{
+			BOOST_REQUIRE_EQUAL(m.size(), 0u);
+			m.grow(64);
+			byte* first = m.data();
+			memset(m.data(), 0xff, 64);
+			m.grow(n);
+			BOOST_REQUIRE_EQUAL(m.size(), n);
+			BOOST_REQUIRE(m.data()[63] == 0xff);
+			BOOST_REQUIRE(allZero(m.ref().cropped(64)));
+			if (m.inPlace() && m.reserved() == reserved)
+				BOOST_REQUIRE(m.data() == first);
+			memset(m.data(), 0xaa, n);
+			m.grow(n / 2);
+			BOOST_REQUIRE_EQUAL(m.size(), n);
+			m.clear();
+			m.grow(n);
+			BOOST_REQUIRE(allZero(m.ref()));
+			m.clear();
+			BOOST_REQUIRE_EQUAL(m.reserved(), reserved);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(vmPool)
+{
+	cnote << "Testing VM pool...";
+
+	VM* outer;
+	VM* inner;
+	{
+		PooledVM a = pooledVM(100);
+		PooledVM b = pooledVM(200);
+		BOOST_REQUIRE(a.get() != b.get());
+		outer = a.get();
+		inner = b.get();
+		a->requireMem(96);
+	}
+
+	// Both come back, last returned first, as new.
+	PooledVM c = pooledVM(300);
+	PooledVM d = pooledVM(400);
+	BOOST_REQUIRE(c.get() == outer);
+	BOOST_REQUIRE(d.get() == inner);
+	BOOST_REQUIRE(c->gas() == 300);
+	BOOST_REQUIRE(c->memory().empty());
+	BOOST_REQUIRE(c->stack().empty());
+}
@@ -0,0 +1,76 @@
+/*
+	This file is part of cpp-ethereum.
+
+	cpp-ethereum is free software: you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	cpp-ethereum is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with cpp-ethereum.  If not, see <http://www.gnu.org/licenses/>.
+*/
+/** @file w256.cpp
+ * @author Gav Wood <i@gavwood.com>
+ * @date 2014
+ * w256 test functions.
+ */
+
+#include <random>
+#include <boost/test/unit_test.hpp>
+#include <libethential/Log.h>
+#include <libethential/W256.h>
+using namespace std;
+using namespace eth;
+
+BOOST_AUTO_TEST_CASE(w256Arithmetic)
+{
+	cnote << "Testing w256...";
+
+	// Values of every width, and the edges, checked against u256.
+	std::mt19937_64 rng(42);
+	auto random = [&]()
+	{
+		u256 ret;
+		switch (rng() % 6)
+		{
+		case 0: return u256(rng() % 4);
+		case 1: return ~u256(rng() % 4);
+		case 2: return u256(1) << 255;
+		default:
+			for (unsigned i = 0, n = rng() % 8 + 1; i < n; ++i)
+				ret = (ret << 32) | (uint32_t)rng();
+			return ret;
+		}
+	};
+
+	for (unsigned i = 0; i < 20000; ++i)
+	{
+		u256 a = random();
+		u256 b = random();
+		w256 wa(a);
+		w256 wb(b);
+		BOOST_REQUIRE(wa.toU256() == a);
+		BOOST_REQUIRE(w256(h256(a)).toHash() == h256(a));
+		BOOST_REQUIRE((wa + wb).toU256() == a + b);
+		BOOST_REQUIRE((wa - wb).toU256() == a - b);
+		BOOST_REQUIRE((wa * wb).toU256() == a * b);
+		BOOST_REQUIRE((wa / wb).toU256() == (b ? a / b : 0));
+		BOOST_REQUIRE((wa % wb).toU256() == (b ? a % b : 0));
+		BOOST_REQUIRE(wa.sdiv(wb).toU256() == (b ? s2u(u2s(a) / u2s(b)) : 0));
+		BOOST_REQUIRE(wa.smod(wb).toU256() == (b ? s2u(u2s(a) % u2s(b)) : 0));
+		BOOST_REQUIRE((wa < wb) == (a < b));
+		BOOST_REQUIRE(wa.slt(wb) == (u2s(a) < u2s(b)));
+		BOOST_REQUIRE((wa == wb) == (a == b));
+		BOOST_REQUIRE((wa ^ ~wb).toU256() == (a ^ ~b));
+		unsigned s = rng() % 300;
+		BOOST_REQUIRE((wa << s).toU256() == (s < 256 ? a << s : 0));
+		BOOST_REQUIRE((wa >> s).toU256() == (s < 256 ? a >> s : 0));
+		BOOST_REQUIRE(wa.byteAt(s % 32) == (byte)((a >> (8 * (31 - s % 32))) & 0xff));
+		BOOST_REQUIRE(wa.pow(s).toU256() == boost::multiprecision::pow(a, s));
+	}
+}